@@ -0,0 +1,68 @@
+/**
+ *  Hardware timed acquisition
+ *  TIM2 runs at 1MHz, the update ISR extends it to a 32 bits microseconds
+ *  timebase and the channel 1 compare event paces the sensor reads.
+ *  Every sample is pushed into a single producer ring, each consumer
+ *  (UI, plot, logger) keeps its own tail and reads at its own rate.
+ */
+
+#ifndef __ACQUISITION_H
+#define __ACQUISITION_H
+
+#include "main.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SampleFifoSize 32 //Must be a power of 2
+#define JitterBins 16     //Bin n holds the deviations of n significant bits, in us
+#define DefaultSamplePeriod 120000 //us, BH1750 high resolution conversion time
+
+typedef bool (*SampleSource)(float *Lux);
+
+typedef struct Sample
+{
+	uint32_t Timestamp; //us
+	float Lux;
+}Sample;
+
+typedef void (*SampleHook)(const Sample *New); //Runs inside the ISR, keep it short
+
+typedef struct SampleReader
+{
+	uint32_t Tail;
+	uint32_t Lost; //Samples overwritten before this reader got them
+}SampleReader;
+
+typedef struct Jitter
+{
+	uint32_t Histogram[JitterBins];
+	uint32_t Max; //us
+	uint32_t Intervals;
+}Jitter;
+
+typedef struct AcquisitionStatus
+{
+	uint32_t Samples;
+	uint32_t ReadErrors;
+	bool LastReadFailed;
+	bool Running;
+}AcquisitionStatus;
+
+extern volatile AcquisitionStatus AcqStatus;
+extern volatile Jitter SampleJitter;
+
+void Acquisition_Init(TIM_HandleTypeDef *htim, SampleSource Source, uint32_t Period);
+void Acquisition_SetHook(SampleHook Hook);
+void Acquisition_Start(void);
+void Acquisition_Stop(void);
+void Acquisition_SetPeriod(uint32_t Period);
+uint32_t Acquisition_GetPeriod(void);
+uint32_t Acquisition_Micros(void);
+void Acquisition_ReaderInit(SampleReader *Reader);
+bool Acquisition_Pop(SampleReader *Reader, Sample *Out);
+bool Acquisition_Latest(Sample *Out);
+void Acquisition_JitterReset(void);
+void Acquisition_OverflowISR(void);
+void Acquisition_CompareISR(void);
+
+#endif /* __ACQUISITION_H */
@@ -0,0 +1,80 @@
+/**
+ *  Adaptive sampling rate
+ *  The activity is the rate of change of the lux in per mille of the level
+ *  per second, past a noise deadband. It rises at once with the samples
+ *  and decays with a time constant, so a fluctuating source keeps it up
+ *  as well as a ramp does.
+ *  Above RiseThreshold the sensor goes to the fast rate, after Calm
+ *  seconds below FallThreshold it steps down one rate, down to a slow
+ *  heartbeat in one shot mode where the BH1750 powers down between
+ *  conversions.
+ *  The rates only change the period, the resolution stays the one the
+ *  user chose. A rate can't sample faster than the sensor converts, so
+ *  with the H resolutions (120ms) the fast rate runs as the normal one
+ *  and only the low resolution (16ms) gets faster.
+ *  The estimate of the I2C traffic and the current comes from the time
+ *  spent on each rate, the samples taken and the display redraws.
+ */
+
+#ifndef __ADAPTIVERATE_H
+#define __ADAPTIVERATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum RateLevel
+{
+	Rate_Heartbeat,
+	Rate_Normal,
+	Rate_Fast,
+	Rate_Levels
+}RateLevel;
+
+typedef struct RateTier
+{
+	uint32_t Period;     //us
+	uint32_t ActiveTime; //us the sensor is converting on each period
+	bool OneShot;        //Powered down between conversions, needs a command per sample
+}RateTier;
+
+typedef struct RateSettings
+{
+	uint16_t NoiseFloor;      //lux, changes below it are quantization
+	uint16_t NoiseRelative;   //Per mille of the level, changes below it are noise
+	uint16_t RiseThreshold;   //Per mille of the level per second
+	uint16_t FallThreshold;   //Per mille of the level per second
+	uint16_t Calm;            //s below FallThreshold before stepping down
+}RateSettings;
+
+typedef struct RateEstimate
+{
+	uint32_t TransactionsPerMinute;
+	uint32_t BytesPerMinute;
+	uint32_t MicroAmps; //Sensor supply plus the I2C pull-ups
+}RateEstimate;
+
+typedef struct AdaptiveRate
+{
+	RateLevel Level;     //Wanted by the controller
+	RateLevel Applied;   //Running on the sensor
+	uint32_t Activity;   //Per mille per second
+	int32_t LastSample;  //Q4 lux
+	uint32_t LastTimestamp;
+	uint32_t CalmSince;
+	bool Primed;
+	//Instrumentation
+	uint64_t Time[Rate_Levels]; //us
+	uint32_t Samples[Rate_Levels];
+	uint32_t Redraws;
+	uint32_t Transitions;
+}AdaptiveRate;
+
+extern const RateTier RateTiers[Rate_Levels];
+
+void AdaptiveRate_Init(AdaptiveRate *Rate, RateLevel Applied);
+RateLevel AdaptiveRate_Update(AdaptiveRate *Rate, const RateSettings *Settings, float Lux, uint32_t Timestamp);
+void AdaptiveRate_Apply(AdaptiveRate *Rate, RateLevel Level);
+void AdaptiveRate_Estimate(const AdaptiveRate *Rate, RateEstimate *Out);
+uint32_t AdaptiveRate_Period(RateLevel Level, uint32_t Conversion);
+
+#endif /* __ADAPTIVERATE_H */
@@ -0,0 +1,70 @@
+/**
+ *  Threshold alarm
+ *  Runs from the acquisition ISR right after the sensor read, the pin is
+ *  driven before the main loop even knows about the sample, so the UI
+ *  can't delay it.
+ *  High: enters above High, leaves below High - Hysteresis
+ *  Low: enters below Low, leaves above Low + Hysteresis
+ *  Every crossing (entering or leaving) records the AlarmPreTrigger
+ *  samples before it and the AlarmPostTrigger samples after it.
+ *  Latency: from the compare event that started the read to the pin
+ *  write, it covers the ISR entry, the I2C read and the evaluation. The
+ *  sensor data itself is at most one conversion old when it's read.
+ */
+
+#ifndef __ALARM_H
+#define __ALARM_H
+
+#include "main.h"
+#include "Acquisition.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define AlarmPort GPIOC
+#define AlarmPin GPIO_PIN_13
+#define AlarmPreTrigger 16
+#define AlarmPostTrigger 16
+#define AlarmCaptureSize (AlarmPreTrigger + 1 + AlarmPostTrigger)
+#define AlarmLatencyBound 500 //us, compare event to pin, only a read running into its timeout goes past it
+
+typedef enum AlarmState
+{
+	Alarm_Normal,
+	Alarm_High,
+	Alarm_Low
+}AlarmState;
+
+typedef struct AlarmConfigs
+{
+	uint16_t High;       //lux, 0 disables it
+	uint16_t Low;        //lux, 0 disables it
+	uint16_t Hysteresis; //lux
+}AlarmConfigs;
+
+typedef struct AlarmCapture
+{
+	Sample Samples[AlarmCaptureSize];
+	uint16_t Trigger; //Index of the crossing sample, less than AlarmPreTrigger right after boot
+	uint16_t Filled;
+	AlarmState From;
+	AlarmState To;
+	uint32_t Sequence; //Changes with every new capture
+}AlarmCapture;
+
+typedef struct AlarmStatus
+{
+	AlarmState State;
+	uint32_t Crossings;
+	uint32_t Latency;    //us, last pin write
+	uint32_t MaxLatency; //us
+	uint32_t OverBound;  //Pin writes later than AlarmLatencyBound
+}AlarmStatus;
+
+extern volatile AlarmStatus AlarmInfo;
+
+void Alarm_Init(const AlarmConfigs *Configs);
+bool Alarm_GetCapture(AlarmCapture *Out);
+void Alarm_LatencyReset(void);
+void Alarm_SampleISR(const Sample *New);
+
+#endif /* __ALARM_H */
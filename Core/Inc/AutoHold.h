@@ -0,0 +1,52 @@
+/**
+ *  Auto hold
+ *  Sliding window of the last samples with a running sum and sum of
+ *  squares, the variance costs O(1) per sample and doesn't drift because
+ *  the sums are exact integers (Q4 lux, Q8 lux^2).
+ *  The reading is held once the window standard deviation is below
+ *  max(AbsoluteThreshold, RelativeThreshold * mean).
+ *  Confidence: 100% with no noise, 50% exactly at the threshold, below
+ *  50% only when the hold was forced by the timeout.
+ */
+
+#ifndef __AUTOHOLD_H
+#define __AUTOHOLD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define AutoHoldWindow 16
+
+typedef struct AutoHoldConfigs
+{
+	uint16_t RelativeThreshold; //Tenths of percent of the mean
+	uint16_t AbsoluteThreshold; //lux, covers the quantization at low light
+	uint16_t Timeout;           //s
+}AutoHoldConfigs;
+
+typedef struct AutoHold
+{
+	int32_t Window[AutoHoldWindow]; //Q4 lux
+	uint16_t Index;
+	uint16_t Filled;
+	int64_t Sum;
+	int64_t SumSquares;
+	uint32_t Start;      //Timestamp of the first sample, us
+	bool Held;
+	float Value;
+	float StdDev;
+	uint8_t Confidence;  //%
+	uint32_t TimeToHold; //us
+	//Instrumentation of the time to hold
+	uint32_t Holds;
+	uint32_t Timeouts;
+	uint64_t TotalTimeToHold;
+	uint32_t MaxTimeToHold;
+}AutoHold;
+
+void AutoHold_Init(AutoHold *Hold);
+void AutoHold_Start(AutoHold *Hold);
+bool AutoHold_Update(AutoHold *Hold, const AutoHoldConfigs *Configs, float Lux, uint32_t Timestamp);
+uint32_t AutoHold_AverageTimeToHold(const AutoHold *Hold);
+
+#endif /* __AUTOHOLD_H */
@@ -0,0 +1,24 @@
+/**
+ *  BH1750 continuous measurement mode
+ *  BH1750_Read sends a one shot command and waits 120ms with HAL_Delay,
+ *  which is too long for the acquisition ISR. In continuous mode the
+ *  sensor keeps converting on its own and a read is only the 2 bytes of
+ *  the last finished conversion (~70us at 400kHz).
+ *  The one shot start is for the slow rates, the sensor powers down
+ *  between conversions instead of drawing ~120uA all the time.
+ */
+
+#ifndef __BH1750_CONTINUOUS_H
+#define __BH1750_CONTINUOUS_H
+
+#include "main.h"
+#include "Rojo_BH1750.h"
+
+#define BH1750_ReadTimeout 500 //us, a read is ~75us on the wire, keeps a stuck bus from holding the ISR
+
+Rojo_Status BH1750_ContinuousStart(Rojo_BH1750 *Head, BH1750_Resolutions Resolution);
+Rojo_Status BH1750_OneShotStart(Rojo_BH1750 *Head, BH1750_Resolutions Resolution);
+Rojo_Status BH1750_ContinuousRead(Rojo_BH1750 *Head, float *Lux);
+uint32_t BH1750_ConversionTime(BH1750_Resolutions Resolution);
+
+#endif /* __BH1750_CONTINUOUS_H */
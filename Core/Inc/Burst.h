@@ -0,0 +1,45 @@
+/**
+ *  Burst capture
+ *  Records a fixed window of samples into a preallocated buffer straight
+ *  from the acquisition ISR, the main loop (display flushes, IWDG
+ *  refreshes) has no way to slow the capture down or to drop samples.
+ *  With a trigger the recording starts on the first sample that moves
+ *  more than Trigger lux away from the level seen when it was armed,
+ *  which catches a switch-on ramp from its beginning.
+ */
+
+#ifndef __BURST_H
+#define __BURST_H
+
+#include "Acquisition.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BurstSize 256 //2KB, 4s at the 16ms of the L resolution mode
+
+typedef enum BurstState
+{
+	Burst_Idle,
+	Burst_Armed,
+	Burst_Recording,
+	Burst_Done
+}BurstState;
+
+typedef struct Burst
+{
+	Sample Samples[BurstSize];
+	volatile uint16_t Count;
+	volatile BurstState State;
+	uint32_t Window;  //us
+	uint16_t Trigger; //lux, 0 starts with the next sample
+	float Reference;  //lux when armed
+	bool ReferenceValid;
+}Burst;
+
+void Burst_Init(Burst *Capture);
+void Burst_Arm(Burst *Capture, uint32_t Window, uint16_t Trigger);
+uint32_t Burst_Duration(const Burst *Capture);
+uint32_t Burst_MaxInterval(const Burst *Capture);
+void Burst_SampleISR(Burst *Capture, const Sample *New);
+
+#endif /* __BURST_H */
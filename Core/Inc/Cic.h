@@ -0,0 +1,33 @@
+/**
+ *  CIC decimator
+ *  N integrators at the input rate and N combs at the output rate, no
+ *  multiplications in the sample path. The registers wrap modulo 2^32,
+ *  which is exact as long as the gain Ratio^N times the input range fits
+ *  in 32 bits: 12 bits ADC samples allow a Ratio up to 101 with N = 3.
+ *  The response has nulls at every multiple of the output rate, with the
+ *  ADC at 9.6kHz and Ratio 96 the 100Hz ripple of 50Hz lamps is removed.
+ *  Away from the nulls it's only sinc^3: the 120Hz ripple of 60Hz lamps
+ *  comes out at 0.4% and a 50Hz flicker at 26%, aliased below 50Hz.
+ */
+
+#ifndef __CIC_H
+#define __CIC_H
+
+#include <stdint.h>
+
+#define CicOrder 3
+
+typedef struct Cic
+{
+	uint32_t Integrators[CicOrder];
+	uint32_t Delays[CicOrder]; //Comb memory
+	uint32_t Gain;             //Ratio^N
+	uint16_t Ratio;
+	uint16_t Phase;
+	uint16_t Settling;         //Outputs left before the combs are filled
+}Cic;
+
+void Cic_Init(Cic *Filter, uint16_t Ratio);
+uint16_t Cic_Process(Cic *Filter, const uint16_t *In, uint16_t Length, uint16_t *Out);
+
+#endif /* __CIC_H */
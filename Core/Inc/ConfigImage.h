@@ -0,0 +1,76 @@
+/**
+ *  Persistent configuration image
+ *  All the settings that survive a power cycle packed in one block of
+ *  the EEPROM, loaded with the rest of the EepromCache in one read:
+ *  0x08 Header: magic, version, body length, CRC-32 of the body
+ *  0x10 Body:   the settings, little endian, no padding
+ *  The CRC is the one of the STM32 CRC unit (CRC-32/MPEG-2 over the body
+ *  in 32 bit words, the tail zero padded).
+ *  Versions only append fields to the body. An image of an older version
+ *  is valid with its own length, the fields it doesn't have keep the
+ *  values the caller put in the body before (the defaults), so it's
+ *  migrated just by saving it again. A newer version than this firmware
+ *  knows is checked with its own length and read up to the fields this
+ *  one knows, a save from this firmware writes it back as this version.
+ *  Version 0 is the layout before the image: the mode and the resolution
+ *  bytes at 0x01 and 0x02, main.c reads those and translates the mode,
+ *  the modes added since then were inserted before Reset_Sensor.
+ */
+
+#ifndef __CONFIGIMAGE_H
+#define __CONFIGIMAGE_H
+
+#include "main.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ConfigImageAddress 0x08 //EEPROM, page aligned
+#define ConfigImageMagic 0xC0F1
+#define ConfigImageVersion 2
+#define ConfigImageMaxBody 48   //What's left of the EepromCache after the header
+
+typedef struct __attribute__((packed)) ConfigImageHeader
+{
+	uint16_t Magic;
+	uint8_t Version;
+	uint8_t Length;  //Body bytes
+	uint32_t Crc;
+}ConfigImageHeader;
+
+//Version 1, the fields after it were appended by the later ones
+typedef struct __attribute__((packed)) ConfigImageBody
+{
+	uint8_t Mode;
+	uint8_t Resolution;
+	uint8_t PlotType;
+	uint8_t PrintLegends;
+	uint16_t SampleTime;
+	uint16_t PlotResolution;
+	uint16_t HoldRelative;
+	uint16_t HoldAbsolute;
+	uint16_t HoldTimeout;
+	uint16_t AlarmHigh;
+	uint16_t AlarmLow;
+	uint16_t AlarmHysteresis;
+	//Version 2
+	uint16_t LogDeadband;
+}ConfigImageBody;
+
+typedef struct __attribute__((packed)) ConfigImage
+{
+	ConfigImageHeader Header;
+	ConfigImageBody Body;
+}ConfigImage;
+
+typedef enum ConfigImageResult
+{
+	Image_Ok,
+	Image_Old,     //Older version, read, save it again to migrate it
+	Image_Invalid  //No image or a bad CRC, the body is untouched
+}ConfigImageResult;
+
+ConfigImageResult ConfigImage_Open(const uint8_t *Area, ConfigImageBody *Body, uint8_t *Version);
+void ConfigImage_Seal(ConfigImage *Image, const ConfigImageBody *Body);
+uint32_t ConfigImage_Crc(const uint8_t *Data, uint16_t Length);
+
+#endif /* __CONFIGIMAGE_H */
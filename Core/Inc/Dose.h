@@ -0,0 +1,42 @@
+/**
+ *  Light dose integration
+ *  Trapezoidal integration of the lux samples over their exact timestamp
+ *  deltas. Whole lux-seconds are carried out of the Q4 lx*us remainder,
+ *  so the 64 bits accumulators can't overflow in the life of the device.
+ *  A gap between samples (a stopped acquisition, a failed read) is still
+ *  integrated as the trapezoid between the samples on both sides, a gap
+ *  over MaxDoseGap is counted in Gaps. The timestamps wrap after ~71
+ *  minutes, a longer gap is short by a multiple of that.
+ *  The accumulator is meant to live in .noinit and is validated with a
+ *  magic word and a checksum to survive warm resets.
+ */
+
+#ifndef __DOSE_H
+#define __DOSE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MaxDoseGap 10000000 //us, longer gaps between samples are counted
+
+typedef struct Dose
+{
+	uint32_t Magic;
+	uint64_t LuxSeconds; //lx*s
+	uint64_t Remainder;  //Q4 lx*us, always below one lx*s
+	uint64_t Elapsed;    //us
+	uint32_t LastTimestamp;
+	int32_t LastSample;  //Q4 lux
+	uint32_t Gaps;       //Integrated over more than MaxDoseGap
+	bool Running;        //LastTimestamp and LastSample are valid
+	uint32_t Check;
+}Dose;
+
+bool Dose_Init(Dose *Acc);
+void Dose_Reset(Dose *Acc);
+void Dose_Update(Dose *Acc, float Lux, uint32_t Timestamp);
+float Dose_LuxHours(const Dose *Acc);
+float Dose_Average(const Dose *Acc);
+uint32_t Dose_ElapsedSeconds(const Dose *Acc);
+
+#endif /* __DOSE_H */
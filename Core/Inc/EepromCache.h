@@ -0,0 +1,85 @@
+/**
+ *  Configuration cache of the external EEPROM
+ *  A RAM shadow of the start of the EEPROM, loaded once on the boot.
+ *  Reads come from the shadow, writes only compare and mark the bytes
+ *  that really changed in a dirty bitmap, so the caller (the menu Ok)
+ *  never waits for the bus.
+ *  EepromCache_task writes the dirty bytes once nothing changed for
+ *  EepromCacheHoldoff, a page at a time: the span from the first to the
+ *  last dirty byte of a page goes as one queued storage job (one write
+ *  cycle, the EEPROM can't cross a page in a write). The end of the
+ *  internal write cycle is found polling the address ACK instead of a
+ *  fixed 5ms wait.
+ *  WP (PA5) keeps the EEPROM protected except from the write job to the
+ *  end of its write cycle.
+ *  Write cycles are counted per page, that's what wears the cells.
+ *  It's the only writer of the EEPROM: the measurement log hands its
+ *  pages with EepromCache_WritePage, they go through the same job, ACK
+ *  polling and WP sequence without passing by the shadow.
+ */
+
+#ifndef __EEPROMCACHE_H
+#define __EEPROMCACHE_H
+
+#include "main.h"
+#include "I2cQueue.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef EepromSize
+#define EepromSize 256         //Bytes, 24C02. Build option, -DEepromSize=8192 for a 24C64
+#endif
+//The 24C04 to 24C16 take the high address bits in the device address, they aren't supported
+#if EepromSize > 256 && EepromSize < 4096
+#error "EepromSize: a 24C02 (256) or a 24C32 (4096) and up"
+#endif
+#define EepromAddressSize ((EepromSize > 256) ? I2C_MEMADD_SIZE_16BIT : I2C_MEMADD_SIZE_8BIT)
+#define EepromCacheSize 64     //Bytes shadowed from the address 0, one bit each in Dirty
+#define EepromPageSize 8       //24C02, the 16 byte pages of the bigger ones are aligned too
+#define EepromCachePages (EepromCacheSize / EepromPageSize)
+#define EepromCacheHoldoff 500 //ms without changes before writing
+#define EepromWriteCycleMax 10 //ms, 5 in the datasheet
+
+typedef enum EepromState
+{
+	Eeprom_Idle,
+	Eeprom_Writing, //Job queued or on the bus
+	Eeprom_Polling, //Internal write cycle
+	Eeprom_Failed   //Job failed, retried on the next task call
+}EepromState;
+
+typedef struct EepromCache
+{
+	I2C_HandleTypeDef *Handle;
+	uint16_t Address;
+	bool Loaded;
+	uint8_t Shadow[EepromCacheSize];
+	uint64_t Dirty;               //One bit per byte
+	uint32_t Changed;             //ms of the last change
+	volatile EepromState State;
+	uint8_t Staging[EepromPageSize];
+	uint16_t Register;            //Of the job on the way
+	uint16_t Length;
+	bool Direct;                  //A EepromCache_WritePage page, not the shadow
+	uint32_t WriteStart;          //ms, end of the job
+	//Statistics
+	uint32_t WriteCycles[EepromCachePages];
+	uint32_t BytesWritten;
+	uint32_t PagesWritten;        //EepromCache_WritePage pages
+	uint32_t Unchanged;           //Bytes written with the same value, not sent
+	uint32_t Polls;
+	uint32_t MaxCycle;            //ms, longest internal write cycle
+	uint32_t Failures;
+}EepromCache;
+
+extern EepromCache ConfigCache;
+
+HAL_StatusTypeDef EepromCache_Init(I2C_HandleTypeDef *Handle, uint16_t Address);
+bool EepromCache_Read(uint16_t Register, uint8_t *Data, uint16_t Length);
+bool EepromCache_Write(uint16_t Register, const uint8_t *Data, uint16_t Length);
+bool EepromCache_WritePage(uint16_t Register, const uint8_t *Data, uint16_t Length);
+bool EepromCache_Idle(void);
+void EepromCache_Flush(void);
+void EepromCache_task(void);
+
+#endif /* __EEPROMCACHE_H */
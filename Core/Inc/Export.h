@@ -0,0 +1,74 @@
+/**
+ *  Serial export
+ *  Live samples and dumps of the measurement log over USART1 (PA9 TX,
+ *  PA10 RX, ExportBaud 8N1) in ExportFrame frames. The TX goes through
+ *  DMA1 channel 4 from two frame buffers: the DMA sends one while the
+ *  main loop fills the other, and the transfer complete interrupt starts
+ *  the next ready frame right away, so the link doesn't wait for the loop.
+ *  No copies: the samples are popped and the log blocks read over I2C
+ *  straight into the body of the frame, COBS is done in place there and
+ *  the DMA sends it from the same buffer.
+ *  The samples come from their own SampleReader, while the link is busy
+ *  they wait in the acquisition FIFO and go out together in the next
+ *  frame (up to ExportMaxSamples), past the FIFO they're counted as lost.
+ *  A 'D' received starts a dump of the log: Begin, the blocks from the
+ *  oldest and End, between the sample frames.
+ *  There is no HAL UART driver in the project, the peripherals are set
+ *  up with the CMSIS registers. CubeMX doesn't know them: the pins and
+ *  the channel are reserved in Luxometro.ioc as the Export_* user
+ *  constants, keep them off anything else there. Tools/ExportDecode.c turns the frames
+ *  into CSV on a PC.
+ */
+
+#ifndef __EXPORT_H
+#define __EXPORT_H
+
+#include "main.h"
+#include "Acquisition.h"
+#include "ExportFrame.h"
+#include "Logger.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ExportBaud 921600
+#define ExportMaxSamples (ExportMaxBody / sizeof(Sample))
+#define ExportDumpCommand 'D'
+
+typedef enum ExportBuffer
+{
+	Buffer_Free,
+	Buffer_Ready,   //Sealed, waiting for the DMA
+	Buffer_Sending
+}ExportBuffer;
+
+typedef struct Export
+{
+	Logger *Log;
+	SampleReader Reader;
+	uint8_t Frames[2][ExportFrameSize] __attribute__((aligned(4)));
+	uint16_t Lengths[2];
+	volatile ExportBuffer States[2];
+	uint16_t Sequence;
+	bool Dumping;
+	bool Begun;
+	uint16_t Age;        //Of the last block of the dump sent
+	uint32_t Written;    //Logger blocks written when Age was taken, a new one ages the rest
+	//Statistics
+	volatile uint32_t Sent; //Frames
+	volatile uint32_t Bytes;
+	uint32_t BytesPerSecond;
+	uint32_t Blocks;     //Of the dumps
+	uint32_t Busy;       //Block reads refused by the EEPROM while it wrote, read again
+	uint32_t WindowStart; //ms
+	uint32_t WindowBytes; //Bytes when it started
+}Export;
+
+extern Export SerialExport;
+
+void Export_Init(Logger *Log);
+void Export_task(void);
+
+//ISR Handlers
+void Export_DMA_ISR(void);
+
+#endif /* __EXPORT_H */
@@ -0,0 +1,39 @@
+/**
+ *  Export frames
+ *  Binary frames of the serial export, plain C without the HAL so the
+ *  host tools build and check the same frames.
+ *  Payload: type, sequence (16 bits, one more per frame, a gap is a lost
+ *  frame), body and the CRC-32 of the CRC unit over the type, sequence
+ *  and body, little endian.
+ *  On the wire: the payload COBS encoded and a 0x00 delimiter, a receiver
+ *  that starts in the middle of a frame or gets a damaged one drops it
+ *  and synchronizes on the next delimiter. The payload is at most 254
+ *  bytes so the COBS overhead is always a byte, the one before it, and
+ *  the encoding runs in place: the body is written (or read by the DMA
+ *  or the I2C) straight into ExportFrame_Body and sent from there.
+ */
+
+#ifndef __EXPORTFRAME_H
+#define __EXPORTFRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ExportFrameSize 256 //COBS code, payload and delimiter
+#define ExportMaxPayload 254
+#define ExportMaxBody (ExportMaxPayload - 3 - 4) //Type and sequence, CRC
+
+typedef enum ExportType
+{
+	Export_Samples = 1, //Sample (us timestamp, lux float) after sample
+	Export_Begin,       //Log dump: uint16 blocks, uint32 log clock now (ms)
+	Export_Block,       //LogBlock, oldest first
+	Export_End          //Log dump done, no body
+}ExportType;
+
+uint8_t *ExportFrame_Body(uint8_t *Frame);
+uint16_t ExportFrame_Seal(uint8_t *Frame, ExportType Type, uint16_t Sequence, uint16_t Length, uint32_t (*Crc)(const uint8_t *Data, uint16_t Length));
+uint16_t ExportFrame_Open(const uint8_t *Wire, uint16_t Length, uint8_t *Payload);
+uint32_t ExportFrame_Crc(const uint8_t *Data, uint16_t Length);
+
+#endif /* __EXPORTFRAME_H */
@@ -0,0 +1,98 @@
+/**
+ *  Configuration store in the internal flash
+ *  Log structured: the last two 1KB pages of the 64KB flash (taken out of
+ *  the linker FLASH region) hold append only records of a key and a 32
+ *  bit value with a CRC. One page is active, a newer record of a key
+ *  overrides the older ones, the RAM index keeps the newest value of each
+ *  key so reading is an array access.
+ *  When the active page is full the live values are copied to the other
+ *  page (compaction), its header is written last and then the old page
+ *  is erased. Each compaction costs one page erase, the pages alternate
+ *  so both wear at the same rate: with the 13 keys live and one setting
+ *  changing a page takes ~230 changes per erase, 10k erase cycles are
+ *  ~2.3M changes.
+ *  Power loss (Tools/FlashStoreModel.c cuts the power in every step):
+ *  - During a record: the CRC doesn't match, the record is skipped. The
+ *    CRC is never 0xFFFF, so a record cut before its CRC is never valid.
+ *  - During a compaction: the new page has no header yet, the old one is
+ *    still active and the new one is erased again on the next boot.
+ *  - Before the old page erase: both headers are valid, the newer
+ *    generation wins and the older page is erased on the next boot.
+ *  Writes only change the RAM index, FlashStore_task programs the changed
+ *  keys at most once every FlashStoreMinInterval, so a burst of changes
+ *  is one record per key. The CPU stalls while the flash is programmed
+ *  (~50us per half word) or erased (~20ms), it's only done from the main
+ *  loop, but the vectors and the ISRs are in the flash too and wait for
+ *  it: a compaction holds the TIM2 acquisition tick (one late sample), the
+ *  photodiode DMA ISR (two 10ms halves overwritten, counted in its
+ *  Overruns) and the export DMA ISR (the next frame starts late, the DMA
+ *  itself goes on from the RAM). Moving them to the RAM would take the
+ *  vector table, the HAL they call and a linker section, for one erase
+ *  per ~115 setting changes it's left as it is.
+ *  Keys: one per field of the EEPROM configuration image, so the build
+ *  without the EEPROM keeps every setting. The numbers are what's stored,
+ *  new keys go at the end.
+ */
+
+#ifndef __FLASHSTORE_H
+#define __FLASHSTORE_H
+
+#include "main.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FlashStorePageSize 1024
+#define FlashStorePageA 0x0800F800 //Page 62
+#define FlashStorePageB 0x0800FC00 //Page 63
+#define FlashStoreMagic 0x4B56     //"KV"
+#define FlashStoreMinInterval 5000 //ms between programming bursts
+
+typedef enum FlashKey
+{
+	FlashKey_Mode,
+	FlashKey_Resolution,
+	FlashKey_PlotType,
+	FlashKey_PrintLegends,
+	FlashKey_SampleTime,
+	FlashKey_PlotResolution,
+	FlashKey_HoldRelative,
+	FlashKey_HoldAbsolute,
+	FlashKey_HoldTimeout,
+	FlashKey_AlarmHigh,
+	FlashKey_AlarmLow,
+	FlashKey_AlarmHysteresis,
+	FlashKey_LogDeadband,
+	FlashStoreKeys
+}FlashKey;
+
+typedef struct FlashEntry
+{
+	uint32_t Value;
+	bool Present;
+	bool Dirty; //Changed in RAM, not programmed yet
+}FlashEntry;
+
+typedef struct FlashStore
+{
+	FlashEntry Index[FlashStoreKeys];
+	uint32_t Active;      //Page address
+	uint16_t Generation;  //Of the active page, +1 per compaction
+	uint16_t Free;        //First blank record slot of the active page
+	uint32_t LastFlush;   //ms
+	//Statistics
+	uint32_t Records;     //Programmed since the boot
+	uint32_t Compactions;
+	uint32_t Erases;
+	uint32_t Torn;        //Records with a bad CRC found on the boot
+	uint32_t Failures;    //Programming or erase errors
+}FlashStore;
+
+extern FlashStore ConfigStore;
+
+void FlashStore_Init(void);
+bool FlashStore_Read(FlashKey Key, uint32_t *Value);
+void FlashStore_Write(FlashKey Key, uint32_t Value);
+void FlashStore_Flush(void);
+void FlashStore_task(void);
+
+#endif /* __FLASHSTORE_H */
@@ -0,0 +1,60 @@
+/**
+ *  Flicker metrics
+ *  Computed on windows of FlickerWindow raw photodiode samples, 100ms at
+ *  9.6kHz: a whole number of cycles of both 100Hz and 120Hz, so every
+ *  Goertzel bin falls exactly on its frequency.
+ *  Percent flicker = (Max - Min) / (Max + Min)
+ *  Flicker index   = area above the mean / total area. The mean is the
+ *                    one of the previous window, a single pass without
+ *                    storing the samples.
+ *  Dominant frequency: the strongest of the Goertzel bins at 50, 60,
+ *  100, 120, 200 and 240Hz (mains, double mains and their harmonic),
+ *  when its modulation is above FlickerMinModulation.
+ *  Integer kernels, Q15 coefficients: per sample it's FlickerBins
+ *  multiply-accumulates plus the min/max/area sums, the cycles per block
+ *  don't depend on the data.
+ */
+
+#ifndef __FLICKER_H
+#define __FLICKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FlickerWindow 960
+#define FlickerBins 6
+#define FlickerMinModulation 5 //Tenths of percent of the mean
+
+typedef struct FlickerMetrics
+{
+	uint16_t PercentFlicker; //Tenths of percent
+	uint16_t Index;          //Thousandths
+	uint16_t Frequency;      //Hz, 0 when there is no periodic flicker
+	uint16_t Modulation[FlickerBins]; //Tenths of percent of the mean, amplitude of each bin
+	uint16_t Mean;           //ADC counts
+}FlickerMetrics;
+
+typedef struct Flicker
+{
+	//Window in progress
+	uint16_t Count;
+	uint16_t Min;
+	uint16_t Max;
+	uint32_t Sum;
+	uint32_t Above;
+	int32_t Mean;            //Of the previous window
+	bool MeanValid;
+	int32_t S1[FlickerBins];
+	int32_t S2[FlickerBins];
+	//Last complete window
+	FlickerMetrics Result;
+	volatile uint32_t Windows;
+}Flicker;
+
+extern const uint16_t FlickerFrequencies[FlickerBins];
+
+void Flicker_Init(Flicker *Meter);
+bool Flicker_Process(Flicker *Meter, const uint16_t *Block, uint16_t Length);
+bool Flicker_Get(const Flicker *Meter, FlickerMetrics *Out);
+
+#endif /* __FLICKER_H */
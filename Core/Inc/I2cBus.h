@@ -0,0 +1,108 @@
+/**
+ *  I2C bus health
+ *  Every transaction result goes through I2cBus_Report, which classifies
+ *  the failures and counts them per bus and per device. A NACK is the
+ *  device's problem (not connected, EEPROM busy writing), everything else
+ *  means the bus itself can't be trusted and it's parked right away.
+ *  Parked: I2cBus_Ready turns false right away, the master, the queue
+ *  and the display flush stop there. I2cBus_task then deinitialises the
+ *  HAL handle, any transaction on it (the sensor library included)
+ *  returns HAL_BUSY without touching the bus, so a stuck bus can't pile
+ *  up the HAL timeouts into the 400ms of the IWDG.
+ *  I2cBus_task recovers a parked bus from the main loop: 9 SCL pulses to
+ *  release a slave holding SDA, a STOP, and the peripheral is
+ *  initialised again (SWRST). The first recovery is right away, the
+ *  next ones without a good transaction in between wait a doubling
+ *  backoff.
+ *  I2cBus_Probe checks if a device answers its address, like
+ *  HAL_I2C_IsDeviceReady but with a bound in us instead of whole ticks,
+ *  it's cheap enough to run on a slow schedule while a device is missing.
+ *  Traffic: every transaction is charged to its device with
+ *  I2cBus_Traffic (the register level master, the queue and the display
+ *  flush do it), I2cBus_task turns the counts into per second rates once
+ *  a second. The busy per mille is the share of the time the bus was
+ *  moving that device's bytes, 1000 would be the whole 400kHz budget.
+ *  Time bound: one attempt costs at most the 25ms the HAL waits for BUSY
+ *  plus I2cTimeout, a recovery ~150us, once per backoff period.
+ */
+
+#ifndef __I2CBUS_H
+#define __I2CBUS_H
+
+#include "main.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define I2cTimeout 10         //ms, per transaction, use it instead of the usual 100
+#define I2cBackoffMin 10      //ms, after the second failed recovery
+#define I2cBackoffMax 1000    //ms
+#define I2cClockOutPulses 9
+#define I2cHalfClock 5        //us, 100kHz while recovering
+#define I2cProbeTimeout 200   //us, a probe is ~25us on the wire at 400kHz
+#define I2cMaxDevices 6
+#define I2cBuses 2
+
+typedef enum I2cFault
+{
+	I2c_Nack,        //AF, the address or a byte wasn't acknowledged
+	I2c_Arbitration, //ARLO, someone else drove SDA
+	I2c_BusBusy,     //BUSY never cleared, a line is held low
+	I2c_BusError,    //BERR, misplaced start or stop
+	I2c_Timeout,     //A flag never came, clock stretched too long
+	I2c_Faults
+}I2cFault;
+
+typedef struct I2cDevice
+{
+	I2C_HandleTypeDef *Bus;
+	uint16_t Address;           //8 bits, as the HAL takes it
+	char Name[5];               //The address in hex until I2cBus_Name
+	uint32_t Faults[I2c_Faults];
+	uint32_t Skipped;           //Refused while the bus was parked
+	uint32_t Transactions;
+	uint32_t Bytes;             //On the wire, address and register bytes included
+	uint32_t BusyMicros;        //Wraps after ~71 minutes of bus time
+	//Last complete second
+	uint32_t TransactionsPerSecond;
+	uint32_t BytesPerSecond;
+	uint32_t ErrorsPerSecond;
+	uint16_t BusyPerMille;
+	//Second being counted
+	uint32_t WindowTransactions;
+	uint32_t WindowBytes;
+	uint32_t WindowCycles;
+	uint32_t WindowErrors;
+}I2cDevice;
+
+typedef struct I2cBusStatus
+{
+	I2C_HandleTypeDef *Handle;
+	uint32_t Faults[I2c_Faults];
+	volatile bool Parked;
+	uint32_t ParkedAt;    //ms
+	uint32_t Backoff;     //ms
+	uint32_t Failures;    //Recoveries without a good transaction after them
+	uint32_t Recoveries;
+	uint32_t Stuck;       //Recoveries that couldn't release the lines
+	uint32_t MaxRecovery; //us
+	uint32_t Probes;
+	uint32_t ProbeTime;   //us, total spent on the probes
+}I2cBusStatus;
+
+extern I2cBusStatus I2cBusInfo[I2cBuses];
+extern I2cDevice I2cDevices[I2cMaxDevices];
+extern volatile uint16_t I2cDeviceCount;
+
+void I2cBus_Init(I2C_HandleTypeDef *Bus1, I2C_HandleTypeDef *Bus2);
+HAL_StatusTypeDef I2cBus_Report(I2C_HandleTypeDef *Handle, uint16_t Address, HAL_StatusTypeDef Result);
+bool I2cBus_Ready(I2C_HandleTypeDef *Handle);
+bool I2cBus_Probe(I2C_HandleTypeDef *Handle, uint16_t Address);
+void I2cBus_Name(I2C_HandleTypeDef *Handle, uint16_t Address, const char *Name);
+void I2cBus_Traffic(I2C_HandleTypeDef *Handle, uint16_t Address, uint32_t Transactions, uint32_t Bytes, uint32_t Cycles);
+uint32_t I2cBus_DeviceFaults(const I2cDevice *Device);
+void I2cBus_task(void);
+
+//ISR Handlers
+void I2cBus_ErrorISR(I2C_HandleTypeDef *Handle);
+
+#endif /* __I2CBUS_H */
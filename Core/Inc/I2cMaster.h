@@ -0,0 +1,68 @@
+/**
+ *  Register level I2C master
+ *  Blocking transfers on the LL register access, for the hot paths that
+ *  run often and from the acquisition ISR (the BH1750 reads and one shot
+ *  starts) and for the presence probe. Same calls and results as the HAL
+ *  ones they replace, the failures leave the HAL error code on the handle
+ *  so I2cBus classifies them the same way.
+ *  Against the HAL polling transfers: no state machine per byte and no
+ *  HAL_GetTick on every flag poll, the timeouts are in us with the cycle
+ *  counter instead of whole ms ticks. Both poll the flags for the whole
+ *  transfer, what it saves per read is measured on the device with
+ *  I2cMaster_Compare (Diagnostics, HAL/LL page), not assumed. The wire
+ *  times (~70us a sensor read at 400kHz) come from Tools/I2cMasterModel.c.
+ *  The handle is taken (State BUSY) during a transfer, a HAL call on the
+ *  same bus backs off with HAL_BUSY and a parked bus refuses it here too.
+ *  STM32F10xx errata (ES096) handled here:
+ *  - 2.13.1 Software events must be handled before the current byte is
+ *    transferred: the ADDR clear, ACK and STOP of the 1 and 2 byte reads
+ *    and of the last 3 bytes of longer reads are done with the
+ *    interrupts masked, the sequences of RM0008 / AN2824.
+ *  - 2.13.2 Wrong data read into the data register: the 2 byte read uses
+ *    the POS method, the last bytes are taken after BTF.
+ *  - 2.13.4 Repeated start setup time: no repeated starts, a register
+ *    read is a write and a separate read.
+ *  - A START requested while the previous STOP is pending is lost, the
+ *    transfer waits for the STOP bit to clear first.
+ *  - The BUSY flag locked by the analog filter (2.13.7 on some revisions)
+ *    is not fixable here, the transfer fails as bus busy and I2cBus does
+ *    the GPIO sequence and the SWRST of the workaround.
+ */
+
+#ifndef __I2CMASTER_H
+#define __I2CMASTER_H
+
+#include "main.h"
+#include "I2cBus.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define I2cMasterBitRate 400000
+#define I2cMasterCeiling (I2cMasterBitRate / 9) //Bytes per second, 8 bits and the ACK
+
+typedef struct I2cMasterStats
+{
+	uint32_t Transfers;
+	uint32_t Bytes;     //On the wire, address bytes included
+	uint32_t Cycles;    //From the START to the STOP
+	uint32_t MaxCycles;
+}I2cMasterStats;
+
+//Averages of the same reads done both ways, with the same timeout in us
+typedef struct I2cMasterComparison
+{
+	uint32_t HalCycles; //Per read, the CPU is busy all of it
+	uint32_t LlCycles;
+	uint16_t Runs;      //Both reads went through, the averaged ones
+	uint16_t Failures;  //Either failed or took the timeout
+}I2cMasterComparison;
+
+extern I2cMasterStats I2cMasterInfo[I2cBuses];
+
+HAL_StatusTypeDef I2cMaster_Transmit(I2C_HandleTypeDef *Handle, uint16_t Address, const uint8_t *Data, uint16_t Length, uint32_t Timeout);
+HAL_StatusTypeDef I2cMaster_Receive(I2C_HandleTypeDef *Handle, uint16_t Address, uint8_t *Data, uint16_t Length, uint32_t Timeout);
+HAL_StatusTypeDef I2cMaster_IsDeviceReady(I2C_HandleTypeDef *Handle, uint16_t Address, uint32_t Timeout);
+uint32_t I2cMaster_Throughput(I2C_HandleTypeDef *Handle);
+void I2cMaster_Compare(I2C_HandleTypeDef *Handle, uint16_t Address, uint16_t Length, uint16_t Runs, uint32_t Timeout, I2cMasterComparison *Out);
+
+#endif /* __I2CMASTER_H */
@@ -0,0 +1,128 @@
+/**
+ *  I2C transaction queue
+ *  One queue per bus, the jobs run with the HAL interrupt transfers and
+ *  the next one is started from the completion interrupt. The highest
+ *  priority waiting job always goes next, jobs of the same priority keep
+ *  their order. A long job is split in chunks of Chunk bytes (register
+ *  address advancing), the queue is checked again after each chunk so an
+ *  urgent job waits at most one chunk.
+ *  Blocking users (the display library flushes with its own HAL calls)
+ *  take the whole bus with I2cQueue_Lock, which waits for the chunk on
+ *  the wire and holds the queue until I2cQueue_Unlock. A chunk that
+ *  doesn't end in I2cQueueLockWait refuses the lock, the display flush
+ *  is done again from the main loop.
+ *  Users in this tree: the EEPROM jobs (storage) on I2C1 and the display
+ *  lock. The display flush can't be split in queued chunks, the OLED
+ *  library keeps its frame buffer to itself and sends it whole (~25ms),
+ *  so a storage job waits for a full flush. The sensor has I2C2 to
+ *  itself and reads from the TIM2 ISR through I2cMaster, it never waits
+ *  behind the display; I2cPrio_Sensor and Chunk are for a job that
+ *  would share a bus with them.
+ *  I2cQueue_Hold stops an idle queue for a short register level access
+ *  (the EEPROM ACK polling) without a wait and out of the statistics.
+ *  Nothing is started while I2cBus has the bus parked, the jobs wait for
+ *  the recovery.
+ *  Statistics per priority: submits, completions, failures, bytes, wait
+ *  from the submit to the first chunk (max and average), plus the queue
+ *  depth and the throughput over 1s windows.
+ */
+
+#ifndef __I2CQUEUE_H
+#define __I2CQUEUE_H
+
+#include "main.h"
+#include "I2cBus.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define I2cQueueSize 8        //Jobs waiting per bus
+#define I2cQueueLockWait 2000 //us, more than a 16 byte chunk at 400kHz
+
+typedef enum I2cPriority
+{
+	I2cPrio_Sensor,
+	I2cPrio_Display,
+	I2cPrio_Storage,
+	I2cPriorities
+}I2cPriority;
+
+typedef enum I2cJobType
+{
+	I2cJob_Write,    //Address, data
+	I2cJob_Read,
+	I2cJob_MemWrite, //Address, register, data
+	I2cJob_MemRead
+}I2cJobType;
+
+typedef struct I2cJob I2cJob;
+typedef void (*I2cJobDone)(const I2cJob *Job, HAL_StatusTypeDef Result);
+
+//Data has to stay valid until the job is done, Done runs from the interrupt
+struct I2cJob
+{
+	I2cJobType Type;
+	I2cPriority Priority;
+	uint16_t Address;
+	uint16_t Register;
+	uint16_t RegisterSize; //I2C_MEMADD_SIZE_8BIT or I2C_MEMADD_SIZE_16BIT
+	uint8_t *Data;
+	uint16_t Length;
+	uint16_t Chunk;        //Bytes per transaction, 0 for the whole job at once
+	I2cJobDone Done;
+	//Kept by the queue
+	uint16_t Sent;
+	uint32_t Sequence;
+	uint32_t Submitted;    //DWT cycles
+	bool Pending;
+};
+
+typedef struct I2cQueueStats
+{
+	uint32_t Submitted;
+	uint32_t Started;
+	uint32_t Completed;
+	uint32_t Failed;
+	uint32_t Bytes;
+	uint32_t WaitMax;   //us
+	uint32_t WaitTotal; //us, over Started
+}I2cQueueStats;
+
+typedef struct I2cQueue
+{
+	I2C_HandleTypeDef *Handle;
+	I2cJob Jobs[I2cQueueSize];
+	I2cJob * volatile Running;
+	uint32_t RunningSince; //ms
+	uint32_t ChunkStart;   //DWT cycles
+	volatile bool Locked;
+	I2cPriority LockPriority;
+	uint32_t Sequence;
+	uint16_t Depth;
+	uint16_t MaxDepth;
+	uint32_t Dropped;      //Submits with the queue full
+	uint32_t LockTimeouts;
+	I2cQueueStats Stats[I2cPriorities];
+	//Throughput window
+	uint32_t WindowStart;  //ms
+	uint32_t WindowBytes;
+	uint32_t WindowTransactions;
+	uint32_t BytesPerSecond;
+	uint32_t TransactionsPerSecond;
+}I2cQueue;
+
+extern I2cQueue I2cQueues[I2cBuses];
+
+void I2cQueue_Init(I2C_HandleTypeDef *Bus1, I2C_HandleTypeDef *Bus2);
+bool I2cQueue_Submit(I2C_HandleTypeDef *Handle, const I2cJob *Job);
+bool I2cQueue_Lock(I2C_HandleTypeDef *Handle, I2cPriority Priority);
+void I2cQueue_Unlock(I2C_HandleTypeDef *Handle, uint32_t Bytes);
+bool I2cQueue_Hold(I2C_HandleTypeDef *Handle);
+void I2cQueue_Release(I2C_HandleTypeDef *Handle);
+bool I2cQueue_Idle(I2C_HandleTypeDef *Handle);
+void I2cQueue_Throughput(I2C_HandleTypeDef *Handle, uint32_t *Bytes, uint32_t *Transactions);
+void I2cQueue_task(void);
+
+//ISR Handlers
+void I2cQueue_DoneISR(I2C_HandleTypeDef *Handle, HAL_StatusTypeDef Result);
+
+#endif /* __I2CQUEUE_H */
@@ -0,0 +1,36 @@
+/**
+ *  Measurement log block
+ *  The layout of a block of the log on the EEPROM, see Logger.h. Plain C
+ *  without the HAL, the host tools read the blocks with it.
+ */
+
+#ifndef __LOGBLOCK_H
+#define __LOGBLOCK_H
+
+#include <stdint.h>
+
+#define LogBlockSize 64    //Multiple of the EEPROM page
+#define LogDataSize (LogBlockSize - 22) //The rest of the block is its header and the CRC
+#define LogMaxRecords (LogDataSize - 1) //A 2 byte keyframe and 1 byte deltas
+#define LogPeriod 10000    //ms per record
+
+typedef struct __attribute__((packed)) LogSummary
+{
+	uint16_t Min;    //lx, rounded down
+	uint16_t Max;    //lx, rounded up
+	uint16_t Count;  //Records
+	uint32_t Sum;    //0.1lx
+}LogSummary;
+
+typedef struct __attribute__((packed)) LogBlock
+{
+	uint32_t Sequence;
+	uint32_t Start;  //ms, log clock
+	uint8_t Count;   //Records
+	uint8_t Step;    //LogPeriod in 0.1s, for the decoder
+	LogSummary Summary;
+	uint8_t Data[LogDataSize]; //LogCodec, time in 0.1s from Start, lux in 0.1lx
+	uint16_t Crc;    //Low half of the CRC unit over the rest of the block
+}LogBlock;
+
+#endif /* __LOGBLOCK_H */
@@ -0,0 +1,55 @@
+/**
+ *  Log record codec
+ *  Packs (time, lux) records in a byte buffer, plain C without the HAL
+ *  so the same file decodes the logs on a PC.
+ *  Format, a buffer is self contained (random access per buffer):
+ *  - Keyframe, the first record: time and lux as unsigned varints.
+ *  - Next records: a varint of the zigzag lux delta shifted left once,
+ *    bit 0 set when the time isn't the previous one plus the nominal
+ *    step, then the zigzag varint of the difference follows.
+ *  Varint: 7 bits per byte, least significant first, bit 7 set on every
+ *  byte but the last. Zigzag: 0, -1, 1, -2... to 0, 1, 2, 3...
+ *  Time in 0.1s from the start of the buffer, lux in 0.1lx below
+ *  LogCodecMaxLux. A record on its nominal step with the light within
+ *  3.2lx of the previous one is a single byte, against 8 of a timestamp
+ *  and a float.
+ */
+
+#ifndef __LOGCODEC_H
+#define __LOGCODEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LogCodecMaxRecord 10        //Two 5 byte varints
+#define LogCodecMaxLux 0x1FFFFFFF   //The shifted zigzag of any delta fits in 32 bits
+
+typedef struct LogEncoder
+{
+	uint8_t *Data;
+	uint16_t Size;
+	uint16_t Used;
+	uint16_t Count;
+	uint16_t Step;      //Nominal time between records, 0.1s
+	uint32_t LastTime;
+	uint32_t LastLux;
+}LogEncoder;
+
+typedef struct LogDecoder
+{
+	const uint8_t *Data;
+	uint16_t Size;
+	uint16_t Read;
+	uint16_t Left;      //Records
+	uint16_t Count;     //Read so far
+	uint16_t Step;
+	uint32_t LastTime;
+	uint32_t LastLux;
+}LogDecoder;
+
+void LogCodec_Start(LogEncoder *Encoder, uint8_t *Data, uint16_t Size, uint16_t Step);
+bool LogCodec_Put(LogEncoder *Encoder, uint32_t Time, uint32_t Lux);
+void LogCodec_Open(LogDecoder *Decoder, const uint8_t *Data, uint16_t Size, uint16_t Count, uint16_t Step);
+bool LogCodec_Get(LogDecoder *Decoder, uint32_t *Time, uint32_t *Lux);
+
+#endif /* __LOGCODEC_H */
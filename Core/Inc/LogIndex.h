@@ -0,0 +1,33 @@
+/**
+ *  Log range index
+ *  Segment tree over the blocks of the log, a leaf per block with the
+ *  minimum, maximum, count and sum of its records, each node the merge
+ *  of its two children. Any run of blocks is answered merging
+ *  ~2*log2(Leaves) nodes, without reading the blocks. Iterative layout:
+ *  node 1 is the root, the children of n are 2n and 2n+1, the leaves are
+ *  Leaves..2*Leaves-1, any number of leaves.
+ *  Plain C without the HAL. Lux in 0.1lx.
+ */
+
+#ifndef __LOGINDEX_H
+#define __LOGINDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct LogRange
+{
+	uint32_t Min;
+	uint32_t Max;
+	uint32_t Count;  //Records, 0 is an empty range
+	uint64_t Sum;
+}LogRange;
+
+void LogIndex_Clear(LogRange *Tree, uint16_t Leaves);
+void LogIndex_Set(LogRange *Tree, uint16_t Leaves, uint16_t Leaf, const LogRange *Value);
+void LogIndex_Query(const LogRange *Tree, uint16_t Leaves, uint16_t First, uint16_t Last, LogRange *Range);
+void LogIndex_Empty(LogRange *Range);
+void LogIndex_Merge(LogRange *Into, const LogRange *From);
+void LogIndex_Add(LogRange *Into, uint32_t Lux);
+
+#endif /* __LOGINDEX_H */
@@ -0,0 +1,120 @@
+/**
+ *  Measurement log on the EEPROM
+ *  Circular log of lux records after the configuration image. A record
+ *  is the mean of the samples of LogPeriod with its time, records are
+ *  gathered in RAM in a block and the block goes to the EEPROM once it's
+ *  full, a page per queued job through EepromCache_WritePage (ACK
+ *  polling, WP), the acquisition never waits for it. While a block is
+ *  being written the next one keeps filling.
+ *  Block: sequence, start time, record count, the summary of its
+ *  records, the records packed with LogCodec (the first one is the
+ *  keyframe, the rest deltas, so every block decodes on its own) and a
+ *  CRC last, so a block cut by a power loss (its first pages new, the
+ *  rest old) is invalid. A block is sealed when the next record doesn't
+ *  fit, ~40 records of ~1 byte against 10 of 4 bytes unpacked. Sequences
+ *  grow by one per block. Logger_Init reads every block once, for the
+ *  index, and the newest valid one is the head.
+ *  Size: the ring goes from LogStart to the end of the EEPROM, EepromSize
+ *  is a build option (EepromCache.h). The 24C02 of the board holds 3
+ *  blocks, a lap of ~20 minutes of quiet records: enough for the history
+ *  screen, not for days. A 24C32 holds 63 blocks (~7 hours) and a 24C64
+ *  127 (~14 hours), days with a deadband; each block costs 56 bytes of
+ *  RAM for the index and 128 is the most that fits next to the rest.
+ *  Wear: each block is rewritten once per lap, ~LogBlocks * 40 *
+ *  LogPeriod, 20 minutes on the 24C02, ~38 years for 1M cycles. A noisy
+ *  signal packs ~22 records per block, ~21 years (Tools/LoggerModel.c).
+ *  Time: a record takes the time of the sample that ends its period, a
+ *  backlog of samples in the FIFO doesn't shift it.
+ *  The records of the block still in RAM are lost on a power loss.
+ *  With a deadband the records go through SwingDoor first and only the
+ *  ends of the straight segments are logged, the decoder draws the lines
+ *  between them. A segment lasts up to SwingDoorMaxSpan and its records
+ *  are lost on a power loss too.
+ *  Time: the log clock goes on from the newest block on the boot, the
+ *  time without power isn't counted, so the blocks stay in time order.
+ *  Range queries: the summary of a block has the minimum, maximum, count
+ *  and sum of the records given while it was filling, before the
+ *  deadband. Logger_Init reads every block once and keeps the summaries
+ *  in a LogIndex segment tree, Logger_Range merges the blocks inside the
+ *  window from it and reads only the two blocks on its edges. The deadband
+ *  leaves only the ends of the segments in a block, so the records of
+ *  the edges are put back on the lines between them, as many as the
+ *  summary of the block counted: with a deadband the edges are within it
+ *  of the records and a record or so off at each end of the window,
+ *  without one they're the records.
+ */
+
+#ifndef __LOGGER_H
+#define __LOGGER_H
+
+#include "main.h"
+#include "Acquisition.h"
+#include "LogBlock.h"
+#include "LogCodec.h"
+#include "LogIndex.h"
+#include "SwingDoor.h"
+#include "EepromCache.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LogStart 0x40      //EEPROM, after the configuration image
+#define LogEnd EepromSize
+#define LogBlocks ((LogEnd - LogStart) / LogBlockSize)
+
+#if LogBlocks > 128
+#error "The index of a log this big doesn't fit the RAM"
+#endif
+
+typedef struct Logger
+{
+	I2C_HandleTypeDef *Handle;
+	uint16_t Address;
+	bool Ready;
+	uint32_t Offset;     //Log clock minus HAL_GetTick
+	//RAM side
+	LogBlock Filling;
+	LogEncoder Encoder;  //Into Filling.Data
+	SwingDoor Door;      //Before Filling, SwingDoor.Points over Stored is its ratio
+	LogRange Summary;    //Of Filling
+	bool Waiting;        //The last record isn't in Summary yet
+	uint32_t WaitingTime;
+	uint32_t WaitingLux;
+	LogBlock Flushing;
+	bool Pending;        //Flushing is being written
+	bool Submitted;      //A page of it is with the EEPROM cache
+	uint16_t Page;
+	uint32_t PagesBefore;
+	float Sum;           //Samples of the current record
+	uint32_t Samples;
+	uint32_t PeriodStart; //ms, log clock
+	//EEPROM side
+	uint16_t Head;       //Newest block
+	uint16_t Next;       //Where the next block goes
+	uint16_t Count;      //Valid blocks
+	uint32_t Sequence;   //Of the next block
+	LogRange Index[2 * LogBlocks]; //LogIndex, a leaf per block of the ring
+	uint32_t Starts[LogBlocks];
+	uint32_t Firsts[LogBlocks]; //Lux of the first record of each block, where the line of the previous one ends
+	//Statistics
+	uint32_t Blocks;     //Written since the boot
+	uint32_t Overruns;   //Blocks dropped, the previous one was still being written
+	uint32_t Retries;    //Pages written again
+	uint32_t Reads;      //Blocks read, LogBlocks on the boot
+	uint32_t Encoded;    //Records, before the deadband
+	uint32_t EncodedBytes; //Of the sealed blocks, against 8 per record of a timestamp and a float
+	uint32_t Puts;       //LogCodec_Put calls, the records stored and the refused ones
+	uint32_t EncodeCycles; //Of LogCodec_Put alone, total over Puts
+	uint32_t MaxEncodeCycles;
+}Logger;
+
+void Logger_Init(Logger *Log, I2C_HandleTypeDef *Handle, uint16_t Address);
+void Logger_Add(Logger *Log, const Sample *New);
+void Logger_Deadband(Logger *Log, uint16_t Deadband);
+uint32_t Logger_Now(Logger *Log);
+uint32_t Logger_Span(Logger *Log);
+bool Logger_Range(Logger *Log, uint32_t From, uint32_t To, LogRange *Range);
+bool Logger_Read(Logger *Log, uint16_t Age, LogBlock *Block);
+void Logger_Open(const LogBlock *Block, LogDecoder *Decoder);
+void Logger_task(Logger *Log);
+
+#endif /* __LOGGER_H */
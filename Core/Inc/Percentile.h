@@ -0,0 +1,33 @@
+/**
+ *  Streaming percentile estimator
+ *  Extended P2 algorithm (Jain & Chlamtac, Raatikainen): P5, P50 and P95
+ *  share 9 markers, O(1) per sample and 76 bytes of state.
+ *  Markers: 0, P5/2, P5, (P5+P50)/2, P50, (P50+P95)/2, P95, (1+P95)/2, 1
+ */
+
+#ifndef __PERCENTILE_H
+#define __PERCENTILE_H
+
+#include <stdint.h>
+
+#define PercentileMarkers 9
+
+typedef enum PercentileRank
+{
+	P5 = 2,
+	P50 = 4,
+	P95 = 6
+}PercentileRank;
+
+typedef struct Percentile
+{
+	uint32_t Count;
+	float Height[PercentileMarkers];
+	int32_t Position[PercentileMarkers];
+}Percentile;
+
+void Percentile_Reset(Percentile *Estimator);
+void Percentile_Update(Percentile *Estimator, float Lux);
+float Percentile_Get(const Percentile *Estimator, PercentileRank Rank);
+
+#endif /* __PERCENTILE_H */
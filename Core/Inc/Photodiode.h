@@ -0,0 +1,51 @@
+/**
+ *  Photodiode acquisition
+ *  TIM1 CC1 triggers ADC1 channel 6 (PA6) at PhotodiodeRate, DMA1
+ *  channel 1 moves the conversions into a circular buffer of two halves.
+ *  The half transfer and transfer complete interrupts hand each half to
+ *  the CIC decimator while the DMA fills the other one, one half is one
+ *  decimated output, every 10ms.
+ *  ADC1 is only powered and clocked between Photodiode_Start and
+ *  Photodiode_Stop, it's calibrated again at every start.
+ *  There is no HAL ADC driver in the project, the peripherals are set up
+ *  with the CMSIS registers.
+ */
+
+#ifndef __PHOTODIODE_H
+#define __PHOTODIODE_H
+
+#include "main.h"
+#include "Cic.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PhotodiodeRate 9600      //Hz
+#define PhotodiodeDecimation 96  //100Hz output, nulls the 100Hz ripple
+#define PhotodiodeHalf PhotodiodeDecimation
+#define PhotodiodeHistory 64     //Decimated outputs kept, must be a power of 2
+#define PhotodiodeFullScale 4095
+
+typedef void (*PhotodiodeBlockHook)(const uint16_t *Block, uint16_t Length); //Raw half buffer, inside the ISR
+
+typedef struct PhotodiodeStatus
+{
+	uint32_t Samples;    //ADC conversions processed
+	uint32_t Outputs;    //Decimated outputs
+	uint32_t Overruns;   //Halves overwritten before they were processed
+	uint32_t BusyCycles; //CPU cycles inside the DMA ISR in the current window
+	uint32_t MaxCycles;  //Longest DMA ISR
+	bool Running;
+}PhotodiodeStatus;
+
+extern volatile PhotodiodeStatus DiodeStatus;
+
+void Photodiode_Init(void);
+void Photodiode_SetHook(PhotodiodeBlockHook Hook);
+void Photodiode_Start(void);
+void Photodiode_Stop(void);
+bool Photodiode_Latest(uint16_t *Value);
+uint16_t Photodiode_History(uint16_t *Out, uint16_t Length);
+bool Photodiode_Throughput(uint32_t *Rate, uint16_t *Load);
+void Photodiode_DMA_ISR(void);
+
+#endif /* __PHOTODIODE_H */
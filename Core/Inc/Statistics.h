@@ -0,0 +1,35 @@
+/**
+ *  Streaming statistics of the lux samples
+ *  Welford's algorithm on fixed point values, O(1) per sample and a
+ *  constant size no matter how long the session runs.
+ *  Samples:  Q4 lux (1/16 lx)
+ *  Mean:     Q16 lux
+ *  M2:       Q8 lux^2, saturates instead of wrapping
+ */
+
+#ifndef __STATISTICS_H
+#define __STATISTICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct Statistics
+{
+	uint32_t Count;
+	int32_t Min;
+	int32_t Max;
+	int64_t Mean;
+	uint64_t M2;
+	uint64_t Elapsed; //us
+	uint32_t LastTimestamp;
+}Statistics;
+
+void Statistics_Reset(Statistics *Stats);
+void Statistics_Update(Statistics *Stats, float Lux, uint32_t Timestamp);
+float Statistics_Min(const Statistics *Stats);
+float Statistics_Max(const Statistics *Stats);
+float Statistics_Mean(const Statistics *Stats);
+float Statistics_StdDev(const Statistics *Stats);
+uint32_t Statistics_ElapsedSeconds(const Statistics *Stats);
+
+#endif /* __STATISTICS_H */
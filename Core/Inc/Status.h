@@ -0,0 +1,62 @@
+/**
+ *  Error status
+ *  Errors are raised and cleared without stopping anything, the modes and
+ *  the acquisition keep running and the main loop retries in the
+ *  background. Each code has an occurrence counter and a level:
+ *  Degraded: the measurement goes on without some feature (EEPROM)
+ *  Blocked:  there is no lux measurement until it recovers (sensor)
+ *  The time spent on each level is accumulated with the HAL tick.
+ */
+
+#ifndef __STATUS_H
+#define __STATUS_H
+
+#include "main.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define StatusBannerTime 3000 //ms the tag blinks after an error is raised
+
+typedef enum ErrorCode
+{
+	Error_Sensor_NoConn,
+	Error_Sensor_Fatal,
+	Error_EEPROM,
+	Error_Codes
+}ErrorCode;
+
+typedef enum ErrorLevel
+{
+	Level_Ok,
+	Level_Degraded,
+	Level_Blocked
+}ErrorLevel;
+
+typedef struct ErrorEntry
+{
+	uint32_t Count;  //Times it was raised
+	uint32_t Raised; //ms
+	bool Active;
+}ErrorEntry;
+
+typedef struct SystemErrors
+{
+	ErrorEntry Entries[Error_Codes];
+	ErrorCode Newest;
+	uint32_t DegradedTime; //ms
+	uint32_t BlockedTime;  //ms
+	uint32_t LastUpdate;
+}SystemErrors;
+
+extern SystemErrors SystemStatus;
+
+void Status_Init(void);
+void Status_Raise(ErrorCode Code);
+void Status_Clear(ErrorCode Code);
+bool Status_IsActive(ErrorCode Code);
+ErrorLevel Status_Level(void);
+void Status_Update(void);
+bool Status_Banner(ErrorCode *Code);
+const char *Status_Tag(ErrorCode Code);
+
+#endif /* __STATUS_H */
@@ -0,0 +1,46 @@
+/**
+ *  Swinging door compression
+ *  Lossy stage in front of the log: a point is stored only when the
+ *  signal leaves the corridor of +-Deadband around the line from the
+ *  last stored point, the points in between are the straight line
+ *  between the stored ones. Constant state and O(1) per point: the doors
+ *  are the lowest and highest slopes from the last stored point that
+ *  keep every point since it within the corridor, a point that closes
+ *  them (the lowest above the highest) ends the segment. The point
+ *  stored isn't the previous sample but the previous time on a line
+ *  between the doors, so every point of the segment is within Deadband
+ *  of the line, which is what the decoder draws. The corridor is half a
+ *  unit narrower than Deadband for the rounding of the stored value.
+ *  Plain C without the HAL, the same file replays a trace on a PC.
+ *  Time in ms, lux in 0.1lx.
+ */
+
+#ifndef __SWINGDOOR_H
+#define __SWINGDOOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SwingDoorMaxSpan 600000 //ms, longest segment, what's lost on a power cut
+
+typedef struct SwingDoor
+{
+	uint16_t Deadband;   //0.1lx, 0 stores every point
+	bool Started;
+	bool Open;           //A point after the anchor, the doors are set
+	uint32_t AnchorTime; //Last stored point
+	uint32_t AnchorLux;
+	uint32_t LastTime;   //Last point
+	uint32_t LastLux;
+	float Low;           //Doors, 0.1lx per ms from the anchor
+	float High;
+	//Statistics
+	uint32_t Points;
+	uint32_t Stored;
+}SwingDoor;
+
+void SwingDoor_Init(SwingDoor *Door, uint16_t Deadband);
+bool SwingDoor_Add(SwingDoor *Door, uint32_t Time, uint32_t Lux, uint32_t *StoreTime, uint32_t *StoreLux);
+bool SwingDoor_Flush(SwingDoor *Door, uint32_t *StoreTime, uint32_t *StoreLux);
+
+#endif /* __SWINGDOOR_H */
@@ -0,0 +1,38 @@
+/**
+ *  Illuminance uniformity between measurement heads
+ *  Emin, Eavg, Emax are accumulated while the heads are read one by one,
+ *  so every new channel reading costs O(1) and nothing is rescanned.
+ *  U0 = Emin/Eavg
+ *  Ud = Emin/Emax
+ */
+
+#ifndef __UNIFORMITY_H
+#define __UNIFORMITY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct Uniformity
+{
+	//Sweep in progress
+	uint16_t Readings;
+	float Sum;
+	float Min;
+	float Max;
+	uint16_t MinHead;
+	//Last completed sweep
+	float Emin;
+	float Eavg;
+	float Emax;
+	float U0;
+	float Ud;
+	uint16_t WeakestHead;
+	uint16_t Heads;
+	bool Ready;
+}Uniformity;
+
+void Uniformity_Init(Uniformity *Metrics);
+void Uniformity_Update(Uniformity *Metrics, uint16_t Head, float Measure);
+bool Uniformity_Publish(Uniformity *Metrics);
+
+#endif /* __UNIFORMITY_H */
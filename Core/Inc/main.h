@@ -57,6 +57,11 @@ void Error_Handler(void);
 /* USER CODE END EFP */
 
 /* Private defines -----------------------------------------------------------*/
+#define Export_USART USART1
+#define Export_TX_Pin GPIO_PIN_9
+#define Export_RX_Pin GPIO_PIN_10
+#define Export_GPIO_Port GPIOA
+#define Export_DMA_Channel DMA1_Channel4
 #define Arriba_Pin GPIO_PIN_0
 #define Arriba_GPIO_Port GPIOA
 #define Abajo_Pin GPIO_PIN_1
@@ -57,10 +57,15 @@ void PendSV_Handler(void);
 void SysTick_Handler(void);
 void EXTI0_IRQHandler(void);
 void EXTI1_IRQHandler(void);
+void TIM2_IRQHandler(void);
 void TIM3_IRQHandler(void);
 void I2C1_ER_IRQHandler(void);
 void I2C2_ER_IRQHandler(void);
 /* USER CODE BEGIN EFP */
+void DMA1_Channel1_IRQHandler(void);
+void DMA1_Channel4_IRQHandler(void);
+void I2C1_EV_IRQHandler(void);
+void I2C2_EV_IRQHandler(void);
 
 /* USER CODE END EFP */
 
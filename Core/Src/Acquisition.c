@@ -0,0 +1,227 @@
+/**
+ *  Hardware timed acquisition
+ *  The sensor is read inside the TIM2 compare ISR, so the sample timing
+ *  doesn't depend on how long the main loop took to draw the UI.
+ *  TIM2 runs at a lower priority than SysTick, the HAL I2C timeouts
+ *  keep working while the read is in progress.
+ */
+
+#include "Acquisition.h"
+#include <string.h>
+
+#define FifoMask (SampleFifoSize - 1)
+#define MinimumLead 10 //us, closer compares could be missed by the counter
+
+volatile AcquisitionStatus AcqStatus;
+volatile Jitter SampleJitter;
+
+static TIM_HandleTypeDef *AcqTimer = NULL;
+static SampleSource AcqSource = NULL;
+static SampleHook AcqHook = NULL;
+static volatile uint32_t SamplePeriod = DefaultSamplePeriod;
+static volatile uint32_t NextSample;
+static volatile uint32_t LastSample;
+static volatile bool LastSampleValid = false;
+static volatile uint32_t Overflows = 0;
+static Sample Fifo[SampleFifoSize];
+static volatile uint32_t FifoHead = 0; //Samples pushed since boot, only written by the ISR
+
+static void Acquisition_Schedule(uint32_t Now);
+static void Acquisition_JitterUpdate(uint32_t Now);
+
+void Acquisition_Init(TIM_HandleTypeDef *htim, SampleSource Source, uint32_t Period)
+{
+	AcqTimer = htim;
+	AcqSource = Source;
+	SamplePeriod = Period;
+	Overflows = 0;
+	FifoHead = 0;
+	memset((void *) &AcqStatus, 0, sizeof(AcqStatus));
+	Acquisition_JitterReset();
+	//The timebase runs from now on, the sampling starts with Acquisition_Start
+	__HAL_TIM_DISABLE_IT(AcqTimer, TIM_IT_CC1);
+	HAL_TIM_Base_Start_IT(AcqTimer);
+}
+
+//Gets every sample as soon as it's read, before any reader
+void Acquisition_SetHook(SampleHook Hook)
+{
+	AcqHook = Hook;
+}
+
+void Acquisition_Start(void)
+{
+	uint32_t Now;
+
+	if(AcqTimer == NULL || AcqStatus.Running)
+		return;
+	Now = Acquisition_Micros();
+	NextSample = Now + SamplePeriod;
+	LastSampleValid = false;
+	AcqStatus.LastReadFailed = false; //A failure from the last run isn't about this one
+	Acquisition_Schedule(Now);
+	__HAL_TIM_CLEAR_FLAG(AcqTimer, TIM_FLAG_CC1);
+	__HAL_TIM_ENABLE_IT(AcqTimer, TIM_IT_CC1);
+	AcqStatus.Running = true;
+}
+
+void Acquisition_Stop(void)
+{
+	if(AcqTimer == NULL)
+		return;
+	__HAL_TIM_DISABLE_IT(AcqTimer, TIM_IT_CC1);
+	AcqStatus.Running = false;
+}
+
+void Acquisition_SetPeriod(uint32_t Period)
+{
+	bool WasRunning = AcqStatus.Running;
+
+	Acquisition_Stop();
+	SamplePeriod = Period;
+	if(WasRunning)
+		Acquisition_Start();
+}
+
+uint32_t Acquisition_GetPeriod(void)
+{
+	return SamplePeriod;
+}
+
+uint32_t Acquisition_Micros(void)
+{
+	uint32_t High, Low, Mask;
+
+	if(AcqTimer == NULL)
+		return 0;
+	//The count, the overflows and the flag from the same instant, the overflow ISR can't run in between
+	Mask = __get_PRIMASK();
+	__disable_irq();
+	High = Overflows;
+	Low = __HAL_TIM_GET_COUNTER(AcqTimer);
+	//An update not counted yet (masked here or inside the TIM2 ISR), a wrap after the count read leaves Low high
+	if(__HAL_TIM_GET_FLAG(AcqTimer, TIM_FLAG_UPDATE) && Low < 0x8000)
+		High++;
+	__set_PRIMASK(Mask);
+	return (High << 16) | Low;
+}
+
+//New readers only get the samples pushed from now on
+void Acquisition_ReaderInit(SampleReader *Reader)
+{
+	Reader->Tail = FifoHead;
+	Reader->Lost = 0;
+}
+
+bool Acquisition_Pop(SampleReader *Reader, Sample *Out)
+{
+	uint32_t Head;
+
+	do
+	{
+		Head = FifoHead;
+		if(Head == Reader->Tail)
+			return false;
+		if(Head - Reader->Tail > SampleFifoSize)
+		{
+			Reader->Lost += Head - Reader->Tail - SampleFifoSize;
+			Reader->Tail = Head - SampleFifoSize;
+		}
+		*Out = Fifo[Reader->Tail & FifoMask];
+		__DMB();
+		//Retry if the ISR has lapped this reader while copying
+	}while(FifoHead - Reader->Tail > SampleFifoSize);
+	Reader->Tail++;
+	return true;
+}
+
+bool Acquisition_Latest(Sample *Out)
+{
+	uint32_t Head;
+
+	do
+	{
+		Head = FifoHead;
+		if(Head == 0)
+			return false;
+		*Out = Fifo[(Head - 1) & FifoMask];
+		__DMB();
+	}while(Head != FifoHead);
+	return true;
+}
+
+void Acquisition_JitterReset(void)
+{
+	memset((void *) &SampleJitter, 0, sizeof(SampleJitter));
+	LastSampleValid = false;
+}
+
+//ISR Handlers
+void Acquisition_OverflowISR(void)
+{
+	Overflows++;
+}
+
+void Acquisition_CompareISR(void)
+{
+	Sample New;
+	uint32_t Now = Acquisition_Micros();
+
+	if((int32_t) (Now - NextSample) < 0)
+	{
+		//Intermediate wake up, the period is longer than the 16 bits compare
+		Acquisition_Schedule(Now);
+		return;
+	}
+	Acquisition_JitterUpdate(Now);
+	NextSample += SamplePeriod;
+	if((int32_t) (Now - NextSample) >= 0) //A whole period was lost, don't try to catch up
+		NextSample = Now + SamplePeriod;
+	Acquisition_Schedule(Now);
+
+	New.Timestamp = Now;
+	if(AcqSource != NULL && AcqSource(&New.Lux))
+	{
+		if(AcqHook != NULL)
+			AcqHook(&New);
+		Fifo[FifoHead & FifoMask] = New;
+		__DMB();
+		FifoHead++;
+		AcqStatus.Samples++;
+		AcqStatus.LastReadFailed = false;
+	}
+	else
+	{
+		AcqStatus.ReadErrors++;
+		AcqStatus.LastReadFailed = true;
+	}
+}
+
+//Private functions
+static void Acquisition_Schedule(uint32_t Now)
+{
+	uint32_t Remaining = NextSample - Now;
+
+	if(Remaining > 0xFFFF)
+		Remaining = 0x8000;
+	else if(Remaining < MinimumLead)
+		Remaining = MinimumLead;
+	__HAL_TIM_SET_COMPARE(AcqTimer, TIM_CHANNEL_1, (uint16_t) (Now + Remaining));
+}
+
+static void Acquisition_JitterUpdate(uint32_t Now)
+{
+	uint32_t Interval, Deviation;
+
+	if(LastSampleValid)
+	{
+		Interval = Now - LastSample;
+		Deviation = (Interval > SamplePeriod) ? Interval - SamplePeriod : SamplePeriod - Interval;
+		SampleJitter.Histogram[(Deviation >= (1 << (JitterBins - 1))) ? JitterBins - 1 : 32 - __CLZ(Deviation)]++;
+		if(Deviation > SampleJitter.Max)
+			SampleJitter.Max = Deviation;
+		SampleJitter.Intervals++;
+	}
+	LastSample = Now;
+	LastSampleValid = true;
+}
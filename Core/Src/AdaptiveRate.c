@@ -0,0 +1,141 @@
+/**
+ *  Adaptive sampling rate
+ *  AdaptiveRate_Update only decides the rate, the caller reconfigures
+ *  the sensor and reports it back with AdaptiveRate_Apply.
+ */
+
+#include "AdaptiveRate.h"
+#include <string.h>
+
+#define SampleShift 4
+#define ActivityDecay 500000 //us, time constant of the activity
+//Costs for the estimate, BH1750FVI and SSD1306 at 400kHz
+#define SensorActiveCurrent 120000 //nA, typical while converting
+#define SensorPowerDownCurrent 10  //nA
+#define BusChargePerByte 16        //nC, 9 bits with both 4.7k pull-ups at 3.3V low about half of the time
+#define ReadTransactions 1         //Address plus the 2 bytes of data
+#define ReadBytes 3
+#define TriggerTransactions 1      //Address plus the one shot opcode
+#define TriggerBytes 2
+#define RedrawTransactions 32      //8 pages of 3 commands plus 128 bytes of data
+#define RedrawBytes 1112
+
+const RateTier RateTiers[Rate_Levels] = {
+		[Rate_Heartbeat] = {.Period = 1000000, .ActiveTime = 120000, .OneShot = true},
+		[Rate_Normal]    = {.Period = 120000, .ActiveTime = 120000, .OneShot = false},
+		[Rate_Fast]      = {.Period = 16000, .ActiveTime = 16000, .OneShot = false}
+};
+
+void AdaptiveRate_Init(AdaptiveRate *Rate, RateLevel Applied)
+{
+	memset(Rate, 0, sizeof(AdaptiveRate));
+	Rate->Level = Applied;
+	Rate->Applied = Applied;
+}
+
+RateLevel AdaptiveRate_Update(AdaptiveRate *Rate, const RateSettings *Settings, float Lux, uint32_t Timestamp)
+{
+	int32_t Sample = (int32_t) (Lux * (1 << SampleShift) + 0.5f);
+	uint32_t Delta = Timestamp - Rate->LastTimestamp;
+	int32_t Change, Deadband, Level;
+	uint32_t Instant;
+
+	if(!Rate->Primed || Delta == 0)
+	{
+		Rate->LastSample = Sample;
+		Rate->LastTimestamp = Timestamp;
+		Rate->CalmSince = Timestamp;
+		Rate->Primed = true;
+		return Rate->Level;
+	}
+	Rate->Time[Rate->Applied] += Delta;
+	Rate->Samples[Rate->Applied]++;
+
+	//Rate of change past the deadband, per mille of the level per second
+	Change = Sample - Rate->LastSample;
+	if(Change < 0)
+		Change = -Change;
+	Level = (Rate->LastSample > Sample) ? Rate->LastSample : Sample;
+	Deadband = (Level * Settings->NoiseRelative) / 1000;
+	if(Deadband < (Settings->NoiseFloor << SampleShift))
+		Deadband = Settings->NoiseFloor << SampleShift;
+	if(Level < (Settings->NoiseFloor << SampleShift))
+		Level = Settings->NoiseFloor << SampleShift;
+	if(Level == 0)
+		Level = 1;
+	Change = (Change > Deadband) ? Change - Deadband : 0;
+	Instant = (uint32_t) (((uint64_t) Change * 1000 * 1000000) / ((uint64_t) Delta * Level));
+
+	//Instant attack, exponential decay on time
+	Rate->Activity = (uint32_t) (((uint64_t) Rate->Activity * ActivityDecay) / (ActivityDecay + Delta));
+	if(Instant > Rate->Activity)
+		Rate->Activity = Instant;
+
+	if(Rate->Activity >= Settings->RiseThreshold)
+	{
+		Rate->Level = Rate_Fast;
+		Rate->CalmSince = Timestamp;
+	}
+	else if(Rate->Activity >= Settings->FallThreshold)
+	{
+		if(Rate->Level < Rate_Normal)
+			Rate->Level = Rate_Normal;
+		Rate->CalmSince = Timestamp;
+	}
+	else if(Timestamp - Rate->CalmSince >= (uint32_t) Settings->Calm * 1000000 && Rate->Level > Rate_Heartbeat)
+	{
+		Rate->Level--;
+		Rate->CalmSince = Timestamp;
+	}
+	Rate->LastSample = Sample;
+	Rate->LastTimestamp = Timestamp;
+	return Rate->Level;
+}
+
+void AdaptiveRate_Apply(AdaptiveRate *Rate, RateLevel Level)
+{
+	if(Level != Rate->Applied)
+		Rate->Transitions++;
+	Rate->Applied = Level;
+	//The activity was measured on the old rate, the calm time starts again
+	Rate->CalmSince = Rate->LastTimestamp;
+}
+
+//us, of a rate with the conversion time of the resolution in use
+uint32_t AdaptiveRate_Period(RateLevel Level, uint32_t Conversion)
+{
+	return (RateTiers[Level].Period > Conversion) ? RateTiers[Level].Period : Conversion;
+}
+
+void AdaptiveRate_Estimate(const AdaptiveRate *Rate, RateEstimate *Out)
+{
+	uint64_t Total = 0, Transactions, Bytes, Active, Nanoamps = 0;
+
+	Transactions = (uint64_t) Rate->Redraws * RedrawTransactions;
+	Bytes = (uint64_t) Rate->Redraws * RedrawBytes;
+	for(uint16_t Level = 0; Level < Rate_Levels; Level++)
+	{
+		Total += Rate->Time[Level];
+		Transactions += (uint64_t) Rate->Samples[Level] * ReadTransactions;
+		Bytes += (uint64_t) Rate->Samples[Level] * ReadBytes;
+		if(RateTiers[Level].OneShot)
+		{
+			Transactions += (uint64_t) Rate->Samples[Level] * TriggerTransactions;
+			Bytes += (uint64_t) Rate->Samples[Level] * TriggerBytes;
+		}
+		//Sensor charge in nA*us
+		Active = (Rate->Time[Level] * RateTiers[Level].ActiveTime) / RateTiers[Level].Period;
+		Nanoamps += Active * SensorActiveCurrent + (Rate->Time[Level] - Active) * SensorPowerDownCurrent;
+	}
+	if(Total == 0)
+	{
+		memset(Out, 0, sizeof(RateEstimate));
+		return;
+	}
+	Nanoamps /= Total;
+	//nC over us is mA
+	Nanoamps += (Bytes * BusChargePerByte * 1000000) / Total;
+	Out->TransactionsPerMinute = (uint32_t) ((Transactions * 60000000) / Total);
+	Out->BytesPerMinute = (uint32_t) ((Bytes * 60000000) / Total);
+	Out->MicroAmps = (uint32_t) (Nanoamps / 1000);
+}
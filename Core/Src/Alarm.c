@@ -0,0 +1,142 @@
+/**
+ *  Threshold alarm
+ *  The capture is written by the ISR across several samples, readers
+ *  copy it with Alarm_GetCapture which checks the sequence number.
+ */
+
+#include "Alarm.h"
+#include <string.h>
+
+volatile AlarmStatus AlarmInfo;
+
+static const AlarmConfigs *AlarmSettings = NULL;
+static Sample Ring[AlarmPreTrigger];
+static uint32_t RingHead = 0;
+static AlarmCapture Capture;
+static volatile uint32_t CaptureSequence = 0;
+static uint16_t PostRemaining = 0;
+
+static AlarmState Alarm_Evaluate(AlarmState State, float Lux);
+static void Alarm_StartCapture(const Sample *New, AlarmState From, AlarmState To);
+
+void Alarm_Init(const AlarmConfigs *Configs)
+{
+	AlarmSettings = Configs;
+	memset((void *) &AlarmInfo, 0, sizeof(AlarmInfo));
+	RingHead = 0;
+	PostRemaining = 0;
+	AlarmPort -> BSRR = (uint32_t) AlarmPin << 16;
+}
+
+//False while there is no capture or the post trigger samples are still coming
+bool Alarm_GetCapture(AlarmCapture *Out)
+{
+	uint32_t Sequence;
+
+	do
+	{
+		Sequence = CaptureSequence;
+		if(Sequence == 0 || (Sequence & 1))
+			return false;
+		memcpy(Out, &Capture, sizeof(AlarmCapture));
+		__DMB();
+	}while(Sequence != CaptureSequence);
+	Out->Sequence = Sequence;
+	return true;
+}
+
+void Alarm_LatencyReset(void)
+{
+	AlarmInfo.MaxLatency = 0;
+	AlarmInfo.OverBound = 0;
+}
+
+//Called by the acquisition ISR with every new sample
+void Alarm_SampleISR(const Sample *New)
+{
+	AlarmState State = AlarmInfo.State;
+	AlarmState Next;
+
+	if(AlarmSettings == NULL)
+		return;
+	Next = Alarm_Evaluate(State, New->Lux);
+	if(Next != State)
+	{
+		//Pin first, the bookkeeping can wait
+		if(Next != Alarm_Normal)
+			AlarmPort -> BSRR = AlarmPin;
+		else
+			AlarmPort -> BSRR = (uint32_t) AlarmPin << 16;
+		AlarmInfo.Latency = Acquisition_Micros() - New->Timestamp;
+		if(AlarmInfo.Latency > AlarmInfo.MaxLatency)
+			AlarmInfo.MaxLatency = AlarmInfo.Latency;
+		if(AlarmInfo.Latency > AlarmLatencyBound)
+			AlarmInfo.OverBound++;
+		AlarmInfo.State = Next;
+		AlarmInfo.Crossings++;
+		if(PostRemaining == 0)
+			Alarm_StartCapture(New, State, Next);
+		else
+		{
+			Capture.Samples[Capture.Filled++] = *New;
+			PostRemaining--;
+		}
+	}
+	else if(PostRemaining)
+	{
+		Capture.Samples[Capture.Filled++] = *New;
+		PostRemaining--;
+	}
+	if(Capture.Filled && PostRemaining == 0 && (CaptureSequence & 1))
+	{
+		__DMB();
+		CaptureSequence++;
+	}
+	Ring[RingHead % AlarmPreTrigger] = *New;
+	RingHead++;
+}
+
+//Private functions
+static AlarmState Alarm_Evaluate(AlarmState State, float Lux)
+{
+	int32_t High = AlarmSettings->High;
+	int32_t Low = AlarmSettings->Low;
+	int32_t Hysteresis = AlarmSettings->Hysteresis;
+
+	switch(State)
+	{
+		case Alarm_High:
+			if(High && Lux >= High - Hysteresis)
+				return Alarm_High;
+		break;
+		case Alarm_Low:
+			if(Low && Lux <= Low + Hysteresis)
+				return Alarm_Low;
+		break;
+		case Alarm_Normal:
+		default:
+		break;
+	}
+	//A jump from one side to the other doesn't wait a sample in Normal
+	if(High && Lux > High)
+		return Alarm_High;
+	if(Low && Lux < Low)
+		return Alarm_Low;
+	return Alarm_Normal;
+}
+
+static void Alarm_StartCapture(const Sample *New, AlarmState From, AlarmState To)
+{
+	uint32_t Available = (RingHead < AlarmPreTrigger) ? RingHead : AlarmPreTrigger;
+
+	CaptureSequence++; //Odd, readers back off
+	__DMB();
+	for(uint32_t Index = 0; Index < Available; Index++)
+		Capture.Samples[Index] = Ring[(RingHead - Available + Index) % AlarmPreTrigger];
+	Capture.Trigger = (uint16_t) Available;
+	Capture.Samples[Available] = *New;
+	Capture.Filled = (uint16_t) Available + 1;
+	Capture.From = From;
+	Capture.To = To;
+	PostRemaining = AlarmPostTrigger;
+}
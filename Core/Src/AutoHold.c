@@ -0,0 +1,88 @@
+/**
+ *  Auto hold
+ *  AutoHold_Update returns true once, on the sample that settled the
+ *  window. AutoHold_Start arms it again keeping the instrumentation.
+ */
+
+#include "AutoHold.h"
+#include <string.h>
+#include <math.h>
+
+#define SampleShift 4
+
+void AutoHold_Init(AutoHold *Hold)
+{
+	memset(Hold, 0, sizeof(AutoHold));
+}
+
+void AutoHold_Start(AutoHold *Hold)
+{
+	Hold->Index = 0;
+	Hold->Filled = 0;
+	Hold->Sum = 0;
+	Hold->SumSquares = 0;
+	Hold->Held = false;
+}
+
+bool AutoHold_Update(AutoHold *Hold, const AutoHoldConfigs *Configs, float Lux, uint32_t Timestamp)
+{
+	int32_t Sample = (int32_t) (Lux * (1 << SampleShift) + 0.5f);
+	int32_t Oldest;
+	int64_t Variance, Threshold, Relative;
+	float Ratio;
+	bool TimedOut;
+
+	if(Hold->Held)
+		return false;
+	if(Hold->Filled == 0)
+		Hold->Start = Timestamp;
+	//Slide the window
+	if(Hold->Filled == AutoHoldWindow)
+	{
+		Oldest = Hold->Window[Hold->Index];
+		Hold->Sum -= Oldest;
+		Hold->SumSquares -= (int64_t) Oldest * Oldest;
+	}
+	else
+		Hold->Filled++;
+	Hold->Window[Hold->Index] = Sample;
+	Hold->Sum += Sample;
+	Hold->SumSquares += (int64_t) Sample * Sample;
+	Hold->Index = (Hold->Index + 1) % AutoHoldWindow;
+	if(Hold->Filled < AutoHoldWindow)
+		return false;
+
+	//N^2 * variance against N^2 * threshold^2, all in Q8
+	Variance = AutoHoldWindow * Hold->SumSquares - Hold->Sum * Hold->Sum;
+	Threshold = (int64_t) Configs->AbsoluteThreshold << SampleShift;
+	Relative = (Hold->Sum * Configs->RelativeThreshold) / (1000 * AutoHoldWindow);
+	if(Relative > Threshold)
+		Threshold = Relative;
+	TimedOut = (Timestamp - Hold->Start) >= (uint32_t) Configs->Timeout * 1000000;
+	if(Variance > Threshold * Threshold * AutoHoldWindow * AutoHoldWindow && !TimedOut)
+		return false;
+
+	Hold->Held = true;
+	Hold->Value = (float) Hold->Sum / (AutoHoldWindow << SampleShift);
+	Hold->StdDev = sqrtf((float) Variance) / (AutoHoldWindow << SampleShift);
+	if(Threshold == 0)
+		Threshold = 1;
+	Ratio = sqrtf((float) Variance) / (Threshold * AutoHoldWindow); //Std over threshold
+	Hold->Confidence = (Ratio >= 2) ? 0 : (uint8_t) (100 - 50 * Ratio);
+	Hold->TimeToHold = Timestamp - Hold->Start;
+	Hold->Holds++;
+	if(TimedOut)
+		Hold->Timeouts++;
+	Hold->TotalTimeToHold += Hold->TimeToHold;
+	if(Hold->TimeToHold > Hold->MaxTimeToHold)
+		Hold->MaxTimeToHold = Hold->TimeToHold;
+	return true;
+}
+
+//us
+uint32_t AutoHold_AverageTimeToHold(const AutoHold *Hold)
+{
+	if(Hold->Holds == 0)
+		return 0;
+	return (uint32_t) (Hold->TotalTimeToHold / Hold->Holds);
+}
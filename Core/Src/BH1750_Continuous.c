@@ -0,0 +1,99 @@
+/**
+ *  BH1750 continuous measurement mode
+ *  Uses the I2C handle, address and resolution kept by Rojo_BH1750, the
+ *  transfers go through the register level master (I2cMaster)
+ */
+
+#include "BH1750_Continuous.h"
+#include "I2cMaster.h"
+
+//Instruction set, BH1750FVI datasheet
+#define ContinuousHResMode  0x10
+#define ContinuousHResMode2 0x11
+#define ContinuousLResMode  0x13
+#define OneTimeHResMode     0x20
+#define OneTimeHResMode2    0x21
+#define OneTimeLResMode     0x23
+
+Rojo_Status BH1750_ContinuousStart(Rojo_BH1750 *Head, BH1750_Resolutions Resolution)
+{
+	uint8_t Command;
+
+	switch(Resolution)
+	{
+		case High_Res:
+			Command = ContinuousHResMode2;
+		break;
+		case Medium_Res:
+			Command = ContinuousHResMode;
+		break;
+		case Low_Res:
+			Command = ContinuousLResMode;
+		break;
+		default:
+			return Rojo_Error;
+	}
+	if(I2cBus_Report(Head -> I2C, Head -> Address, I2cMaster_Transmit(Head -> I2C, Head -> Address, &Command, 1, I2cTimeout * 1000)) != HAL_OK)
+		return Rojo_Error;
+	Head -> Resolution = Resolution;
+	Head -> Status = Standby;
+	return Rojo_OK;
+}
+
+//Single conversion, the sensor powers down once it's done. The result is
+//read with BH1750_ContinuousRead after the conversion time
+Rojo_Status BH1750_OneShotStart(Rojo_BH1750 *Head, BH1750_Resolutions Resolution)
+{
+	uint8_t Command;
+
+	switch(Resolution)
+	{
+		case High_Res:
+			Command = OneTimeHResMode2;
+		break;
+		case Medium_Res:
+			Command = OneTimeHResMode;
+		break;
+		case Low_Res:
+			Command = OneTimeLResMode;
+		break;
+		default:
+			return Rojo_Error;
+	}
+	if(I2cBus_Report(Head -> I2C, Head -> Address, I2cMaster_Transmit(Head -> I2C, Head -> Address, &Command, 1, BH1750_ReadTimeout)) != HAL_OK)
+		return Rojo_Error;
+	Head -> Resolution = Resolution;
+	Head -> Status = Sleep;
+	return Rojo_OK;
+}
+
+Rojo_Status BH1750_ContinuousRead(Rojo_BH1750 *Head, float *Lux)
+{
+	uint8_t Data[2];
+	uint16_t Counts;
+
+	if(I2cBus_Report(Head -> I2C, Head -> Address, I2cMaster_Receive(Head -> I2C, Head -> Address, Data, 2, BH1750_ReadTimeout)) != HAL_OK)
+		return Rojo_Error;
+	Counts = (uint16_t) (Data[0] << 8 | Data[1]);
+	Head -> Value = Counts;
+	//H resolution mode 2 has half a lux per count
+	if(Head -> Resolution == High_Res)
+		*Lux = Counts / 2.4f;
+	else
+		*Lux = Counts / 1.2f;
+	return Rojo_OK;
+}
+
+//Typical conversion time, us
+uint32_t BH1750_ConversionTime(BH1750_Resolutions Resolution)
+{
+	switch(Resolution)
+	{
+		case Low_Res:
+			return 16000;
+		case Medium_Res:
+		case High_Res:
+		default:
+			return 120000;
+	}
+}
@@ -0,0 +1,84 @@
+/**
+ *  Burst capture
+ *  Only the ISR writes the samples, the main loop reads them once the
+ *  state is Burst_Done.
+ */
+
+#include "Burst.h"
+
+void Burst_Init(Burst *Capture)
+{
+	Capture->State = Burst_Idle;
+	Capture->Count = 0;
+}
+
+void Burst_Arm(Burst *Capture, uint32_t Window, uint16_t Trigger)
+{
+	Capture->State = Burst_Idle;
+	__DMB();
+	Capture->Count = 0;
+	Capture->Window = Window;
+	Capture->Trigger = Trigger;
+	Capture->ReferenceValid = false;
+	__DMB();
+	Capture->State = Burst_Armed;
+}
+
+//us from the first to the last sample
+uint32_t Burst_Duration(const Burst *Capture)
+{
+	if(Capture->Count < 2)
+		return 0;
+	return Capture->Samples[Capture->Count - 1].Timestamp - Capture->Samples[0].Timestamp;
+}
+
+//us, the longest gap shows if the capture rate was kept
+uint32_t Burst_MaxInterval(const Burst *Capture)
+{
+	uint32_t Max = 0, Interval;
+
+	for(uint16_t Index = 1; Index < Capture->Count; Index++)
+	{
+		Interval = Capture->Samples[Index].Timestamp - Capture->Samples[Index - 1].Timestamp;
+		if(Interval > Max)
+			Max = Interval;
+	}
+	return Max;
+}
+
+//Called by the acquisition ISR with every new sample
+void Burst_SampleISR(Burst *Capture, const Sample *New)
+{
+	float Deviation;
+
+	switch(Capture->State)
+	{
+		case Burst_Armed:
+			if(Capture->Trigger)
+			{
+				if(!Capture->ReferenceValid)
+				{
+					Capture->Reference = New->Lux;
+					Capture->ReferenceValid = true;
+					return;
+				}
+				Deviation = New->Lux - Capture->Reference;
+				if(Deviation < 0)
+					Deviation = -Deviation;
+				if(Deviation <= Capture->Trigger)
+					return;
+			}
+			//The sample that started it is the first one
+			Capture->State = Burst_Recording;
+			//Falls through
+		case Burst_Recording:
+			Capture->Samples[Capture->Count++] = *New;
+			if(Capture->Count == BurstSize || New->Timestamp - Capture->Samples[0].Timestamp >= Capture->Window)
+				Capture->State = Burst_Done;
+		break;
+		case Burst_Idle:
+		case Burst_Done:
+		default:
+		break;
+	}
+}
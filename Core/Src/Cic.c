@@ -0,0 +1,61 @@
+/**
+ *  CIC decimator
+ *  The outputs are Q4 input counts, a 12 bits ADC still fits in 16 bits.
+ */
+
+#include "Cic.h"
+#include <string.h>
+
+#define OutputShift 4
+
+#if CicOrder != 3
+#error "Cic_Process keeps the integrators unrolled for 3 stages"
+#endif
+
+void Cic_Init(Cic *Filter, uint16_t Ratio)
+{
+	memset(Filter, 0, sizeof(Cic));
+	Filter->Ratio = Ratio;
+	Filter->Gain = 1;
+	for(uint16_t Stage = 0; Stage < CicOrder; Stage++)
+		Filter->Gain *= Ratio;
+	Filter->Settling = CicOrder;
+}
+
+//Returns the number of outputs written, Length / Ratio rounded up at most
+uint16_t Cic_Process(Cic *Filter, const uint16_t *In, uint16_t Length, uint16_t *Out)
+{
+	uint32_t I0 = Filter->Integrators[0];
+	uint32_t I1 = Filter->Integrators[1];
+	uint32_t I2 = Filter->Integrators[2];
+	uint32_t Value, Previous;
+	uint16_t Outputs = 0;
+
+	for(uint16_t Index = 0; Index < Length; Index++)
+	{
+		I0 += In[Index];
+		I1 += I0;
+		I2 += I1;
+		if(++Filter->Phase < Filter->Ratio)
+			continue;
+		Filter->Phase = 0;
+		Value = I2;
+		for(uint16_t Stage = 0; Stage < CicOrder; Stage++)
+		{
+			Previous = Filter->Delays[Stage];
+			Filter->Delays[Stage] = Value;
+			Value -= Previous;
+		}
+		//The first outputs only see part of the impulse response
+		if(Filter->Settling)
+		{
+			Filter->Settling--;
+			continue;
+		}
+		Out[Outputs++] = (uint16_t) (((uint64_t) Value << OutputShift) / Filter->Gain);
+	}
+	Filter->Integrators[0] = I0;
+	Filter->Integrators[1] = I1;
+	Filter->Integrators[2] = I2;
+	return Outputs;
+}
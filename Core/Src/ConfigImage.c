@@ -0,0 +1,62 @@
+/**
+ *  Persistent configuration image
+ *  The CRC unit has no HAL driver in this project, it's used through its
+ *  registers. It's only used from the main loop.
+ */
+
+#include "ConfigImage.h"
+#include <string.h>
+#include <stddef.h>
+
+//Body length of each version, a known version with another length is damaged
+static const uint8_t BodyLength[ConfigImageVersion + 1] = {
+		[1] = offsetof(ConfigImageBody, LogDeadband),
+		[2] = sizeof(ConfigImageBody)
+};
+
+//Area: the header and ConfigImageMaxBody bytes. Fills the body with the fields the image has,
+//Version gets the one of the image, 0 if it's invalid
+ConfigImageResult ConfigImage_Open(const uint8_t *Area, ConfigImageBody *Body, uint8_t *Version)
+{
+	ConfigImageHeader Header;
+
+	*Version = 0;
+	memcpy(&Header, Area, sizeof(ConfigImageHeader));
+	if(Header.Magic != ConfigImageMagic || Header.Version == 0 || Header.Length > ConfigImageMaxBody)
+		return Image_Invalid;
+	//A known version has its own length, a newer one at least the fields of this one
+	if((Header.Version <= ConfigImageVersion && Header.Length != BodyLength[Header.Version]) ||
+	   (Header.Version > ConfigImageVersion && Header.Length < sizeof(ConfigImageBody)))
+		return Image_Invalid;
+	if(ConfigImage_Crc(Area + sizeof(ConfigImageHeader), Header.Length) != Header.Crc)
+		return Image_Invalid;
+	memcpy(Body, Area + sizeof(ConfigImageHeader), (Header.Length < sizeof(ConfigImageBody)) ? Header.Length : sizeof(ConfigImageBody));
+	*Version = Header.Version;
+	return (Header.Version < ConfigImageVersion) ? Image_Old : Image_Ok;
+}
+
+void ConfigImage_Seal(ConfigImage *Image, const ConfigImageBody *Body)
+{
+	Image->Header.Magic = ConfigImageMagic;
+	Image->Header.Version = ConfigImageVersion;
+	Image->Header.Length = sizeof(ConfigImageBody);
+	Image->Body = *Body;
+	Image->Header.Crc = ConfigImage_Crc((const uint8_t *) &Image->Body, sizeof(ConfigImageBody));
+}
+
+//STM32 CRC unit, the bytes in little endian words, the last word zero padded
+uint32_t ConfigImage_Crc(const uint8_t *Data, uint16_t Length)
+{
+	uint32_t Word;
+
+	__HAL_RCC_CRC_CLK_ENABLE();
+	CRC -> CR = CRC_CR_RESET;
+	for(uint16_t Index = 0; Index < Length; Index += 4)
+	{
+		Word = 0;
+		for(uint16_t Byte = 0; Byte < 4 && Index + Byte < Length; Byte++)
+			Word |= (uint32_t) Data[Index + Byte] << (Byte * 8);
+		CRC -> DR = Word;
+	}
+	return CRC -> DR;
+}
@@ -0,0 +1,90 @@
+/**
+ *  Light dose integration
+ *  The checksum is refreshed on every update, a power cycle leaves random
+ *  RAM behind and Dose_Init starts a new dose in that case.
+ */
+
+#include "Dose.h"
+#include <string.h>
+
+#define DoseMagic 0x4C584853 //"LXHS"
+#define SampleShift 4
+#define Q4LuxMicroSecond ((uint64_t) 1000000 << SampleShift) //One lx*s in Q4 lx*us
+
+static uint32_t Dose_Checksum(const Dose *Acc);
+
+//Returns true if the dose was recovered after a warm reset
+bool Dose_Init(Dose *Acc)
+{
+	if(Acc->Magic != DoseMagic || Acc->Check != Dose_Checksum(Acc) || Acc->Remainder >= Q4LuxMicroSecond)
+	{
+		Dose_Reset(Acc);
+		return false;
+	}
+	//The timebase restarted with the MCU, the next sample opens a new segment
+	Acc->Running = false;
+	Acc->Check = Dose_Checksum(Acc);
+	return true;
+}
+
+void Dose_Reset(Dose *Acc)
+{
+	memset(Acc, 0, sizeof(Dose));
+	Acc->Magic = DoseMagic;
+	Acc->Check = Dose_Checksum(Acc);
+}
+
+void Dose_Update(Dose *Acc, float Lux, uint32_t Timestamp)
+{
+	int32_t Sample = (int32_t) (Lux * (1 << SampleShift) + 0.5f);
+	uint32_t Delta = Timestamp - Acc->LastTimestamp;
+
+	if(Sample < 0)
+		Sample = 0;
+	if(Acc->Running)
+	{
+		//Trapezoid, Q4 lx*us
+		Acc->Remainder += ((uint64_t) (Acc->LastSample + Sample) * Delta) >> 1;
+		if(Acc->Remainder >= Q4LuxMicroSecond)
+		{
+			Acc->LuxSeconds += Acc->Remainder / Q4LuxMicroSecond;
+			Acc->Remainder %= Q4LuxMicroSecond;
+		}
+		Acc->Elapsed += Delta;
+		if(Delta > MaxDoseGap)
+			Acc->Gaps++;
+	}
+	Acc->LastTimestamp = Timestamp;
+	Acc->LastSample = Sample;
+	Acc->Running = true;
+	Acc->Check = Dose_Checksum(Acc);
+}
+
+float Dose_LuxHours(const Dose *Acc)
+{
+	return (Acc->LuxSeconds + (float) Acc->Remainder / Q4LuxMicroSecond) / 3600.0f;
+}
+
+float Dose_Average(const Dose *Acc)
+{
+	if(Acc->Elapsed < 1000000)
+		return (float) Acc->LastSample / (1 << SampleShift);
+	return (float) Acc->LuxSeconds / (Acc->Elapsed / 1000000);
+}
+
+uint32_t Dose_ElapsedSeconds(const Dose *Acc)
+{
+	return (uint32_t) (Acc->Elapsed / 1000000);
+}
+
+//Private functions
+static uint32_t Dose_Checksum(const Dose *Acc)
+{
+	uint32_t Sum = ~Acc->Magic;
+
+	Sum += (uint32_t) Acc->LuxSeconds + (uint32_t) (Acc->LuxSeconds >> 32);
+	Sum += (uint32_t) Acc->Remainder + (uint32_t) (Acc->Remainder >> 32);
+	Sum += (uint32_t) Acc->Elapsed + (uint32_t) (Acc->Elapsed >> 32);
+	Sum += Acc->LastTimestamp + (uint32_t) Acc->LastSample + Acc->Gaps + Acc->Running;
+	return Sum;
+}
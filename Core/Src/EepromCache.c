@@ -0,0 +1,221 @@
+/**
+ *  Configuration cache of the external EEPROM
+ *  The shadow and the dirty bitmap are only touched from the main loop,
+ *  the job completion (interrupt) just moves the state.
+ */
+
+#include "EepromCache.h"
+#include "I2cMaster.h"
+#include <string.h>
+
+EepromCache ConfigCache;
+
+static void EepromCache_Start(void);
+static bool EepromCache_Submit(uint16_t Register, const uint8_t *Data, uint16_t Length, bool Direct);
+static void EepromCache_Poll(void);
+static void EepromCache_Done(const I2cJob *Job, HAL_StatusTypeDef Result);
+static uint64_t EepromCache_Mask(uint16_t Register, uint16_t Length);
+static void EepromCache_Protect(bool Protect);
+
+//Blocking, from the boot. The cache refuses the writes if the load failed
+HAL_StatusTypeDef EepromCache_Init(I2C_HandleTypeDef *Handle, uint16_t Address)
+{
+	HAL_StatusTypeDef Result;
+
+	memset(&ConfigCache, 0, sizeof(EepromCache));
+	ConfigCache.Handle = Handle;
+	ConfigCache.Address = Address;
+	EepromCache_Protect(true);
+	Result = I2cBus_Report(Handle, Address, HAL_I2C_Mem_Read(Handle, Address, 0x0, EepromAddressSize, ConfigCache.Shadow, EepromCacheSize, I2cTimeout));
+	ConfigCache.Loaded = (Result == HAL_OK);
+	return Result;
+}
+
+bool EepromCache_Read(uint16_t Register, uint8_t *Data, uint16_t Length)
+{
+	if(!ConfigCache.Loaded || Register + Length > EepromCacheSize)
+		return false;
+	memcpy(Data, &ConfigCache.Shadow[Register], Length);
+	return true;
+}
+
+//Only the shadow, the bytes that didn't change aren't written
+bool EepromCache_Write(uint16_t Register, const uint8_t *Data, uint16_t Length)
+{
+	if(!ConfigCache.Loaded || Register + Length > EepromCacheSize)
+		return false;
+	for(uint16_t Index = 0; Index < Length; Index++)
+	{
+		if(ConfigCache.Shadow[Register + Index] == Data[Index])
+		{
+			ConfigCache.Unchanged++;
+			continue;
+		}
+		ConfigCache.Shadow[Register + Index] = Data[Index];
+		ConfigCache.Dirty |= 1ULL << (Register + Index);
+		ConfigCache.Changed = HAL_GetTick();
+	}
+	return true;
+}
+
+//Outside the shadow, one EEPROM page at most. False while another write is going on,
+//PagesWritten moves when it's done
+bool EepromCache_WritePage(uint16_t Register, const uint8_t *Data, uint16_t Length)
+{
+	if(!ConfigCache.Loaded || ConfigCache.State != Eeprom_Idle || Length == 0 || Length > EepromPageSize ||
+	   Register / EepromPageSize != (Register + Length - 1) / EepromPageSize)
+		return false;
+	return EepromCache_Submit(Register, Data, Length, true);
+}
+
+//Nothing waiting to be written
+bool EepromCache_Idle(void)
+{
+	return ConfigCache.Dirty == 0 && ConfigCache.State == Eeprom_Idle;
+}
+
+//Blocking, before a reset: no holdoff, waits for every page to be written
+void EepromCache_Flush(void)
+{
+	uint32_t Start = HAL_GetTick();
+
+	ConfigCache.Changed = Start - EepromCacheHoldoff;
+	while(!EepromCache_Idle() && ConfigCache.Loaded && HAL_GetTick() - Start < EepromCachePages * (I2cTimeout + EepromWriteCycleMax))
+	{
+		I2cQueue_task();
+		EepromCache_task();
+	}
+}
+
+//Main loop
+void EepromCache_task(void)
+{
+	switch(ConfigCache.State)
+	{
+		case Eeprom_Idle:
+			if(ConfigCache.Loaded && ConfigCache.Dirty && HAL_GetTick() - ConfigCache.Changed >= EepromCacheHoldoff)
+				EepromCache_Start();
+		break;
+		case Eeprom_Polling:
+			EepromCache_Poll();
+		break;
+		case Eeprom_Failed:
+			//The bytes go again with the next write, a direct page is retried by its owner
+			if(!ConfigCache.Direct)
+				ConfigCache.Dirty |= EepromCache_Mask(ConfigCache.Register, ConfigCache.Length);
+			ConfigCache.Failures++;
+			EepromCache_Protect(true);
+			ConfigCache.State = Eeprom_Idle;
+		break;
+		case Eeprom_Writing:
+		default:
+		break;
+	}
+}
+
+//Private functions
+//The first page with dirty bytes, from its first to its last dirty byte
+static void EepromCache_Start(void)
+{
+	uint16_t First = 0, Last, PageEnd;
+	uint64_t Mask;
+
+	while(!(ConfigCache.Dirty & (1ULL << First)))
+		First++;
+	PageEnd = (First / EepromPageSize + 1) * EepromPageSize;
+	Last = First;
+	for(uint16_t Index = First; Index < PageEnd; Index++)
+	{
+		if(ConfigCache.Dirty & (1ULL << Index))
+			Last = Index;
+	}
+	Mask = EepromCache_Mask(First, Last - First + 1);
+	//A change from now on marks the byte again
+	ConfigCache.Dirty &= ~Mask;
+	if(!EepromCache_Submit(First, &ConfigCache.Shadow[First], Last - First + 1, false))
+		ConfigCache.Dirty |= Mask; //Queue full, next time
+}
+
+//A copy of the data goes as a queued storage job, WP released until the write cycle ends
+static bool EepromCache_Submit(uint16_t Register, const uint8_t *Data, uint16_t Length, bool Direct)
+{
+	I2cJob Job = {
+			.Type = I2cJob_MemWrite,
+			.Priority = I2cPrio_Storage,
+			.Address = ConfigCache.Address,
+			.Register = Register,
+			.RegisterSize = EepromAddressSize,
+			.Data = ConfigCache.Staging,
+			.Length = Length,
+			.Done = EepromCache_Done
+	};
+
+	ConfigCache.Register = Register;
+	ConfigCache.Length = Length;
+	ConfigCache.Direct = Direct;
+	memcpy(ConfigCache.Staging, Data, Length);
+	ConfigCache.State = Eeprom_Writing;
+	EepromCache_Protect(false);
+	if(!I2cQueue_Submit(ConfigCache.Handle, &Job))
+	{
+		ConfigCache.State = Eeprom_Idle;
+		EepromCache_Protect(true);
+		return false;
+	}
+	return true;
+}
+
+//The EEPROM doesn't acknowledge its address until the write cycle ends, once per ms.
+//The probe goes first, a main loop pass longer than the write cycle finds the write done
+static void EepromCache_Poll(void)
+{
+	static uint32_t LastPoll = 0;
+	uint32_t Elapsed = HAL_GetTick() - ConfigCache.WriteStart;
+	bool Ready = false;
+
+	if(HAL_GetTick() == LastPoll)
+		return;
+	LastPoll = HAL_GetTick();
+	//The register level probe goes with the queue held, it isn't a queue transaction
+	if(I2cBus_Ready(ConfigCache.Handle) && I2cQueue_Hold(ConfigCache.Handle))
+	{
+		Ready = (I2cMaster_IsDeviceReady(ConfigCache.Handle, ConfigCache.Address, I2cProbeTimeout) == HAL_OK);
+		I2cQueue_Release(ConfigCache.Handle);
+		ConfigCache.Polls++;
+	}
+	if(!Ready)
+	{
+		//Still busy (or no probe possible) past the limit
+		if(Elapsed > EepromWriteCycleMax)
+			ConfigCache.State = Eeprom_Failed;
+		return;
+	}
+	if(Elapsed > ConfigCache.MaxCycle)
+		ConfigCache.MaxCycle = Elapsed;
+	if(ConfigCache.Direct)
+		ConfigCache.PagesWritten++;
+	else
+		ConfigCache.WriteCycles[ConfigCache.Register / EepromPageSize]++;
+	ConfigCache.BytesWritten += ConfigCache.Length;
+	EepromCache_Protect(true);
+	ConfigCache.State = Eeprom_Idle;
+}
+
+//From the queue, interrupt
+static void EepromCache_Done(const I2cJob *Job, HAL_StatusTypeDef Result)
+{
+	(void) Job;
+	ConfigCache.WriteStart = HAL_GetTick();
+	ConfigCache.State = (Result == HAL_OK) ? Eeprom_Polling : Eeprom_Failed;
+}
+
+static uint64_t EepromCache_Mask(uint16_t Register, uint16_t Length)
+{
+	return ((Length >= 64) ? 0xFFFFFFFFFFFFFFFFULL : ((1ULL << Length) - 1)) << Register;
+}
+
+//WP high: writes ignored
+static void EepromCache_Protect(bool Protect)
+{
+	HAL_GPIO_WritePin(WP_GPIO_Port, WP_Pin, Protect ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
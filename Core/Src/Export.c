@@ -0,0 +1,165 @@
+/**
+ *  Serial export
+ *  A buffer is Free, Ready or Sending. Only the main loop makes one
+ *  Ready and only while the other isn't, so a frame never waits behind
+ *  two. The DMA is started from the ISR or from the main loop with its
+ *  interrupt off, whoever finds the link idle.
+ */
+
+#include "Export.h"
+#include "ConfigImage.h"
+#include <string.h>
+
+Export SerialExport;
+
+static bool Export_Fill(Export *Link, uint8_t *Frame, uint16_t *Length);
+static void Export_Next(Export *Link);
+
+//USART1 at ExportBaud with the DMA on its TX
+void Export_Init(Logger *Log)
+{
+	memset(&SerialExport, 0, sizeof(Export));
+	SerialExport.Log = Log;
+	Acquisition_ReaderInit(&SerialExport.Reader);
+	RCC -> APB2ENR |= RCC_APB2ENR_USART1EN | RCC_APB2ENR_IOPAEN;
+	RCC -> AHBENR |= RCC_AHBENR_DMA1EN;
+	//PA9 alternate function push-pull, PA10 input with pull-up
+	MODIFY_REG(GPIOA -> CRH, GPIO_CRH_MODE9 | GPIO_CRH_CNF9 | GPIO_CRH_MODE10 | GPIO_CRH_CNF10,
+			GPIO_CRH_MODE9 | GPIO_CRH_CNF9_1 | GPIO_CRH_CNF10_1);
+	GPIOA -> BSRR = GPIO_BSRR_BS10;
+	USART1 -> CR1 = 0;
+	USART1 -> BRR = (HAL_RCC_GetPCLK2Freq() + ExportBaud / 2) / ExportBaud;
+	USART1 -> CR2 = 0;
+	USART1 -> CR3 = USART_CR3_DMAT;
+	USART1 -> CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE;
+	DMA1_Channel4 -> CCR = 0;
+	DMA1_Channel4 -> CPAR = (uint32_t) &USART1 -> DR;
+	DMA1_Channel4 -> CCR = DMA_CCR_PL_0 | DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_TCIE;
+	HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 3, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+	SerialExport.WindowStart = HAL_GetTick();
+}
+
+//Main loop: the dump command, a frame into the free buffer and the link started if it's idle
+void Export_task(void)
+{
+	Export *Link = &SerialExport;
+	uint32_t Now = HAL_GetTick();
+	uint16_t Buffer;
+
+	if(Now - Link->WindowStart >= 1000)
+	{
+		Link->BytesPerSecond = ((Link->Bytes - Link->WindowBytes) * 1000) / (Now - Link->WindowStart);
+		Link->WindowBytes = Link->Bytes;
+		Link->WindowStart = Now;
+	}
+	if((USART1 -> SR & USART_SR_RXNE) && (uint8_t) USART1 -> DR == ExportDumpCommand && !Link->Dumping)
+	{
+		Link->Dumping = true;
+		Link->Begun = false;
+	}
+	if(Link->States[0] == Buffer_Ready || Link->States[1] == Buffer_Ready)
+		return;
+	Buffer = (Link->States[0] == Buffer_Free) ? 0 : 1;
+	if(Link->States[Buffer] != Buffer_Free || !Export_Fill(Link, Link->Frames[Buffer], &Link->Lengths[Buffer]))
+		return;
+	Link->States[Buffer] = Buffer_Ready;
+	HAL_NVIC_DisableIRQ(DMA1_Channel4_IRQn);
+	Export_Next(Link);
+	HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+}
+
+//ISR Handlers
+void Export_DMA_ISR(void)
+{
+	Export *Link = &SerialExport;
+	uint32_t Flags = DMA1 -> ISR;
+
+	DMA1 -> IFCR = DMA_IFCR_CGIF4;
+	if(!(Flags & DMA_ISR_TCIF4))
+		return;
+	DMA1_Channel4 -> CCR &= ~DMA_CCR_EN;
+	for(uint16_t Buffer = 0; Buffer < 2; Buffer++)
+	{
+		if(Link->States[Buffer] == Buffer_Sending)
+		{
+			Link->Sent++;
+			Link->Bytes += Link->Lengths[Buffer];
+			Link->States[Buffer] = Buffer_Free;
+		}
+	}
+	Export_Next(Link);
+}
+
+//Private functions
+//A frame into Frame: the dump first, the samples waiting otherwise. False with nothing to send
+static bool Export_Fill(Export *Link, uint8_t *Frame, uint16_t *Length)
+{
+	uint8_t *Body = ExportFrame_Body(Frame);
+	Sample *Samples = (Sample *) Body;
+	uint32_t Now;
+	uint16_t Count = 0;
+
+	if(Link->Dumping && !Link->Begun)
+	{
+		//Blocks and the log clock, to place the live samples against the log
+		Count = Link->Log->Ready ? Link->Log->Count : 0;
+		Now = Logger_Now(Link->Log);
+		memcpy(Body, &Count, sizeof(Count));
+		memcpy(Body + sizeof(Count), &Now, sizeof(Now));
+		Link->Age = Count;
+		Link->Written = Link->Log->Blocks;
+		Link->Begun = true;
+		*Length = ExportFrame_Seal(Frame, Export_Begin, Link->Sequence++, sizeof(Count) + sizeof(Now), ConfigImage_Crc);
+		return true;
+	}
+	if(Link->Dumping)
+	{
+		//The blocks written meanwhile are newer, the ones left to send got older
+		Link->Age += Link->Log->Blocks - Link->Written;
+		Link->Written = Link->Log->Blocks;
+		while(Link->Age > 0)
+		{
+			if(Logger_Read(Link->Log, Link->Age - 1, (LogBlock *) Body))
+			{
+				Link->Age--;
+				Link->Blocks++;
+				*Length = ExportFrame_Seal(Frame, Export_Block, Link->Sequence++, sizeof(LogBlock), ConfigImage_Crc);
+				return true;
+			}
+			//The EEPROM doesn't answer during its write cycle, the same block again on the next call
+			if(ConfigCache.State != Eeprom_Idle)
+			{
+				Link->Busy++;
+				return false;
+			}
+			//Damaged, skipped
+			Link->Age--;
+		}
+		Link->Dumping = false;
+		*Length = ExportFrame_Seal(Frame, Export_End, Link->Sequence++, 0, ConfigImage_Crc);
+		return true;
+	}
+	while(Count < ExportMaxSamples && Acquisition_Pop(&Link->Reader, &Samples[Count]))
+		Count++;
+	if(Count == 0)
+		return false;
+	*Length = ExportFrame_Seal(Frame, Export_Samples, Link->Sequence++, Count * sizeof(Sample), ConfigImage_Crc);
+	return true;
+}
+
+//A ready frame to the DMA if the link is idle. From the ISR or with its interrupt off
+static void Export_Next(Export *Link)
+{
+	uint16_t Buffer;
+
+	if(Link->States[0] == Buffer_Sending || Link->States[1] == Buffer_Sending)
+		return;
+	for(Buffer = 0; Buffer < 2 && Link->States[Buffer] != Buffer_Ready; Buffer++);
+	if(Buffer == 2)
+		return;
+	Link->States[Buffer] = Buffer_Sending;
+	DMA1_Channel4 -> CMAR = (uint32_t) Link->Frames[Buffer];
+	DMA1_Channel4 -> CNDTR = Link->Lengths[Buffer];
+	DMA1_Channel4 -> CCR |= DMA_CCR_EN;
+}
@@ -0,0 +1,86 @@
+/**
+ *  Export frames
+ *  In place COBS: with the payload one byte after the start of the frame
+ *  every byte but the zeros stays where it is, a zero becomes the length
+ *  of the run after it and the byte before the payload the length of
+ *  the first run.
+ */
+
+#include "ExportFrame.h"
+
+//Frame: ExportFrameSize bytes, 4 byte aligned, so is the body
+uint8_t *ExportFrame_Body(uint8_t *Frame)
+{
+	return Frame + 4;
+}
+
+//Length bytes of body already in place. The bytes to send, delimiter included
+uint16_t ExportFrame_Seal(uint8_t *Frame, ExportType Type, uint16_t Sequence, uint16_t Length, uint32_t (*Crc)(const uint8_t *Data, uint16_t Length))
+{
+	uint16_t Payload = 3 + Length;
+	uint16_t Code = 0;
+	uint32_t Check;
+
+	Frame[1] = (uint8_t) Type;
+	Frame[2] = (uint8_t) Sequence;
+	Frame[3] = (uint8_t) (Sequence >> 8);
+	Check = Crc(&Frame[1], Payload);
+	for(uint16_t Byte = 0; Byte < 4; Byte++)
+		Frame[1 + Payload++] = (uint8_t) (Check >> (Byte * 8));
+	for(uint16_t Index = 1; Index <= Payload; Index++)
+	{
+		if(Frame[Index] == 0)
+		{
+			Frame[Code] = (uint8_t) (Index - Code);
+			Code = Index;
+		}
+	}
+	Frame[Code] = (uint8_t) (Payload + 1 - Code);
+	Frame[Payload + 1] = 0;
+	return Payload + 2;
+}
+
+//Wire: a frame without its delimiter. The payload length with a good CRC, 0 otherwise
+uint16_t ExportFrame_Open(const uint8_t *Wire, uint16_t Length, uint8_t *Payload)
+{
+	uint16_t Read = 0, Written = 0, Run;
+	uint32_t Check = 0;
+
+	if(Length < 2 || Length > ExportMaxPayload + 1)
+		return 0;
+	while(Read < Length)
+	{
+		Run = Wire[Read++];
+		if(Run == 0 || Read + Run - 1 > Length)
+			return 0;
+		for(uint16_t Byte = 1; Byte < Run; Byte++)
+			Payload[Written++] = Wire[Read++];
+		if(Read < Length && Run != 0xFF)
+			Payload[Written++] = 0;
+	}
+	if(Written < 3 + 4)
+		return 0;
+	for(uint16_t Byte = 0; Byte < 4; Byte++)
+		Check |= (uint32_t) Payload[Written - 4 + Byte] << (Byte * 8);
+	if(ExportFrame_Crc(Payload, Written - 4) != Check)
+		return 0;
+	return Written;
+}
+
+//The CRC of the CRC unit in software, CRC-32/MPEG-2 over little endian words, the last one zero padded
+uint32_t ExportFrame_Crc(const uint8_t *Data, uint16_t Length)
+{
+	uint32_t Crc = 0xFFFFFFFF;
+	uint32_t Word;
+
+	for(uint16_t Index = 0; Index < Length; Index += 4)
+	{
+		Word = 0;
+		for(uint16_t Byte = 0; Byte < 4 && Index + Byte < Length; Byte++)
+			Word |= (uint32_t) Data[Index + Byte] << (Byte * 8);
+		Crc ^= Word;
+		for(uint16_t Bit = 0; Bit < 32; Bit++)
+			Crc = (Crc & 0x80000000) ? (Crc << 1) ^ 0x04C11DB7 : Crc << 1;
+	}
+	return Crc;
+}
@@ -0,0 +1,300 @@
+/**
+ *  Configuration store in the internal flash
+ *  Page: an 8 byte header (magic, generation, inverted generation, spare)
+ *  and 127 records of 8 bytes (key, value low, value high, CRC), every
+ *  field a half word, the size the flash programs at once. A record is
+ *  programmed key first and CRC last, a slot that isn't blank is used
+ *  even if its CRC is bad, the first blank slot is the end of the log.
+ */
+
+#include "FlashStore.h"
+#include <string.h>
+
+#define HeaderSize 8
+#define RecordSize 8
+#define RecordSlots ((FlashStorePageSize - HeaderSize) / RecordSize)
+
+typedef struct FlashHeader
+{
+	uint16_t Magic;
+	uint16_t Generation;
+	uint16_t Check; //~Generation
+	uint16_t Spare;
+}FlashHeader;
+
+typedef struct FlashRecord
+{
+	uint16_t Key;
+	uint16_t ValueLow;
+	uint16_t ValueHigh;
+	uint16_t Crc;
+}FlashRecord;
+
+FlashStore ConfigStore;
+
+static bool FlashStore_Valid(uint32_t Page);
+static bool FlashStore_Blank(uint32_t Page);
+static bool FlashStore_Erase(uint32_t Page);
+static bool FlashStore_Program(uint32_t Address, const uint16_t *Data, uint16_t Count);
+static bool FlashStore_Append(FlashKey Key, uint32_t Value);
+static bool FlashStore_Compact(void);
+static void FlashStore_Scan(void);
+static uint16_t FlashStore_Crc(uint16_t Key, uint32_t Value);
+
+//Picks the active page and fills the index, cleans after an interrupted compaction
+void FlashStore_Init(void)
+{
+	bool ValidA = FlashStore_Valid(FlashStorePageA);
+	bool ValidB = FlashStore_Valid(FlashStorePageB);
+	const FlashHeader *HeaderA = (const FlashHeader *) FlashStorePageA;
+	const FlashHeader *HeaderB = (const FlashHeader *) FlashStorePageB;
+	uint32_t Stale;
+	FlashHeader Header = {FlashStoreMagic, 0, 0xFFFF, 0xFFFF};
+
+	memset(&ConfigStore, 0, sizeof(FlashStore));
+	ConfigStore.LastFlush = HAL_GetTick();
+	HAL_FLASH_Unlock();
+	if(ValidA && ValidB)
+	{
+		//The compaction wrote the new header but didn't get to the erase
+		ConfigStore.Active = ((int16_t) (HeaderB->Generation - HeaderA->Generation) > 0) ? FlashStorePageB : FlashStorePageA;
+		Stale = (ConfigStore.Active == FlashStorePageA) ? FlashStorePageB : FlashStorePageA;
+		FlashStore_Erase(Stale);
+	}
+	else if(ValidA || ValidB)
+	{
+		ConfigStore.Active = ValidA ? FlashStorePageA : FlashStorePageB;
+		Stale = ValidA ? FlashStorePageB : FlashStorePageA;
+		//A compaction that didn't reach the header
+		if(!FlashStore_Blank(Stale))
+			FlashStore_Erase(Stale);
+	}
+	else
+	{
+		//First boot or both pages damaged, start over on A
+		if(!FlashStore_Blank(FlashStorePageA))
+			FlashStore_Erase(FlashStorePageA);
+		if(!FlashStore_Blank(FlashStorePageB))
+			FlashStore_Erase(FlashStorePageB);
+		ConfigStore.Active = FlashStorePageA;
+		FlashStore_Program(FlashStorePageA, (const uint16_t *) &Header, sizeof(FlashHeader) / 2);
+	}
+	HAL_FLASH_Lock();
+	ConfigStore.Generation = ((const FlashHeader *) ConfigStore.Active)->Generation;
+	FlashStore_Scan();
+}
+
+//False if the key was never stored
+bool FlashStore_Read(FlashKey Key, uint32_t *Value)
+{
+	if(Key >= FlashStoreKeys || !ConfigStore.Index[Key].Present)
+		return false;
+	*Value = ConfigStore.Index[Key].Value;
+	return true;
+}
+
+//Only the RAM copy, FlashStore_task programs it
+void FlashStore_Write(FlashKey Key, uint32_t Value)
+{
+	FlashEntry *Entry;
+
+	if(Key >= FlashStoreKeys)
+		return;
+	Entry = &ConfigStore.Index[Key];
+	if(Entry->Present && Entry->Value == Value)
+		return;
+	Entry->Value = Value;
+	Entry->Present = true;
+	Entry->Dirty = true;
+}
+
+//Programs the changed keys now, compacting if the page fills
+void FlashStore_Flush(void)
+{
+	FlashEntry *Entry;
+
+	ConfigStore.LastFlush = HAL_GetTick();
+	HAL_FLASH_Unlock();
+	for(uint16_t Key = 0; Key < FlashStoreKeys; Key++)
+	{
+		Entry = &ConfigStore.Index[Key];
+		if(!Entry->Dirty)
+			continue;
+		if(ConfigStore.Free >= RecordSlots)
+		{
+			//Takes every dirty key with it
+			FlashStore_Compact();
+			break;
+		}
+		if(!FlashStore_Append(Key, Entry->Value))
+			break;
+		Entry->Dirty = false;
+	}
+	HAL_FLASH_Lock();
+}
+
+//Main loop
+void FlashStore_task(void)
+{
+	bool Dirty = false;
+
+	if(HAL_GetTick() - ConfigStore.LastFlush < FlashStoreMinInterval)
+		return;
+	for(uint16_t Key = 0; Key < FlashStoreKeys; Key++)
+		Dirty |= ConfigStore.Index[Key].Dirty;
+	if(Dirty)
+		FlashStore_Flush();
+}
+
+//Private functions
+static bool FlashStore_Valid(uint32_t Page)
+{
+	const FlashHeader *Header = (const FlashHeader *) Page;
+	uint16_t Check = ~Header->Generation;
+
+	return Header->Magic == FlashStoreMagic && Header->Check == Check;
+}
+
+static bool FlashStore_Blank(uint32_t Page)
+{
+	const uint32_t *Word = (const uint32_t *) Page;
+
+	for(uint16_t Index = 0; Index < FlashStorePageSize / 4; Index++)
+	{
+		if(Word[Index] != 0xFFFFFFFF)
+			return false;
+	}
+	return true;
+}
+
+//Flash unlocked
+static bool FlashStore_Erase(uint32_t Page)
+{
+	FLASH_EraseInitTypeDef Erase = {
+			.TypeErase = FLASH_TYPEERASE_PAGES,
+			.Banks = FLASH_BANK_1,
+			.PageAddress = Page,
+			.NbPages = 1
+	};
+	uint32_t PageError;
+
+	ConfigStore.Erases++;
+	if(HAL_FLASHEx_Erase(&Erase, &PageError) != HAL_OK)
+	{
+		ConfigStore.Failures++;
+		return false;
+	}
+	return true;
+}
+
+//Flash unlocked, half words in order
+static bool FlashStore_Program(uint32_t Address, const uint16_t *Data, uint16_t Count)
+{
+	for(uint16_t Index = 0; Index < Count; Index++)
+	{
+		if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, Address + Index * 2, Data[Index]) != HAL_OK)
+		{
+			ConfigStore.Failures++;
+			return false;
+		}
+	}
+	return true;
+}
+
+//Flash unlocked, the CRC goes last so a cut record never looks valid
+static bool FlashStore_Append(FlashKey Key, uint32_t Value)
+{
+	FlashRecord Record = {
+			.Key = Key,
+			.ValueLow = (uint16_t) Value,
+			.ValueHigh = (uint16_t) (Value >> 16),
+			.Crc = FlashStore_Crc(Key, Value)
+	};
+	uint32_t Address = ConfigStore.Active + HeaderSize + ConfigStore.Free * RecordSize;
+
+	//The slot is used even if the programming fails halfway
+	ConfigStore.Free++;
+	if(!FlashStore_Program(Address, (const uint16_t *) &Record, sizeof(FlashRecord) / 2))
+		return false;
+	ConfigStore.Records++;
+	return true;
+}
+
+//Flash unlocked. The live values go to the other page, its header makes it the active one
+static bool FlashStore_Compact(void)
+{
+	uint32_t Old = ConfigStore.Active;
+	uint32_t New = (Old == FlashStorePageA) ? FlashStorePageB : FlashStorePageA;
+	FlashHeader Header;
+
+	if(!FlashStore_Blank(New) && !FlashStore_Erase(New))
+		return false;
+	ConfigStore.Active = New;
+	ConfigStore.Free = 0;
+	for(uint16_t Key = 0; Key < FlashStoreKeys; Key++)
+	{
+		if(!ConfigStore.Index[Key].Present)
+			continue;
+		if(!FlashStore_Append(Key, ConfigStore.Index[Key].Value))
+		{
+			//The old page is still the valid one
+			ConfigStore.Active = Old;
+			ConfigStore.Free = RecordSlots;
+			return false;
+		}
+	}
+	Header.Magic = FlashStoreMagic;
+	Header.Generation = ConfigStore.Generation + 1;
+	Header.Check = (uint16_t) ~Header.Generation;
+	Header.Spare = 0xFFFF;
+	if(!FlashStore_Program(New, (const uint16_t *) &Header, sizeof(FlashHeader) / 2))
+	{
+		ConfigStore.Active = Old;
+		ConfigStore.Free = RecordSlots;
+		return false;
+	}
+	ConfigStore.Generation = Header.Generation;
+	ConfigStore.Compactions++;
+	for(uint16_t Key = 0; Key < FlashStoreKeys; Key++)
+		ConfigStore.Index[Key].Dirty = false;
+	FlashStore_Erase(Old);
+	return true;
+}
+
+//Replays the active page into the index, the newest record of each key wins
+static void FlashStore_Scan(void)
+{
+	const FlashRecord *Record;
+	uint32_t Value;
+
+	for(ConfigStore.Free = 0; ConfigStore.Free < RecordSlots; ConfigStore.Free++)
+	{
+		Record = (const FlashRecord *) (ConfigStore.Active + HeaderSize + ConfigStore.Free * RecordSize);
+		if(Record->Key == 0xFFFF && Record->ValueLow == 0xFFFF && Record->ValueHigh == 0xFFFF && Record->Crc == 0xFFFF)
+			break;
+		Value = Record->ValueLow | ((uint32_t) Record->ValueHigh << 16);
+		if(Record->Key >= FlashStoreKeys || Record->Crc != FlashStore_Crc(Record->Key, Value))
+		{
+			ConfigStore.Torn++;
+			continue;
+		}
+		ConfigStore.Index[Record->Key].Value = Value;
+		ConfigStore.Index[Record->Key].Present = true;
+	}
+}
+
+//CRC-16/CCITT of the key and the value, little endian
+static uint16_t FlashStore_Crc(uint16_t Key, uint32_t Value)
+{
+	const uint8_t Bytes[6] = {Key, Key >> 8, Value, Value >> 8, Value >> 16, Value >> 24};
+	uint16_t Crc = 0xFFFF;
+
+	for(uint16_t Index = 0; Index < sizeof(Bytes); Index++)
+	{
+		Crc ^= (uint16_t) Bytes[Index] << 8;
+		for(uint16_t Bit = 0; Bit < 8; Bit++)
+			Crc = (Crc & 0x8000) ? (Crc << 1) ^ 0x1021 : Crc << 1;
+	}
+	//A blank CRC is a record cut before its end, whatever its other fields hold
+	return (Crc == 0xFFFF) ? 0 : Crc;
+}
@@ -0,0 +1,127 @@
+/**
+ *  Flicker metrics
+ *  Flicker_Process runs in the photodiode DMA ISR, Flicker_Get copies the
+ *  last result from the main loop and retries if a window closed
+ *  meanwhile.
+ */
+
+#include "Flicker.h"
+#include <string.h>
+
+#define CoefficientShift 14 //cos in Q15 is 2*cos in Q14
+
+const uint16_t FlickerFrequencies[FlickerBins] = {50, 60, 100, 120, 200, 240};
+//cos(2*pi*k/FlickerWindow) in Q15, k = f * FlickerWindow / 9600
+static const int16_t Coefficients[FlickerBins] = {32750, 32743, 32698, 32667, 32488, 32365};
+
+static void Flicker_Close(Flicker *Meter);
+static uint32_t Flicker_Isqrt(uint64_t Value);
+
+void Flicker_Init(Flicker *Meter)
+{
+	memset(Meter, 0, sizeof(Flicker));
+	Meter->Min = 0xFFFF;
+}
+
+//Returns true when the block closed a window
+bool Flicker_Process(Flicker *Meter, const uint16_t *Block, uint16_t Length)
+{
+	bool Closed = false;
+	int32_t Centered, S0;
+
+	for(uint16_t Index = 0; Index < Length; Index++)
+	{
+		uint16_t Value = Block[Index];
+
+		Meter->Sum += Value;
+		if(Value < Meter->Min)
+			Meter->Min = Value;
+		if(Value > Meter->Max)
+			Meter->Max = Value;
+		Centered = Value - Meter->Mean;
+		if(Centered > 0)
+			Meter->Above += Centered;
+		for(uint16_t Bin = 0; Bin < FlickerBins; Bin++)
+		{
+			S0 = Centered + (int32_t) (((int64_t) Coefficients[Bin] * Meter->S1[Bin]) >> CoefficientShift) - Meter->S2[Bin];
+			Meter->S2[Bin] = Meter->S1[Bin];
+			Meter->S1[Bin] = S0;
+		}
+		if(++Meter->Count == FlickerWindow)
+		{
+			Flicker_Close(Meter);
+			Closed = true;
+		}
+	}
+	return Closed;
+}
+
+//False until the first window with a valid mean is done
+bool Flicker_Get(const Flicker *Meter, FlickerMetrics *Out)
+{
+	uint32_t Windows;
+
+	do
+	{
+		Windows = Meter->Windows;
+		if(Windows < 2)
+			return false;
+		memcpy(Out, &Meter->Result, sizeof(FlickerMetrics));
+	}while(Windows != Meter->Windows);
+	return true;
+}
+
+//Private functions
+static void Flicker_Close(Flicker *Meter)
+{
+	FlickerMetrics *Result = &Meter->Result;
+	int64_t Power, Cross;
+	uint32_t Amplitude, Mean = Meter->Sum / FlickerWindow;
+	uint16_t Strongest = 0;
+
+	Result->Mean = (uint16_t) Mean;
+	Result->PercentFlicker = (Meter->Max + Meter->Min) ? (uint16_t) (((uint32_t) (Meter->Max - Meter->Min) * 1000) / (Meter->Max + Meter->Min)) : 0;
+	Result->Index = (Meter->MeanValid && Meter->Sum) ? (uint16_t) (((uint64_t) Meter->Above * 1000) / Meter->Sum) : 0;
+	for(uint16_t Bin = 0; Bin < FlickerBins; Bin++)
+	{
+		//|X|^2 = S1^2 + S2^2 - 2cos*S1*S2, amplitude = 2|X|/N
+		Cross = ((int64_t) Meter->S1[Bin] * Meter->S2[Bin]) >> CoefficientShift;
+		Power = (int64_t) Meter->S1[Bin] * Meter->S1[Bin] + (int64_t) Meter->S2[Bin] * Meter->S2[Bin] - Cross * Coefficients[Bin];
+		Amplitude = (Power > 0) ? (2 * Flicker_Isqrt((uint64_t) Power)) / FlickerWindow : 0;
+		Result->Modulation[Bin] = Mean ? (uint16_t) ((Amplitude * 1000) / Mean) : 0;
+		if(Result->Modulation[Bin] > Result->Modulation[Strongest])
+			Strongest = Bin;
+		Meter->S1[Bin] = 0;
+		Meter->S2[Bin] = 0;
+	}
+	Result->Frequency = (Result->Modulation[Strongest] >= FlickerMinModulation) ? FlickerFrequencies[Strongest] : 0;
+	//The next window centers on this mean
+	Meter->Mean = (int32_t) Mean;
+	Meter->MeanValid = true;
+	Meter->Count = 0;
+	Meter->Sum = 0;
+	Meter->Above = 0;
+	Meter->Min = 0xFFFF;
+	Meter->Max = 0;
+	Meter->Windows++;
+}
+
+static uint32_t Flicker_Isqrt(uint64_t Value)
+{
+	uint64_t Result = 0, Bit = (uint64_t) 1 << 62;
+
+	while(Bit > Value)
+		Bit >>= 2;
+	while(Bit)
+	{
+		if(Value >= Result + Bit)
+		{
+			Value -= Result + Bit;
+			Result = (Result >> 1) + Bit;
+		}
+		else
+			Result >>= 1;
+		Bit >>= 2;
+	}
+	return (uint32_t) Result;
+}
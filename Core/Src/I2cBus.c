@@ -0,0 +1,343 @@
+/**
+ *  I2C bus health
+ *  I2cBus_Report runs from the main loop and from the acquisition ISR,
+ *  parking only sets the flag and the backoff so it's safe from both.
+ *  The HAL calls, deinitialising the handle and the recovery, only run
+ *  from the main loop in I2cBus_task.
+ */
+
+#include "I2cBus.h"
+#include "I2cMaster.h"
+#include <string.h>
+
+#define StuckConfirm 50 //us, BUSY right after a STOP is still legit
+#define RateWindow 1000 //ms
+
+typedef struct I2cPins
+{
+	I2C_TypeDef *Instance;
+	GPIO_TypeDef *Port;
+	uint16_t Scl;
+	uint16_t Sda;
+}I2cPins;
+
+//I2C1 is remapped to PB8/PB9
+static const I2cPins Pins[I2cBuses] = {
+		{.Instance = I2C1, .Port = GPIOB, .Scl = GPIO_PIN_8, .Sda = GPIO_PIN_9},
+		{.Instance = I2C2, .Port = GPIOB, .Scl = GPIO_PIN_10, .Sda = GPIO_PIN_11}
+};
+
+I2cBusStatus I2cBusInfo[I2cBuses];
+I2cDevice I2cDevices[I2cMaxDevices];
+volatile uint16_t I2cDeviceCount = 0;
+
+static uint32_t WindowStart = 0;
+
+static uint16_t I2cBus_Index(I2C_HandleTypeDef *Handle);
+static I2cDevice *I2cBus_Device(I2C_HandleTypeDef *Handle, uint16_t Address);
+static I2cFault I2cBus_Classify(I2C_HandleTypeDef *Handle);
+static void I2cBus_Park(I2cBusStatus *Bus);
+static void I2cBus_Recover(uint16_t Index);
+static bool I2cBus_ClockOut(const I2cPins *Lines);
+static void I2cBus_Delay(uint32_t Micros);
+static void I2cBus_Rates(void);
+
+void I2cBus_Init(I2C_HandleTypeDef *Bus1, I2C_HandleTypeDef *Bus2)
+{
+	memset(I2cBusInfo, 0, sizeof(I2cBusInfo));
+	memset(I2cDevices, 0, sizeof(I2cDevices));
+	I2cDeviceCount = 0;
+	I2cBusInfo[0].Handle = Bus1;
+	I2cBusInfo[1].Handle = Bus2;
+	WindowStart = HAL_GetTick();
+	//The recovery times its pulses with the cycle counter
+	CoreDebug -> DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT -> CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+//Returns Result so it can wrap the HAL call
+HAL_StatusTypeDef I2cBus_Report(I2C_HandleTypeDef *Handle, uint16_t Address, HAL_StatusTypeDef Result)
+{
+	I2cBusStatus *Bus = &I2cBusInfo[I2cBus_Index(Handle)];
+	I2cDevice *Device = I2cBus_Device(Handle, Address);
+	I2cFault Fault;
+
+	if(Result == HAL_OK)
+	{
+		Bus->Failures = 0;
+		return Result;
+	}
+	//Refused without a transaction: parked, or the handle was taken by an interrupted call
+	if(Bus->Parked || (Result == HAL_BUSY && Handle->State != HAL_I2C_STATE_READY))
+	{
+		if(Device != NULL)
+			Device->Skipped++;
+		return Result;
+	}
+	Fault = I2cBus_Classify(Handle);
+	Handle->ErrorCode = HAL_I2C_ERROR_NONE;
+	Bus->Faults[Fault]++;
+	if(Device != NULL)
+	{
+		Device->Faults[Fault]++;
+		Device->WindowErrors++;
+	}
+	if(Fault != I2c_Nack)
+		I2cBus_Park(Bus);
+	return Result;
+}
+
+bool I2cBus_Ready(I2C_HandleTypeDef *Handle)
+{
+	return !I2cBusInfo[I2cBus_Index(Handle)].Parked;
+}
+
+//Address only write: START, address, STOP. True if the device acknowledged it
+bool I2cBus_Probe(I2C_HandleTypeDef *Handle, uint16_t Address)
+{
+	I2cBusStatus *Bus = &I2cBusInfo[I2cBus_Index(Handle)];
+	uint32_t Start = DWT -> CYCCNT;
+	HAL_StatusTypeDef Result;
+
+	Result = I2cMaster_IsDeviceReady(Handle, Address, I2cProbeTimeout);
+	Bus->Probes++;
+	Bus->ProbeTime += (DWT -> CYCCNT - Start) / (SystemCoreClock / 1000000);
+	//A missing device is a NACK, no SB or no answer at all parks the bus
+	return I2cBus_Report(Handle, Address, Result) == HAL_OK;
+}
+
+//Up to 4 characters for the diagnostics
+void I2cBus_Name(I2C_HandleTypeDef *Handle, uint16_t Address, const char *Name)
+{
+	I2cDevice *Device = I2cBus_Device(Handle, Address);
+
+	if(Device == NULL)
+		return;
+	strncpy(Device->Name, Name, sizeof(Device->Name) - 1);
+	Device->Name[sizeof(Device->Name) - 1] = '\0';
+}
+
+//Cycles the bus spent on them, from the START to the STOP
+void I2cBus_Traffic(I2C_HandleTypeDef *Handle, uint16_t Address, uint32_t Transactions, uint32_t Bytes, uint32_t Cycles)
+{
+	I2cDevice *Device = I2cBus_Device(Handle, Address);
+	uint32_t Mask;
+
+	if(Device == NULL)
+		return;
+	Mask = __get_PRIMASK();
+	__disable_irq();
+	Device->Transactions += Transactions;
+	Device->Bytes += Bytes;
+	Device->BusyMicros += Cycles / (SystemCoreClock / 1000000);
+	Device->WindowTransactions += Transactions;
+	Device->WindowBytes += Bytes;
+	Device->WindowCycles += Cycles;
+	__set_PRIMASK(Mask);
+}
+
+uint32_t I2cBus_DeviceFaults(const I2cDevice *Device)
+{
+	uint32_t Total = 0;
+
+	for(uint16_t Fault = 0; Fault < I2c_Faults; Fault++)
+		Total += Device->Faults[Fault];
+	return Total;
+}
+
+//Main loop only
+void I2cBus_task(void)
+{
+	I2cBusStatus *Bus;
+
+	I2cBus_Rates();
+	for(uint16_t Index = 0; Index < I2cBuses; Index++)
+	{
+		Bus = &I2cBusInfo[Index];
+		if(Bus->Handle == NULL)
+			continue;
+		if(Bus->Parked)
+		{
+			if(Bus->Handle->State != HAL_I2C_STATE_RESET)
+				HAL_I2C_DeInit(Bus->Handle);
+			if(HAL_GetTick() - Bus->ParkedAt >= Bus->Backoff)
+				I2cBus_Recover(Index);
+			continue;
+		}
+		//Idle handle with BUSY set, a line is held low. Caught here before a display flush runs into it
+		if(Bus->Handle->State == HAL_I2C_STATE_READY && (Bus->Handle->Instance->SR2 & I2C_SR2_BUSY))
+		{
+			I2cBus_Delay(StuckConfirm);
+			if(Bus->Handle->State == HAL_I2C_STATE_READY && (Bus->Handle->Instance->SR2 & I2C_SR2_BUSY))
+			{
+				Bus->Faults[I2c_BusBusy]++;
+				I2cBus_Park(Bus);
+			}
+		}
+	}
+}
+
+//ISR Handlers
+//HAL_I2C_ErrorCallback, only the interrupt and DMA transfers get here
+void I2cBus_ErrorISR(I2C_HandleTypeDef *Handle)
+{
+	I2cBus_Report(Handle, Handle->Devaddress, HAL_ERROR);
+}
+
+//Private functions
+static uint16_t I2cBus_Index(I2C_HandleTypeDef *Handle)
+{
+	return (Handle->Instance == Pins[0].Instance) ? 0 : 1;
+}
+
+//Devices are added the first time they report, NULL once the table is full
+static I2cDevice *I2cBus_Device(I2C_HandleTypeDef *Handle, uint16_t Address)
+{
+	static const char Hex[] = "0123456789ABCDEF";
+	I2cDevice *Device = NULL;
+	uint32_t Mask;
+
+	for(uint16_t Index = 0; Index < I2cDeviceCount; Index++)
+		if(I2cDevices[Index].Bus == Handle && I2cDevices[Index].Address == Address)
+			return &I2cDevices[Index];
+	//The ISR could be adding one too
+	Mask = __get_PRIMASK();
+	__disable_irq();
+	if(I2cDeviceCount < I2cMaxDevices)
+	{
+		Device = &I2cDevices[I2cDeviceCount];
+		Device->Bus = Handle;
+		Device->Address = Address;
+		Device->Name[0] = Hex[(Address >> 4) & 0x0F];
+		Device->Name[1] = Hex[Address & 0x0F];
+		Device->Name[2] = '\0';
+		I2cDeviceCount++;
+	}
+	__set_PRIMASK(Mask);
+	return Device;
+}
+
+static I2cFault I2cBus_Classify(I2C_HandleTypeDef *Handle)
+{
+	uint32_t Error = Handle->ErrorCode;
+
+	if(Error & HAL_I2C_ERROR_ARLO)
+		return I2c_Arbitration;
+	if(Error & HAL_I2C_ERROR_BERR)
+		return I2c_BusError;
+	if(Error & HAL_I2C_ERROR_AF)
+		return I2c_Nack;
+	if(Handle->Instance->SR2 & I2C_SR2_BUSY)
+		return I2c_BusBusy;
+	if(Error & HAL_I2C_ERROR_TIMEOUT)
+		return I2c_Timeout;
+	//OVR or a library that didn't say why
+	return I2c_BusError;
+}
+
+static void I2cBus_Park(I2cBusStatus *Bus)
+{
+	if(Bus->Parked)
+		return;
+	//Immediate the first time, then doubling
+	if(Bus->Failures == 0)
+		Bus->Backoff = 0;
+	else if(Bus->Failures > 7)
+		Bus->Backoff = I2cBackoffMax;
+	else
+	{
+		Bus->Backoff = (uint32_t) I2cBackoffMin << (Bus->Failures - 1);
+		if(Bus->Backoff > I2cBackoffMax)
+			Bus->Backoff = I2cBackoffMax;
+	}
+	Bus->Failures++;
+	Bus->ParkedAt = HAL_GetTick();
+	//I2cBus_task releases the handle
+	Bus->Parked = true;
+}
+
+static void I2cBus_Recover(uint16_t Index)
+{
+	I2cBusStatus *Bus = &I2cBusInfo[Index];
+	uint32_t Start = DWT -> CYCCNT;
+	uint32_t Micros;
+
+	if(!I2cBus_ClockOut(&Pins[Index]))
+		Bus->Stuck++;
+	//The handle isn't ready until HAL_I2C_Init finishes, a report on the way sees the new state
+	Bus->Parked = false;
+	__DMB();
+	//MspInit gives the pins back to the peripheral and Init pulses SWRST
+	HAL_I2C_Init(Bus->Handle);
+	Bus->Recoveries++;
+	Micros = (DWT -> CYCCNT - Start) / (SystemCoreClock / 1000000);
+	if(Micros > Bus->MaxRecovery)
+		Bus->MaxRecovery = Micros;
+}
+
+//True if both lines are high at the end
+static bool I2cBus_ClockOut(const I2cPins *Lines)
+{
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+	Lines->Port -> BSRR = Lines->Scl | Lines->Sda;
+	GPIO_InitStruct.Pin = Lines->Scl | Lines->Sda;
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+	HAL_GPIO_Init(Lines->Port, &GPIO_InitStruct);
+	I2cBus_Delay(I2cHalfClock);
+	//A slave in the middle of a byte holds SDA low until it gets the rest of its clocks
+	for(uint16_t Pulse = 0; Pulse < I2cClockOutPulses && !(Lines->Port -> IDR & Lines->Sda); Pulse++)
+	{
+		Lines->Port -> BRR = Lines->Scl;
+		I2cBus_Delay(I2cHalfClock);
+		Lines->Port -> BSRR = Lines->Scl;
+		I2cBus_Delay(I2cHalfClock);
+	}
+	//STOP, SDA rises while SCL is high
+	Lines->Port -> BRR = Lines->Scl;
+	I2cBus_Delay(I2cHalfClock);
+	Lines->Port -> BRR = Lines->Sda;
+	I2cBus_Delay(I2cHalfClock);
+	Lines->Port -> BSRR = Lines->Scl;
+	I2cBus_Delay(I2cHalfClock);
+	Lines->Port -> BSRR = Lines->Sda;
+	I2cBus_Delay(I2cHalfClock);
+	return (Lines->Port -> IDR & Lines->Scl) && (Lines->Port -> IDR & Lines->Sda);
+}
+
+//Closes the window once a second
+static void I2cBus_Rates(void)
+{
+	uint32_t Elapsed = HAL_GetTick() - WindowStart;
+	uint32_t Mask;
+	I2cDevice *Device;
+
+	if(Elapsed < RateWindow)
+		return;
+	Mask = __get_PRIMASK();
+	__disable_irq();
+	for(uint16_t Index = 0; Index < I2cDeviceCount; Index++)
+	{
+		Device = &I2cDevices[Index];
+		Device->TransactionsPerSecond = (uint32_t) (((uint64_t) Device->WindowTransactions * 1000) / Elapsed);
+		Device->BytesPerSecond = (uint32_t) (((uint64_t) Device->WindowBytes * 1000) / Elapsed);
+		Device->ErrorsPerSecond = (uint32_t) (((uint64_t) Device->WindowErrors * 1000) / Elapsed);
+		//Cycles over ms * cycles per ms, in per mille
+		Device->BusyPerMille = (uint16_t) (((uint64_t) Device->WindowCycles * 1000) / ((uint64_t) Elapsed * (SystemCoreClock / 1000)));
+		Device->WindowTransactions = 0;
+		Device->WindowBytes = 0;
+		Device->WindowCycles = 0;
+		Device->WindowErrors = 0;
+	}
+	WindowStart += Elapsed;
+	__set_PRIMASK(Mask);
+}
+
+static void I2cBus_Delay(uint32_t Micros)
+{
+	uint32_t Start = DWT -> CYCCNT;
+	uint32_t Cycles = Micros * (SystemCoreClock / 1000000);
+
+	while(DWT -> CYCCNT - Start < Cycles);
+}
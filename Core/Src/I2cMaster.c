@@ -0,0 +1,315 @@
+/**
+ *  Register level I2C master
+ *  The receive sequences follow RM0008 26.3.3 for 1, 2 and more bytes,
+ *  the windows with the interrupts masked are the ones of the errata.
+ *  Every wait watches AF, ARLO and BERR too and gives up after the
+ *  timeout, in us from the START.
+ */
+
+#include "I2cMaster.h"
+#include "stm32f1xx_ll_i2c.h"
+
+typedef struct I2cTransfer
+{
+	I2C_HandleTypeDef *Handle;
+	I2C_TypeDef *Regs;
+	uint8_t Address;
+	uint32_t Start; //DWT cycles
+	uint32_t Limit; //Cycles
+	bool Started;
+}I2cTransfer;
+
+I2cMasterStats I2cMasterInfo[I2cBuses];
+
+static bool I2cMaster_Take(I2C_HandleTypeDef *Handle);
+static HAL_StatusTypeDef I2cMaster_Begin(I2cTransfer *Transfer, I2C_HandleTypeDef *Handle, uint8_t Address, uint32_t Timeout);
+static bool I2cMaster_Wait(I2cTransfer *Transfer, uint32_t Flag);
+static HAL_StatusTypeDef I2cMaster_End(I2cTransfer *Transfer, HAL_StatusTypeDef Result, uint16_t Length);
+
+HAL_StatusTypeDef I2cMaster_Transmit(I2C_HandleTypeDef *Handle, uint16_t Address, const uint8_t *Data, uint16_t Length, uint32_t Timeout)
+{
+	I2cTransfer Transfer;
+	HAL_StatusTypeDef Result;
+
+	if(!I2cMaster_Take(Handle))
+		return HAL_BUSY;
+	Result = I2cMaster_Begin(&Transfer, Handle, (uint8_t) (Address & 0xFE), Timeout);
+	if(Result == HAL_OK)
+	{
+		LL_I2C_ClearFlag_ADDR(Transfer.Regs);
+		for(uint16_t Index = 0; Index < Length && Result == HAL_OK; Index++)
+		{
+			if(I2cMaster_Wait(&Transfer, I2C_SR1_TXE))
+				LL_I2C_TransmitData8(Transfer.Regs, Data[Index]);
+			else
+				Result = HAL_ERROR;
+		}
+		if(Result == HAL_OK && !I2cMaster_Wait(&Transfer, I2C_SR1_BTF))
+			Result = HAL_ERROR;
+		if(Result == HAL_OK)
+			LL_I2C_GenerateStopCondition(Transfer.Regs);
+	}
+	return I2cMaster_End(&Transfer, Result, Length);
+}
+
+HAL_StatusTypeDef I2cMaster_Receive(I2C_HandleTypeDef *Handle, uint16_t Address, uint8_t *Data, uint16_t Length, uint32_t Timeout)
+{
+	I2cTransfer Transfer;
+	HAL_StatusTypeDef Result;
+	uint16_t Index = 0;
+	uint32_t Mask;
+
+	if(Length == 0)
+		return HAL_ERROR;
+	if(!I2cMaster_Take(Handle))
+		return HAL_BUSY;
+	LL_I2C_AcknowledgeNextData(Handle->Instance, LL_I2C_ACK);
+	Result = I2cMaster_Begin(&Transfer, Handle, (uint8_t) (Address | 0x01), Timeout);
+	if(Result != HAL_OK)
+		return I2cMaster_End(&Transfer, Result, Length);
+	switch(Length)
+	{
+		case 1:
+			//NACK and STOP have to be set before the byte ends
+			LL_I2C_AcknowledgeNextData(Transfer.Regs, LL_I2C_NACK);
+			Mask = __get_PRIMASK();
+			__disable_irq();
+			LL_I2C_ClearFlag_ADDR(Transfer.Regs);
+			LL_I2C_GenerateStopCondition(Transfer.Regs);
+			__set_PRIMASK(Mask);
+			if(I2cMaster_Wait(&Transfer, I2C_SR1_RXNE))
+				Data[0] = LL_I2C_ReceiveData8(Transfer.Regs);
+			else
+				Result = HAL_ERROR;
+		break;
+		case 2:
+			//POS: the NACK goes to the second byte, both are read once they are in DR and the shift register
+			LL_I2C_EnableBitPOS(Transfer.Regs);
+			Mask = __get_PRIMASK();
+			__disable_irq();
+			LL_I2C_ClearFlag_ADDR(Transfer.Regs);
+			LL_I2C_AcknowledgeNextData(Transfer.Regs, LL_I2C_NACK);
+			__set_PRIMASK(Mask);
+			if(I2cMaster_Wait(&Transfer, I2C_SR1_BTF))
+			{
+				Mask = __get_PRIMASK();
+				__disable_irq();
+				LL_I2C_GenerateStopCondition(Transfer.Regs);
+				Data[0] = LL_I2C_ReceiveData8(Transfer.Regs);
+				__set_PRIMASK(Mask);
+				Data[1] = LL_I2C_ReceiveData8(Transfer.Regs);
+			}
+			else
+				Result = HAL_ERROR;
+		break;
+		default:
+			LL_I2C_ClearFlag_ADDR(Transfer.Regs);
+			for(; Index < Length - 3 && Result == HAL_OK; Index++)
+			{
+				if(I2cMaster_Wait(&Transfer, I2C_SR1_RXNE))
+					Data[Index] = LL_I2C_ReceiveData8(Transfer.Regs);
+				else
+					Result = HAL_ERROR;
+			}
+			//Last 3: N-2 in DR and N-1 in the shift register before the NACK and the STOP
+			if(Result == HAL_OK && I2cMaster_Wait(&Transfer, I2C_SR1_BTF))
+			{
+				LL_I2C_AcknowledgeNextData(Transfer.Regs, LL_I2C_NACK);
+				Mask = __get_PRIMASK();
+				__disable_irq();
+				Data[Index++] = LL_I2C_ReceiveData8(Transfer.Regs);
+				if(I2cMaster_Wait(&Transfer, I2C_SR1_BTF))
+				{
+					LL_I2C_GenerateStopCondition(Transfer.Regs);
+					Data[Index++] = LL_I2C_ReceiveData8(Transfer.Regs);
+					__set_PRIMASK(Mask);
+					if(I2cMaster_Wait(&Transfer, I2C_SR1_RXNE))
+						Data[Index] = LL_I2C_ReceiveData8(Transfer.Regs);
+					else
+						Result = HAL_ERROR;
+				}
+				else
+				{
+					__set_PRIMASK(Mask);
+					Result = HAL_ERROR;
+				}
+			}
+			else
+				Result = HAL_ERROR;
+		break;
+	}
+	return I2cMaster_End(&Transfer, Result, Length);
+}
+
+//Address only write, HAL_OK if it was acknowledged
+HAL_StatusTypeDef I2cMaster_IsDeviceReady(I2C_HandleTypeDef *Handle, uint16_t Address, uint32_t Timeout)
+{
+	I2cTransfer Transfer;
+	HAL_StatusTypeDef Result;
+
+	if(!I2cMaster_Take(Handle))
+		return HAL_BUSY;
+	Result = I2cMaster_Begin(&Transfer, Handle, (uint8_t) (Address & 0xFE), Timeout);
+	if(Result == HAL_OK)
+	{
+		LL_I2C_GenerateStopCondition(Transfer.Regs);
+		LL_I2C_ClearFlag_ADDR(Transfer.Regs);
+	}
+	return I2cMaster_End(&Transfer, Result, 0);
+}
+
+//Bytes per second while on the wire, to compare with I2cMasterCeiling
+uint32_t I2cMaster_Throughput(I2C_HandleTypeDef *Handle)
+{
+	I2cMasterStats *Stats = &I2cMasterInfo[(Handle->Instance == I2C1) ? 0 : 1];
+
+	if(Stats->Cycles == 0)
+		return 0;
+	return (uint32_t) (((uint64_t) Stats->Bytes * SystemCoreClock) / Stats->Cycles);
+}
+
+//Alternates HAL_I2C_Master_Receive and I2cMaster_Receive of the same bytes, the caller keeps the bus to itself.
+//Both are held to Timeout us on the cycle counter: the HAL tick timeout, a ms past it, only stops a hung
+//transfer and a HAL read that took Timeout or longer fails as the LL one would have
+void I2cMaster_Compare(I2C_HandleTypeDef *Handle, uint16_t Address, uint16_t Length, uint16_t Runs, uint32_t Timeout, I2cMasterComparison *Out)
+{
+	uint8_t Data[4];
+	uint32_t Start, Hal, Ll, Limit = Timeout * (SystemCoreClock / 1000000);
+	uint64_t HalTotal = 0, LlTotal = 0;
+	bool Failed;
+
+	Out->Runs = 0;
+	Out->Failures = 0;
+	if(Length == 0 || Length > sizeof(Data))
+		Runs = 0;
+	for(uint16_t Run = 0; Run < Runs; Run++)
+	{
+		Start = DWT -> CYCCNT;
+		Failed = HAL_I2C_Master_Receive(Handle, Address, Data, Length, Timeout / 1000 + 2) != HAL_OK;
+		Hal = DWT -> CYCCNT - Start;
+		Failed |= Hal >= Limit;
+		Start = DWT -> CYCCNT;
+		Failed |= I2cMaster_Receive(Handle, Address, Data, Length, Timeout) != HAL_OK;
+		Ll = DWT -> CYCCNT - Start;
+		//Only the reads both sides did are averaged, a failure costs each its own timeout
+		if(Failed)
+			Out->Failures++;
+		else
+		{
+			HalTotal += Hal;
+			LlTotal += Ll;
+			Out->Runs++;
+		}
+	}
+	Out->HalCycles = (Out->Runs != 0) ? (uint32_t) (HalTotal / Out->Runs) : 0;
+	Out->LlCycles = (Out->Runs != 0) ? (uint32_t) (LlTotal / Out->Runs) : 0;
+}
+
+//Private functions
+static bool I2cMaster_Take(I2C_HandleTypeDef *Handle)
+{
+	uint32_t Mask = __get_PRIMASK();
+	bool Taken = false;
+
+	__disable_irq();
+	//A bus parked from an ISR keeps a ready handle until I2cBus_task deinitialises it
+	if(Handle->State == HAL_I2C_STATE_READY && I2cBus_Ready(Handle))
+	{
+		Handle->State = HAL_I2C_STATE_BUSY;
+		Taken = true;
+	}
+	__set_PRIMASK(Mask);
+	return Taken;
+}
+
+static HAL_StatusTypeDef I2cMaster_Begin(I2cTransfer *Transfer, I2C_HandleTypeDef *Handle, uint8_t Address, uint32_t Timeout)
+{
+	Transfer->Handle = Handle;
+	Transfer->Regs = Handle->Instance;
+	Transfer->Address = Address & 0xFE;
+	Transfer->Start = DWT -> CYCCNT;
+	Transfer->Limit = Timeout * (SystemCoreClock / 1000000);
+	Transfer->Started = false;
+	Handle->ErrorCode = HAL_I2C_ERROR_NONE;
+	//A START asked for while the last STOP is pending gets lost
+	while((Transfer->Regs -> CR1 & I2C_CR1_STOP) || LL_I2C_IsActiveFlag_BUSY(Transfer->Regs))
+	{
+		if(DWT -> CYCCNT - Transfer->Start >= Transfer->Limit)
+		{
+			Handle->ErrorCode |= HAL_I2C_ERROR_TIMEOUT;
+			return HAL_BUSY;
+		}
+	}
+	LL_I2C_DisableBitPOS(Transfer->Regs);
+	LL_I2C_GenerateStartCondition(Transfer->Regs);
+	Transfer->Started = true;
+	if(!I2cMaster_Wait(Transfer, I2C_SR1_SB))
+		return HAL_ERROR;
+	LL_I2C_TransmitData8(Transfer->Regs, Address);
+	if(!I2cMaster_Wait(Transfer, I2C_SR1_ADDR))
+		return HAL_ERROR;
+	return HAL_OK;
+}
+
+//False on AF, ARLO, BERR or the timeout, the cause is left in the handle's error code
+static bool I2cMaster_Wait(I2cTransfer *Transfer, uint32_t Flag)
+{
+	I2C_TypeDef *Regs = Transfer->Regs;
+	uint32_t Status;
+
+	while(1)
+	{
+		Status = Regs -> SR1;
+		if(Status & Flag)
+			return true;
+		if(Status & (I2C_SR1_AF | I2C_SR1_ARLO | I2C_SR1_BERR))
+		{
+			if(Status & I2C_SR1_AF)
+			{
+				Transfer->Handle->ErrorCode |= HAL_I2C_ERROR_AF;
+				LL_I2C_ClearFlag_AF(Regs);
+			}
+			if(Status & I2C_SR1_ARLO)
+			{
+				Transfer->Handle->ErrorCode |= HAL_I2C_ERROR_ARLO;
+				LL_I2C_ClearFlag_ARLO(Regs);
+			}
+			if(Status & I2C_SR1_BERR)
+			{
+				Transfer->Handle->ErrorCode |= HAL_I2C_ERROR_BERR;
+				LL_I2C_ClearFlag_BERR(Regs);
+			}
+			return false;
+		}
+		if(DWT -> CYCCNT - Transfer->Start >= Transfer->Limit)
+		{
+			Transfer->Handle->ErrorCode |= HAL_I2C_ERROR_TIMEOUT;
+			return false;
+		}
+	}
+}
+
+static HAL_StatusTypeDef I2cMaster_End(I2cTransfer *Transfer, HAL_StatusTypeDef Result, uint16_t Length)
+{
+	I2cMasterStats *Stats = &I2cMasterInfo[(Transfer->Regs == I2C1) ? 0 : 1];
+	uint32_t Cycles = DWT -> CYCCNT - Transfer->Start;
+
+	//After an arbitration loss the bus isn't ours to stop
+	if(Result != HAL_OK && Transfer->Started && !(Transfer->Handle->ErrorCode & HAL_I2C_ERROR_ARLO))
+		LL_I2C_GenerateStopCondition(Transfer->Regs);
+	LL_I2C_DisableBitPOS(Transfer->Regs);
+	LL_I2C_AcknowledgeNextData(Transfer->Regs, LL_I2C_ACK);
+	if(Result == HAL_OK)
+	{
+		Stats->Transfers++;
+		Stats->Bytes += Length + 1;
+		Stats->Cycles += Cycles;
+		if(Cycles > Stats->MaxCycles)
+			Stats->MaxCycles = Cycles;
+	}
+	Transfer->Handle->State = HAL_I2C_STATE_READY;
+	//Refused before the START, nothing went on the wire
+	if(Transfer->Started)
+		I2cBus_Traffic(Transfer->Handle, Transfer->Address, 1, (Result == HAL_OK) ? Length + 1 : 0, Cycles);
+	return Result;
+}
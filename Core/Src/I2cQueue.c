@@ -0,0 +1,343 @@
+/**
+ *  I2C transaction queue
+ *  The queue is touched from the main loop and from the I2C interrupts,
+ *  the main loop side runs with the interrupts off. The running job stays
+ *  Pending until its last chunk, so a chunked job keeps its place among
+ *  the jobs of its priority.
+ */
+
+#include "I2cQueue.h"
+#include <string.h>
+
+I2cQueue I2cQueues[I2cBuses];
+
+static I2cQueue *I2cQueue_Get(I2C_HandleTypeDef *Handle);
+static I2cJob *I2cQueue_Next(I2cQueue *Queue);
+static uint16_t I2cQueue_ChunkSize(const I2cJob *Job);
+static HAL_StatusTypeDef I2cQueue_Start(I2cQueue *Queue, I2cJob *Job);
+static void I2cQueue_Dispatch(I2cQueue *Queue);
+static void I2cQueue_Finish(I2cQueue *Queue, HAL_StatusTypeDef Result);
+static void I2cQueue_Waited(I2cQueueStats *Stats, uint32_t Cycles);
+static uint32_t I2cQueue_WireBytes(const I2cJob *Job, uint16_t Size);
+
+void I2cQueue_Init(I2C_HandleTypeDef *Bus1, I2C_HandleTypeDef *Bus2)
+{
+	memset(I2cQueues, 0, sizeof(I2cQueues));
+	I2cQueues[0].Handle = Bus1;
+	I2cQueues[1].Handle = Bus2;
+	I2cQueues[0].WindowStart = HAL_GetTick();
+	I2cQueues[1].WindowStart = HAL_GetTick();
+}
+
+//False with the queue full, the job is copied
+bool I2cQueue_Submit(I2C_HandleTypeDef *Handle, const I2cJob *Job)
+{
+	I2cQueue *Queue = I2cQueue_Get(Handle);
+	I2cJob *Slot = NULL;
+	uint32_t Mask;
+
+	if(Job->Length == 0 || Job->Priority >= I2cPriorities)
+		return false;
+	Mask = __get_PRIMASK();
+	__disable_irq();
+	for(uint16_t Index = 0; Index < I2cQueueSize; Index++)
+	{
+		if(!Queue->Jobs[Index].Pending)
+		{
+			Slot = &Queue->Jobs[Index];
+			break;
+		}
+	}
+	if(Slot == NULL)
+	{
+		Queue->Dropped++;
+		__set_PRIMASK(Mask);
+		return false;
+	}
+	*Slot = *Job;
+	Slot->Sent = 0;
+	Slot->Sequence = Queue->Sequence++;
+	Slot->Submitted = DWT -> CYCCNT;
+	Slot->Pending = true;
+	Queue->Depth++;
+	if(Queue->Depth > Queue->MaxDepth)
+		Queue->MaxDepth = Queue->Depth;
+	Queue->Stats[Slot->Priority].Submitted++;
+	I2cQueue_Dispatch(Queue);
+	__set_PRIMASK(Mask);
+	return true;
+}
+
+//Waits for the chunk on the wire and keeps the queue stopped. False if the chunk never finished,
+//the queue goes on then and there's nothing to unlock
+bool I2cQueue_Lock(I2C_HandleTypeDef *Handle, I2cPriority Priority)
+{
+	I2cQueue *Queue = I2cQueue_Get(Handle);
+	uint32_t Start = DWT -> CYCCNT;
+	uint32_t Limit = I2cQueueLockWait * (SystemCoreClock / 1000000);
+
+	Queue->Locked = true;
+	while(Queue->Running != NULL)
+	{
+		if(DWT -> CYCCNT - Start >= Limit)
+		{
+			Queue->LockTimeouts++;
+			I2cQueue_Release(Handle);
+			return false;
+		}
+	}
+	Queue->LockPriority = Priority;
+	Queue->Stats[Priority].Submitted++;
+	I2cQueue_Waited(&Queue->Stats[Priority], DWT -> CYCCNT - Start);
+	return true;
+}
+
+//Bytes the blocking user moved while it had the bus
+void I2cQueue_Unlock(I2C_HandleTypeDef *Handle, uint32_t Bytes)
+{
+	I2cQueue *Queue = I2cQueue_Get(Handle);
+	I2cQueueStats *Stats = &Queue->Stats[Queue->LockPriority];
+	uint32_t Mask;
+
+	Mask = __get_PRIMASK();
+	__disable_irq();
+	Stats->Completed++;
+	Stats->Bytes += Bytes;
+	Queue->WindowBytes += Bytes;
+	Queue->WindowTransactions++;
+	Queue->Locked = false;
+	I2cQueue_Dispatch(Queue);
+	__set_PRIMASK(Mask);
+}
+
+//False with a chunk on the wire or the queue locked, nothing is counted
+bool I2cQueue_Hold(I2C_HandleTypeDef *Handle)
+{
+	I2cQueue *Queue = I2cQueue_Get(Handle);
+	uint32_t Mask;
+	bool Free;
+
+	Mask = __get_PRIMASK();
+	__disable_irq();
+	Free = (Queue->Running == NULL && !Queue->Locked);
+	if(Free)
+		Queue->Locked = true;
+	__set_PRIMASK(Mask);
+	return Free;
+}
+
+void I2cQueue_Release(I2C_HandleTypeDef *Handle)
+{
+	I2cQueue *Queue = I2cQueue_Get(Handle);
+	uint32_t Mask;
+
+	Mask = __get_PRIMASK();
+	__disable_irq();
+	Queue->Locked = false;
+	I2cQueue_Dispatch(Queue);
+	__set_PRIMASK(Mask);
+}
+
+bool I2cQueue_Idle(I2C_HandleTypeDef *Handle)
+{
+	I2cQueue *Queue = I2cQueue_Get(Handle);
+
+	return Queue->Depth == 0 && Queue->Running == NULL;
+}
+
+//Per second, updated once a 1s window is complete
+void I2cQueue_Throughput(I2C_HandleTypeDef *Handle, uint32_t *Bytes, uint32_t *Transactions)
+{
+	I2cQueue *Queue = I2cQueue_Get(Handle);
+	uint32_t Elapsed = HAL_GetTick() - Queue->WindowStart;
+	uint32_t Mask;
+
+	if(Elapsed >= 1000)
+	{
+		Mask = __get_PRIMASK();
+		__disable_irq();
+		Queue->BytesPerSecond = (uint32_t) (((uint64_t) Queue->WindowBytes * 1000) / Elapsed);
+		Queue->TransactionsPerSecond = (uint32_t) (((uint64_t) Queue->WindowTransactions * 1000) / Elapsed);
+		Queue->WindowBytes = 0;
+		Queue->WindowTransactions = 0;
+		Queue->WindowStart += Elapsed;
+		__set_PRIMASK(Mask);
+	}
+	*Bytes = Queue->BytesPerSecond;
+	*Transactions = Queue->TransactionsPerSecond;
+}
+
+//Main loop, fails a job whose interrupt never came and restarts the queue after a bus recovery
+void I2cQueue_task(void)
+{
+	I2cQueue *Queue;
+	uint32_t Mask;
+
+	for(uint16_t Index = 0; Index < I2cBuses; Index++)
+	{
+		Queue = &I2cQueues[Index];
+		if(Queue->Handle == NULL)
+			continue;
+		Mask = __get_PRIMASK();
+		__disable_irq();
+		if(Queue->Running != NULL && HAL_GetTick() - Queue->RunningSince > I2cTimeout)
+		{
+			//I2cBus parks the bus, which also aborts the transfer
+			Queue->Handle->ErrorCode |= HAL_I2C_ERROR_TIMEOUT;
+			I2cBus_Report(Queue->Handle, Queue->Running->Address, HAL_ERROR);
+			I2cQueue_Finish(Queue, HAL_TIMEOUT);
+		}
+		I2cQueue_Dispatch(Queue);
+		__set_PRIMASK(Mask);
+	}
+}
+
+//ISR Handlers
+//From the HAL completion and error callbacks
+void I2cQueue_DoneISR(I2C_HandleTypeDef *Handle, HAL_StatusTypeDef Result)
+{
+	I2cQueue *Queue = I2cQueue_Get(Handle);
+	I2cJob *Job = Queue->Running;
+	uint16_t Size;
+
+	if(Job == NULL)
+		return;
+	Size = I2cQueue_ChunkSize(Job);
+	I2cBus_Traffic(Handle, Job->Address, 1, (Result == HAL_OK) ? I2cQueue_WireBytes(Job, Size) : 0, DWT -> CYCCNT - Queue->ChunkStart);
+	if(Result == HAL_OK)
+	{
+		I2cBus_Report(Handle, Job->Address, HAL_OK);
+		Job->Sent += Size;
+		Queue->Stats[Job->Priority].Bytes += Size;
+		Queue->WindowBytes += Size;
+		Queue->WindowTransactions++;
+		if(Job->Sent < Job->Length)
+		{
+			//Back to the queue, anything more urgent goes first
+			Queue->Running = NULL;
+			I2cQueue_Dispatch(Queue);
+			return;
+		}
+	}
+	I2cQueue_Finish(Queue, Result);
+	I2cQueue_Dispatch(Queue);
+}
+
+//Private functions
+static I2cQueue *I2cQueue_Get(I2C_HandleTypeDef *Handle)
+{
+	return (Handle->Instance == I2C1) ? &I2cQueues[0] : &I2cQueues[1];
+}
+
+//Highest priority, then the oldest
+static I2cJob *I2cQueue_Next(I2cQueue *Queue)
+{
+	I2cJob *Best = NULL, *Job;
+
+	for(uint16_t Index = 0; Index < I2cQueueSize; Index++)
+	{
+		Job = &Queue->Jobs[Index];
+		if(!Job->Pending)
+			continue;
+		if(Best == NULL || Job->Priority < Best->Priority ||
+		   (Job->Priority == Best->Priority && (int32_t) (Job->Sequence - Best->Sequence) < 0))
+			Best = Job;
+	}
+	return Best;
+}
+
+//Only the register jobs can be split, the address moves with the data
+static uint16_t I2cQueue_ChunkSize(const I2cJob *Job)
+{
+	uint16_t Size = Job->Length - Job->Sent;
+
+	if(Job->Chunk && Size > Job->Chunk && (Job->Type == I2cJob_MemWrite || Job->Type == I2cJob_MemRead))
+		Size = Job->Chunk;
+	return Size;
+}
+
+static HAL_StatusTypeDef I2cQueue_Start(I2cQueue *Queue, I2cJob *Job)
+{
+	uint16_t Size = I2cQueue_ChunkSize(Job);
+
+	switch(Job->Type)
+	{
+		case I2cJob_Write:
+			return HAL_I2C_Master_Transmit_IT(Queue->Handle, Job->Address, Job->Data, Size);
+		case I2cJob_Read:
+			return HAL_I2C_Master_Receive_IT(Queue->Handle, Job->Address, Job->Data, Size);
+		case I2cJob_MemWrite:
+			return HAL_I2C_Mem_Write_IT(Queue->Handle, Job->Address, Job->Register + Job->Sent, Job->RegisterSize, Job->Data + Job->Sent, Size);
+		case I2cJob_MemRead:
+			return HAL_I2C_Mem_Read_IT(Queue->Handle, Job->Address, Job->Register + Job->Sent, Job->RegisterSize, Job->Data + Job->Sent, Size);
+		default:
+			return HAL_ERROR;
+	}
+}
+
+//Interrupts off or from the completion interrupt
+static void I2cQueue_Dispatch(I2cQueue *Queue)
+{
+	I2cJob *Next;
+	HAL_StatusTypeDef Result;
+
+	while(Queue->Running == NULL && !Queue->Locked && I2cBus_Ready(Queue->Handle))
+	{
+		Next = I2cQueue_Next(Queue);
+		if(Next == NULL)
+			return;
+		if(Next->Sent == 0)
+			I2cQueue_Waited(&Queue->Stats[Next->Priority], DWT -> CYCCNT - Next->Submitted);
+		Queue->Running = Next;
+		Queue->RunningSince = HAL_GetTick();
+		Queue->ChunkStart = DWT -> CYCCNT;
+		Result = I2cQueue_Start(Queue, Next);
+		if(Result == HAL_OK)
+			return;
+		//Refused before anything went on the wire
+		I2cBus_Report(Queue->Handle, Next->Address, Result);
+		I2cQueue_Finish(Queue, Result);
+	}
+}
+
+static void I2cQueue_Finish(I2cQueue *Queue, HAL_StatusTypeDef Result)
+{
+	I2cJob *Job = Queue->Running;
+
+	Queue->Running = NULL;
+	if(Result == HAL_OK)
+		Queue->Stats[Job->Priority].Completed++;
+	else
+		Queue->Stats[Job->Priority].Failed++;
+	//The slot is released after Done, a job submitted from it gets another one
+	if(Job->Done != NULL)
+		Job->Done(Job, Result);
+	Job->Pending = false;
+	Queue->Depth--;
+}
+
+static void I2cQueue_Waited(I2cQueueStats *Stats, uint32_t Cycles)
+{
+	uint32_t Micros = Cycles / (SystemCoreClock / 1000000);
+
+	Stats->Started++;
+	Stats->WaitTotal += Micros;
+	if(Micros > Stats->WaitMax)
+		Stats->WaitMax = Micros;
+}
+
+//Data plus the address, and for the register jobs the register and the address again on reads
+static uint32_t I2cQueue_WireBytes(const I2cJob *Job, uint16_t Size)
+{
+	switch(Job->Type)
+	{
+		case I2cJob_MemWrite:
+			return Size + 1 + Job->RegisterSize;
+		case I2cJob_MemRead:
+			return Size + 2 + Job->RegisterSize;
+		case I2cJob_Write:
+		case I2cJob_Read:
+		default:
+			return Size + 1;
+	}
+}
@@ -0,0 +1,133 @@
+/**
+ *  Log record codec
+ *  The deltas are taken modulo 2^32, a decoder adding them back gets the
+ *  same values even when one wraps.
+ */
+
+#include "LogCodec.h"
+
+static uint16_t LogCodec_Varint(uint8_t *Out, uint32_t Value);
+static bool LogCodec_ReadVarint(LogDecoder *Decoder, uint32_t *Value);
+static uint32_t LogCodec_Zigzag(int32_t Value);
+static int32_t LogCodec_Unzigzag(uint32_t Value);
+
+void LogCodec_Start(LogEncoder *Encoder, uint8_t *Data, uint16_t Size, uint16_t Step)
+{
+	Encoder->Data = Data;
+	Encoder->Size = Size;
+	Encoder->Used = 0;
+	Encoder->Count = 0;
+	Encoder->Step = Step;
+	Encoder->LastTime = 0;
+	Encoder->LastLux = 0;
+}
+
+//False if the record doesn't fit, the buffer is left as it was
+bool LogCodec_Put(LogEncoder *Encoder, uint32_t Time, uint32_t Lux)
+{
+	uint8_t Record[LogCodecMaxRecord];
+	uint16_t Length;
+	uint32_t Late;
+
+	if(Encoder->Count == 0)
+	{
+		Length = LogCodec_Varint(Record, Time);
+		Length += LogCodec_Varint(&Record[Length], Lux);
+	}
+	else
+	{
+		Late = LogCodec_Zigzag((int32_t) (Time - Encoder->LastTime - Encoder->Step));
+		Length = LogCodec_Varint(Record, (LogCodec_Zigzag((int32_t) (Lux - Encoder->LastLux)) << 1) | (Late != 0));
+		if(Late)
+			Length += LogCodec_Varint(&Record[Length], Late);
+	}
+	if(Encoder->Used + Length > Encoder->Size)
+		return false;
+	for(uint16_t Index = 0; Index < Length; Index++)
+		Encoder->Data[Encoder->Used++] = Record[Index];
+	Encoder->Count++;
+	Encoder->LastTime = Time;
+	Encoder->LastLux = Lux;
+	return true;
+}
+
+void LogCodec_Open(LogDecoder *Decoder, const uint8_t *Data, uint16_t Size, uint16_t Count, uint16_t Step)
+{
+	Decoder->Data = Data;
+	Decoder->Size = Size;
+	Decoder->Read = 0;
+	Decoder->Left = Count;
+	Decoder->Count = 0;
+	Decoder->Step = Step;
+	Decoder->LastTime = 0;
+	Decoder->LastLux = 0;
+}
+
+//False after the last record or on a truncated buffer
+bool LogCodec_Get(LogDecoder *Decoder, uint32_t *Time, uint32_t *Lux)
+{
+	uint32_t First, Late = 0;
+
+	if(Decoder->Left == 0 || !LogCodec_ReadVarint(Decoder, &First))
+		return false;
+	if(Decoder->Count == 0)
+	{
+		if(!LogCodec_ReadVarint(Decoder, &Late))
+			return false;
+		Decoder->LastTime = First;
+		Decoder->LastLux = Late;
+	}
+	else
+	{
+		if((First & 1) && !LogCodec_ReadVarint(Decoder, &Late))
+			return false;
+		Decoder->LastTime += Decoder->Step + (uint32_t) LogCodec_Unzigzag(Late);
+		Decoder->LastLux += (uint32_t) LogCodec_Unzigzag(First >> 1);
+	}
+	Decoder->Count++;
+	Decoder->Left--;
+	*Time = Decoder->LastTime;
+	*Lux = Decoder->LastLux;
+	return true;
+}
+
+//Private functions
+static uint16_t LogCodec_Varint(uint8_t *Out, uint32_t Value)
+{
+	uint16_t Length = 0;
+
+	while(Value >= 0x80)
+	{
+		Out[Length++] = (uint8_t) (Value | 0x80);
+		Value >>= 7;
+	}
+	Out[Length++] = (uint8_t) Value;
+	return Length;
+}
+
+static bool LogCodec_ReadVarint(LogDecoder *Decoder, uint32_t *Value)
+{
+	uint8_t Byte;
+
+	*Value = 0;
+	for(uint16_t Shift = 0; Shift < 35; Shift += 7)
+	{
+		if(Decoder->Read >= Decoder->Size)
+			return false;
+		Byte = Decoder->Data[Decoder->Read++];
+		*Value |= (uint32_t) (Byte & 0x7F) << Shift;
+		if(!(Byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static uint32_t LogCodec_Zigzag(int32_t Value)
+{
+	return ((uint32_t) Value << 1) ^ (uint32_t) (Value >> 31);
+}
+
+static int32_t LogCodec_Unzigzag(uint32_t Value)
+{
+	return (int32_t) (Value >> 1) ^ -(int32_t) (Value & 1);
+}
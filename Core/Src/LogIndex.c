@@ -0,0 +1,68 @@
+/**
+ *  Log range index
+ *  Updating a leaf merges again its ancestors, log2(Leaves) nodes.
+ */
+
+#include "LogIndex.h"
+
+void LogIndex_Clear(LogRange *Tree, uint16_t Leaves)
+{
+	for(uint16_t Node = 1; Node < 2 * Leaves; Node++)
+		LogIndex_Empty(&Tree[Node]);
+}
+
+void LogIndex_Set(LogRange *Tree, uint16_t Leaves, uint16_t Leaf, const LogRange *Value)
+{
+	uint16_t Node = Leaves + Leaf;
+
+	Tree[Node] = *Value;
+	for(Node /= 2; Node >= 1; Node /= 2)
+	{
+		Tree[Node] = Tree[2 * Node];
+		LogIndex_Merge(&Tree[Node], &Tree[2 * Node + 1]);
+	}
+}
+
+//Leaves First..Last merged into Range
+void LogIndex_Query(const LogRange *Tree, uint16_t Leaves, uint16_t First, uint16_t Last, LogRange *Range)
+{
+	uint16_t Low = First + Leaves, High = Last + Leaves + 1;
+
+	for(; Low < High; Low /= 2, High /= 2)
+	{
+		if(Low & 1)
+			LogIndex_Merge(Range, &Tree[Low++]);
+		if(High & 1)
+			LogIndex_Merge(Range, &Tree[--High]);
+	}
+}
+
+void LogIndex_Empty(LogRange *Range)
+{
+	Range->Min = UINT32_MAX;
+	Range->Max = 0;
+	Range->Count = 0;
+	Range->Sum = 0;
+}
+
+void LogIndex_Merge(LogRange *Into, const LogRange *From)
+{
+	if(From->Count == 0)
+		return;
+	if(From->Min < Into->Min)
+		Into->Min = From->Min;
+	if(From->Max > Into->Max)
+		Into->Max = From->Max;
+	Into->Count += From->Count;
+	Into->Sum += From->Sum;
+}
+
+void LogIndex_Add(LogRange *Into, uint32_t Lux)
+{
+	if(Lux < Into->Min)
+		Into->Min = Lux;
+	if(Lux > Into->Max)
+		Into->Max = Lux;
+	Into->Count++;
+	Into->Sum += Lux;
+}
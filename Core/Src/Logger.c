@@ -0,0 +1,467 @@
+/**
+ *  Measurement log on the EEPROM
+ *  Recovery: the index needs every block read anyway, the same pass finds
+ *  the head. The newest valid block is the head, the log is the run of
+ *  blocks before it whose sequences go down by one. It stops at a blank
+ *  block, the block cut while being written (only Head + 1 can be) or the
+ *  previous lap.
+ *  Summaries: a record waits for the next one before going into the
+ *  summary, so the record the next block starts with (the one the
+ *  deadband stores late) goes into that block and the summary of a block
+ *  has the records from its start to the start of the next one.
+ */
+
+#include "Logger.h"
+#include "EepromCache.h"
+#include "ConfigImage.h"
+#include "I2cQueue.h"
+#include <string.h>
+#include <stddef.h>
+
+#define PagesPerBlock (LogBlockSize / EepromPageSize)
+#define LogStep (LogPeriod / 100)
+
+static bool Logger_ReadBlock(Logger *Log, uint16_t Index, LogBlock *Block);
+static uint16_t Logger_Crc(const LogBlock *Block);
+static void Logger_Store(Logger *Log, uint32_t Now, uint32_t Lux);
+static bool Logger_Put(Logger *Log, uint32_t Time, uint32_t Lux);
+static void Logger_Seal(Logger *Log, uint32_t Next);
+static void Logger_Begin(Logger *Log);
+static void Logger_Leaf(Logger *Log, uint16_t Index, const LogBlock *Block);
+static uint16_t Logger_Age(Logger *Log, uint32_t Time);
+static uint32_t Logger_End(Logger *Log, uint16_t Age);
+static void Logger_Blocks(Logger *Log, uint16_t Newest, uint16_t Oldest, LogRange *Range);
+static void Logger_Records(Logger *Log, uint16_t Age, uint32_t From, uint32_t To, LogRange *Range);
+static void Logger_Line(uint32_t Time0, uint32_t Lux0, uint32_t Time1, uint32_t Lux1, uint16_t Records,
+		uint32_t From, uint32_t To, LogRange *Range);
+static uint32_t Logger_First(const LogBlock *Block, uint16_t Count, uint16_t Step);
+
+//Blocking, from the boot. Reads each block once
+void Logger_Init(Logger *Log, I2C_HandleTypeDef *Handle, uint16_t Address)
+{
+	LogBlock Block;
+	LogDecoder Decoder;
+	LogRange Empty;
+	uint32_t Sequences[LogBlocks], End = 0, Time, Lux;
+	bool Valid[LogBlocks], Found = false;
+	uint16_t Index;
+
+	memset(Log, 0, sizeof(Logger));
+	Log->Handle = Handle;
+	Log->Address = Address;
+	Log->Head = LogBlocks - 1; //An empty log starts on block 0
+	LogIndex_Clear(Log->Index, LogBlocks);
+	for(Index = 0; Index < LogBlocks; Index++)
+	{
+		Valid[Index] = Logger_ReadBlock(Log, Index, &Block);
+		if(!Valid[Index])
+			continue;
+		Sequences[Index] = Block.Sequence;
+		Logger_Leaf(Log, Index, &Block);
+		if(Found && (int32_t) (Block.Sequence - Sequences[Log->Head]) <= 0)
+			continue;
+		//Newest so far, the log clock goes on from the end of its last record
+		Found = true;
+		Log->Head = Index;
+		End = Block.Start;
+		Logger_Open(&Block, &Decoder);
+		while(LogCodec_Get(&Decoder, &Time, &Lux))
+			End = Block.Start + Time * 100 + LogPeriod;
+	}
+	if(Found)
+	{
+		Log->Sequence = Sequences[Log->Head] + 1;
+		Log->Count = 1;
+		while(Log->Count < LogBlocks)
+		{
+			Index = (Log->Head + LogBlocks - Log->Count) % LogBlocks;
+			if(!Valid[Index] || Sequences[Index] != Log->Sequence - 1 - Log->Count)
+				break;
+			Log->Count++;
+		}
+	}
+	Log->Next = (Log->Head + 1) % LogBlocks;
+	//The leaves of the blocks out of the log (the previous lap) stay empty
+	LogIndex_Empty(&Empty);
+	for(uint16_t Age = Log->Count; Age < LogBlocks; Age++)
+		LogIndex_Set(Log->Index, LogBlocks, (Log->Head + LogBlocks - Age) % LogBlocks, &Empty);
+	Log->Offset = End - HAL_GetTick();
+	Log->PeriodStart = Logger_Now(Log);
+	SwingDoor_Init(&Log->Door, 0);
+	LogIndex_Empty(&Log->Summary);
+	Logger_Begin(Log);
+	Log->Ready = true;
+}
+
+//From the sample readers of the main loop. The records take the time of their samples,
+//a backlog in the FIFO doesn't move them
+void Logger_Add(Logger *Log, const Sample *New)
+{
+	uint32_t Now, Time, Lux, Stored;
+	float Mean;
+
+	if(!Log->Ready)
+		return;
+	Now = Logger_Now(Log) - (Acquisition_Micros() - New->Timestamp) / 1000;
+	Log->Sum += New->Lux;
+	Log->Samples++;
+	if((int32_t) (Now - Log->PeriodStart) < LogPeriod)
+		return;
+	Mean = Log->Sum / Log->Samples * 10;
+	Lux = (Mean > LogCodecMaxLux) ? LogCodecMaxLux : (uint32_t) (Mean + 0.5f);
+	Log->Sum = 0;
+	Log->Samples = 0;
+	Log->PeriodStart = Now;
+	Log->Encoded++;
+	if(SwingDoor_Add(&Log->Door, Now, Lux, &Time, &Stored))
+		Logger_Store(Log, Time, Stored);
+	if(Log->Waiting)
+		LogIndex_Add(&Log->Summary, Log->WaitingLux);
+	Log->Waiting = true;
+	Log->WaitingTime = Now;
+	Log->WaitingLux = Lux;
+}
+
+//0.1lx, 0 logs every record. The segment in course ends with the old one
+void Logger_Deadband(Logger *Log, uint16_t Deadband)
+{
+	uint32_t Time, Lux;
+
+	if(!Log->Ready || Deadband == Log->Door.Deadband)
+		return;
+	if(SwingDoor_Flush(&Log->Door, &Time, &Lux))
+		Logger_Store(Log, Time, Lux);
+	SwingDoor_Init(&Log->Door, Deadband);
+}
+
+//ms, the clock of the log times
+uint32_t Logger_Now(Logger *Log)
+{
+	return Log->Offset + HAL_GetTick();
+}
+
+//Log clock the EEPROM blocks cover, from the start of the oldest one to now. 0 without blocks
+uint32_t Logger_Span(Logger *Log)
+{
+	if(!Log->Ready || Log->Count == 0)
+		return 0;
+	return Logger_Now(Log) - Log->Starts[(Log->Head + LogBlocks + 1 - Log->Count) % LogBlocks];
+}
+
+//Minimum, maximum, count and sum of the records of the EEPROM from From to To (log clock, To excluded).
+//Two block reads at most, blocking, from the main loop. False without records there
+bool Logger_Range(Logger *Log, uint32_t From, uint32_t To, LogRange *Range)
+{
+	uint16_t Newest, Oldest;
+
+	LogIndex_Empty(Range);
+	if(!Log->Ready || Log->Count == 0 || From >= To)
+		return false;
+	Newest = Logger_Age(Log, To - 1);
+	if(Newest == Log->Count)
+		return false;
+	Oldest = Logger_Age(Log, From);
+	if(Oldest == Log->Count)
+		Oldest = Log->Count - 1;
+	//Only the blocks on the edges can be partly in the window
+	if(Log->Starts[(Log->Head + LogBlocks - Oldest) % LogBlocks] < From)
+	{
+		Logger_Records(Log, Oldest, From, To, Range);
+		if(Oldest == Newest)
+			return Range->Count != 0;
+		Oldest--;
+	}
+	if(Logger_End(Log, Newest) > To)
+	{
+		Logger_Records(Log, Newest, From, To, Range);
+		if(Oldest == Newest)
+			return Range->Count != 0;
+		Newest++;
+	}
+	if(Newest <= Oldest)
+		Logger_Blocks(Log, Newest, Oldest, Range);
+	return Range->Count != 0;
+}
+
+//Age 0 is the newest block in the EEPROM. Blocking, from the main loop
+bool Logger_Read(Logger *Log, uint16_t Age, LogBlock *Block)
+{
+	if(!Log->Ready || Age >= Log->Count)
+		return false;
+	return Logger_ReadBlock(Log, (Log->Head + LogBlocks - Age) % LogBlocks, Block);
+}
+
+//The records of a block, LogCodec_Get gives them in order
+void Logger_Open(const LogBlock *Block, LogDecoder *Decoder)
+{
+	LogCodec_Open(Decoder, Block->Data, LogDataSize, Block->Count, Block->Step);
+}
+
+//Main loop, a page at a time while the EEPROM cache is free
+void Logger_task(Logger *Log)
+{
+	uint16_t Register;
+
+	if(!Log->Ready || !Log->Pending)
+		return;
+	if(Log->Submitted)
+	{
+		if(ConfigCache.PagesWritten != Log->PagesBefore)
+		{
+			Log->Page++;
+			Log->Submitted = false;
+		}
+		else if(ConfigCache.State == Eeprom_Idle)
+		{
+			//Gone without being written, again
+			Log->Submitted = false;
+			Log->Retries++;
+		}
+		else
+			return;
+	}
+	if(Log->Page == PagesPerBlock)
+	{
+		Log->Head = Log->Next;
+		Log->Next = (Log->Next + 1) % LogBlocks;
+		if(Log->Count < LogBlocks)
+			Log->Count++;
+		Logger_Leaf(Log, Log->Head, &Log->Flushing);
+		Log->Blocks++;
+		Log->Pending = false;
+		return;
+	}
+	Register = LogStart + Log->Next * LogBlockSize + Log->Page * EepromPageSize;
+	Log->PagesBefore = ConfigCache.PagesWritten;
+	if(EepromCache_WritePage(Register, (const uint8_t *) &Log->Flushing + Log->Page * EepromPageSize, EepromPageSize))
+		Log->Submitted = true;
+}
+
+//Private functions
+//False if it couldn't be read, is blank or its CRC doesn't match
+static bool Logger_ReadBlock(Logger *Log, uint16_t Index, LogBlock *Block)
+{
+	HAL_StatusTypeDef Result;
+
+	Log->Reads++;
+	I2cQueue_Lock(Log->Handle, I2cPrio_Storage);
+	Result = I2cBus_Report(Log->Handle, Log->Address, HAL_I2C_Mem_Read(Log->Handle, Log->Address, LogStart + Index * LogBlockSize,
+			EepromAddressSize, (uint8_t *) Block, sizeof(LogBlock), I2cTimeout));
+	I2cQueue_Unlock(Log->Handle, sizeof(LogBlock) + 3);
+	return Result == HAL_OK && Block->Count <= LogMaxRecords && Block->Crc == Logger_Crc(Block);
+}
+
+static uint16_t Logger_Crc(const LogBlock *Block)
+{
+	return (uint16_t) ConfigImage_Crc((const uint8_t *) Block, offsetof(LogBlock, Crc));
+}
+
+//Into the filling block, times in ms since the boot
+static void Logger_Store(Logger *Log, uint32_t Now, uint32_t Lux)
+{
+	if(Log->Encoder.Count == 0)
+		Log->Filling.Start = Now;
+	if(!Logger_Put(Log, (Now - Log->Filling.Start) / 100, Lux))
+	{
+		//Full, the record is the keyframe of the next block
+		Logger_Seal(Log, Now);
+		Log->Filling.Start = Now;
+		Logger_Put(Log, 0, Lux);
+	}
+}
+
+//LogCodec_Put timed alone, the deadband and the block writes out of the cycles
+static bool Logger_Put(Logger *Log, uint32_t Time, uint32_t Lux)
+{
+	uint32_t Start = DWT -> CYCCNT, Cycles;
+	bool Fits;
+
+	Fits = LogCodec_Put(&Log->Encoder, Time, Lux);
+	Cycles = DWT -> CYCCNT - Start;
+	Log->Puts++;
+	Log->EncodeCycles += Cycles;
+	if(Cycles > Log->MaxEncodeCycles)
+		Log->MaxEncodeCycles = Cycles;
+	return Fits;
+}
+
+//The filling block goes to the EEPROM, the next one starts empty at Next
+static void Logger_Seal(Logger *Log, uint32_t Next)
+{
+	if(Log->Waiting && Log->WaitingTime < Next)
+	{
+		LogIndex_Add(&Log->Summary, Log->WaitingLux);
+		Log->Waiting = false;
+	}
+	Log->Filling.Summary.Min = (Log->Summary.Count == 0) ? 0 : (uint16_t) (Log->Summary.Min / 10);
+	Log->Filling.Summary.Max = (Log->Summary.Max >= 655350) ? 65535 : (uint16_t) ((Log->Summary.Max + 9) / 10);
+	Log->Filling.Summary.Count = (uint16_t) Log->Summary.Count;
+	Log->Filling.Summary.Sum = (Log->Summary.Sum > UINT32_MAX) ? UINT32_MAX : (uint32_t) Log->Summary.Sum;
+	LogIndex_Empty(&Log->Summary);
+	Log->Filling.Sequence = Log->Sequence++;
+	Log->Filling.Count = (uint8_t) Log->Encoder.Count;
+	Log->Filling.Step = LogStep;
+	Log->EncodedBytes += Log->Encoder.Used;
+	Log->Filling.Crc = Logger_Crc(&Log->Filling);
+	if(Log->Pending)
+		Log->Overruns++;
+	else
+	{
+		Log->Flushing = Log->Filling;
+		Log->Pending = true;
+		Log->Page = 0;
+		Log->Submitted = false;
+	}
+	Logger_Begin(Log);
+}
+
+//Empty block, it starts with its first record. The unused bytes stay as the blank EEPROM
+static void Logger_Begin(Logger *Log)
+{
+	memset(&Log->Filling, 0xFF, sizeof(LogBlock));
+	LogCodec_Start(&Log->Encoder, Log->Filling.Data, LogDataSize, LogStep);
+}
+
+//The summary of the block at Index into its leaf
+static void Logger_Leaf(Logger *Log, uint16_t Index, const LogBlock *Block)
+{
+	LogRange Leaf;
+
+	LogIndex_Empty(&Leaf);
+	if(Block->Summary.Count)
+	{
+		Leaf.Min = Block->Summary.Min * 10;
+		Leaf.Max = Block->Summary.Max * 10;
+		Leaf.Count = Block->Summary.Count;
+		Leaf.Sum = Block->Summary.Sum;
+	}
+	LogIndex_Set(Log->Index, LogBlocks, Index, &Leaf);
+	Log->Starts[Index] = Block->Start;
+	Log->Firsts[Index] = Logger_First(Block, Block->Count, Block->Step);
+}
+
+//Of the block with Time, Log->Count if it's older than the log. Binary search, the starts fall with the age
+static uint16_t Logger_Age(Logger *Log, uint32_t Time)
+{
+	uint16_t Low = 0, High = Log->Count, Middle;
+
+	while(Low < High)
+	{
+		Middle = (Low + High) / 2;
+		if(Log->Starts[(Log->Head + LogBlocks - Middle) % LogBlocks] <= Time)
+			High = Middle;
+		else
+			Low = Middle + 1;
+	}
+	return Low;
+}
+
+//Start of the next block, the newest one goes up to now
+static uint32_t Logger_End(Logger *Log, uint16_t Age)
+{
+	if(Age == 0)
+		return Logger_Now(Log);
+	return Log->Starts[(Log->Head + LogBlocks + 1 - Age) % LogBlocks];
+}
+
+//Ages Newest..Oldest from the index, a run of leaves or two when it wraps around the ring
+static void Logger_Blocks(Logger *Log, uint16_t Newest, uint16_t Oldest, LogRange *Range)
+{
+	uint16_t First = (Log->Head + LogBlocks - Oldest) % LogBlocks;
+	uint16_t Last = (Log->Head + LogBlocks - Newest) % LogBlocks;
+
+	if(First <= Last)
+		LogIndex_Query(Log->Index, LogBlocks, First, Last, Range);
+	else
+	{
+		LogIndex_Query(Log->Index, LogBlocks, First, LogBlocks - 1, Range);
+		LogIndex_Query(Log->Index, LogBlocks, 0, Last, Range);
+	}
+}
+
+//The records of the block of Age from From to To. With a deadband the block only has the ends of the
+//segments, the records are put back on the lines between them a LogPeriod apart, as many in the
+//block as its summary has, so the edges count the same records as the blocks of the index
+static void Logger_Records(Logger *Log, uint16_t Age, uint32_t From, uint32_t To, LogRange *Range)
+{
+	LogBlock Block;
+	LogDecoder Decoder;
+	uint32_t Time, Lux, LastTime, LastLux, NextTime, NextLux;
+	uint32_t Records;
+	uint16_t Left, Index;
+	bool Next;
+
+	if(!Logger_Read(Log, Age, &Block))
+		return;
+	Logger_Open(&Block, &Decoder);
+	if(!LogCodec_Get(&Decoder, &LastTime, &LastLux))
+		return;
+	LastTime = Block.Start + LastTime * 100;
+	Left = (Block.Summary.Count > Block.Count) ? Block.Summary.Count : Block.Count;
+	while(LogCodec_Get(&Decoder, &Time, &Lux))
+	{
+		Time = Block.Start + Time * 100;
+		//Rounded, the records are a bit more than a LogPeriod apart. The last line takes what's left
+		//and each point still to come has one at least
+		Records = (Time - LastTime + LogPeriod / 2) / LogPeriod;
+		if(Records + Decoder.Left + 1 > Left)
+			Records = Left - Decoder.Left - 1;
+		if(Records == 0)
+			Records = 1;
+		Logger_Line(LastTime, LastLux, Time, Lux, Records, From, To, Range);
+		Left -= Records;
+		LastTime = Time;
+		LastLux = Lux;
+	}
+	//The last line goes to the first record of the next block, in the EEPROM or still in the RAM
+	if(Age > 0)
+	{
+		Index = (Log->Head + LogBlocks + 1 - Age) % LogBlocks;
+		Next = true;
+		NextTime = Log->Starts[Index];
+		NextLux = Log->Firsts[Index];
+	}
+	else if(Log->Pending)
+	{
+		Next = true;
+		NextTime = Log->Flushing.Start;
+		NextLux = Logger_First(&Log->Flushing, Log->Flushing.Count, LogStep);
+	}
+	else
+	{
+		Next = Log->Encoder.Count != 0;
+		NextTime = Log->Filling.Start;
+		NextLux = Logger_First(&Log->Filling, Log->Encoder.Count, LogStep);
+	}
+	if(!Next)
+	{
+		//Nothing after it yet, level
+		NextTime = LastTime + Left * LogPeriod;
+		NextLux = LastLux;
+	}
+	Logger_Line(LastTime, LastLux, NextTime, NextLux, Left, From, To, Range);
+}
+
+//Records evenly from Time0 (included) to Time1 on the line between the two points
+static void Logger_Line(uint32_t Time0, uint32_t Lux0, uint32_t Time1, uint32_t Lux1, uint16_t Records,
+		uint32_t From, uint32_t To, LogRange *Range)
+{
+	uint32_t Time;
+
+	for(uint16_t Record = 0; Record < Records; Record++)
+	{
+		Time = Time0 + (uint32_t) ((uint64_t) (Time1 - Time0) * Record / Records);
+		if(Time >= From && Time < To)
+			LogIndex_Add(Range, (uint32_t) ((int32_t) Lux0 + ((int32_t) Lux1 - (int32_t) Lux0) * Record / Records));
+	}
+}
+
+//Lux of the first record of a block, 0 if it's empty
+static uint32_t Logger_First(const LogBlock *Block, uint16_t Count, uint16_t Step)
+{
+	LogDecoder Decoder;
+	uint32_t Time, Lux;
+
+	LogCodec_Open(&Decoder, Block->Data, LogDataSize, Count, Step);
+	return LogCodec_Get(&Decoder, &Time, &Lux) ? Lux : 0;
+}
@@ -0,0 +1,109 @@
+/**
+ *  Streaming percentile estimator
+ *  The first 9 samples are kept sorted in the marker heights, after that
+ *  the inner markers are moved towards their desired positions with the
+ *  piecewise parabolic (P2) prediction.
+ */
+
+#include "Percentile.h"
+
+static const float MarkerProbability[PercentileMarkers] = {0.0f, 0.025f, 0.05f, 0.275f, 0.5f, 0.725f, 0.95f, 0.975f, 1.0f};
+
+static float Percentile_Parabolic(const Percentile *Estimator, uint16_t i, int32_t Sign);
+static float Percentile_Linear(const Percentile *Estimator, uint16_t i, int32_t Sign);
+
+void Percentile_Reset(Percentile *Estimator)
+{
+	Estimator->Count = 0;
+	for(uint16_t i = 0; i < PercentileMarkers; i++)
+	{
+		Estimator->Height[i] = 0;
+		Estimator->Position[i] = i + 1;
+	}
+}
+
+void Percentile_Update(Percentile *Estimator, float Lux)
+{
+	uint16_t k, i;
+	float Desired, Candidate;
+	int32_t Sign;
+
+	//Filling the markers, insertion sort
+	if(Estimator->Count < PercentileMarkers)
+	{
+		for(i = Estimator->Count; i > 0 && Estimator->Height[i - 1] > Lux; i--)
+			Estimator->Height[i] = Estimator->Height[i - 1];
+		Estimator->Height[i] = Lux;
+		Estimator->Count++;
+		return;
+	}
+	//Cell of the new sample, the extreme markers follow the min and max
+	if(Lux < Estimator->Height[0])
+	{
+		Estimator->Height[0] = Lux;
+		k = 0;
+	}
+	else if(Lux >= Estimator->Height[PercentileMarkers - 1])
+	{
+		Estimator->Height[PercentileMarkers - 1] = Lux;
+		k = PercentileMarkers - 2;
+	}
+	else
+	{
+		for(k = 0; Lux >= Estimator->Height[k + 1]; k++);
+	}
+	for(i = k + 1; i < PercentileMarkers; i++)
+		Estimator->Position[i]++;
+	if(Estimator->Count != UINT32_MAX)
+		Estimator->Count++;
+	//Adjust the inner markers
+	for(i = 1; i < PercentileMarkers - 1; i++)
+	{
+		Desired = 1.0f + (Estimator->Count - 1) * MarkerProbability[i] - Estimator->Position[i];
+		if((Desired >= 1.0f && Estimator->Position[i + 1] - Estimator->Position[i] > 1) ||
+		   (Desired <= -1.0f && Estimator->Position[i - 1] - Estimator->Position[i] < -1))
+		{
+			Sign = (Desired > 0) ? 1 : -1;
+			Candidate = Percentile_Parabolic(Estimator, i, Sign);
+			if(Estimator->Height[i - 1] < Candidate && Candidate < Estimator->Height[i + 1])
+				Estimator->Height[i] = Candidate;
+			else
+				Estimator->Height[i] = Percentile_Linear(Estimator, i, Sign);
+			Estimator->Position[i] += Sign;
+		}
+	}
+}
+
+float Percentile_Get(const Percentile *Estimator, PercentileRank Rank)
+{
+	uint32_t Index;
+
+	if(Estimator->Count == 0)
+		return 0;
+	if(Estimator->Count < PercentileMarkers)
+	{
+		//Nearest rank on the sorted samples
+		Index = (uint32_t) ((Estimator->Count - 1) * MarkerProbability[Rank] + 0.5f);
+		return Estimator->Height[Index];
+	}
+	return Estimator->Height[Rank];
+}
+
+//Private functions
+static float Percentile_Parabolic(const Percentile *Estimator, uint16_t i, int32_t Sign)
+{
+	const float *q = Estimator->Height;
+	const int32_t *n = Estimator->Position;
+
+	return q[i] + (float) Sign / (n[i + 1] - n[i - 1]) *
+			((n[i] - n[i - 1] + Sign) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+			 (n[i + 1] - n[i] - Sign) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+static float Percentile_Linear(const Percentile *Estimator, uint16_t i, int32_t Sign)
+{
+	const float *q = Estimator->Height;
+	const int32_t *n = Estimator->Position;
+
+	return q[i] + Sign * (q[i + Sign] - q[i]) / (n[i + Sign] - n[i]);
+}
@@ -0,0 +1,206 @@
+/**
+ *  Photodiode acquisition
+ *  The DMA ISR only runs the CIC over the finished half, the cycles it
+ *  takes are counted with the DWT cycle counter to report the CPU load.
+ */
+
+#include "Photodiode.h"
+#include <string.h>
+
+#define AdcChannel 6
+#define AdcStabilization 1 //us, tSTAB from ADON to the calibration
+#define HistoryMask (PhotodiodeHistory - 1)
+
+volatile PhotodiodeStatus DiodeStatus;
+
+static uint16_t DmaBuffer[2 * PhotodiodeHalf];
+static Cic Decimator;
+static PhotodiodeBlockHook BlockHook = NULL;
+static uint16_t History[PhotodiodeHistory];
+static volatile uint32_t HistoryHead = 0;
+static uint32_t WindowStart;
+static uint32_t WindowSamples;
+
+static void Photodiode_PowerUp(void);
+
+void Photodiode_Init(void)
+{
+	//ADC clock at 72MHz / 6 = 12MHz, 14MHz is the limit
+	RCC -> APB2ENR |= RCC_APB2ENR_ADC1EN | RCC_APB2ENR_TIM1EN | RCC_APB2ENR_IOPAEN;
+	RCC -> AHBENR |= RCC_AHBENR_DMA1EN;
+	MODIFY_REG(RCC -> CFGR, RCC_CFGR_ADCPRE, RCC_CFGR_ADCPRE_DIV6);
+	//PA6 as analog input
+	GPIOA -> CRL &= ~(GPIO_CRL_MODE6 | GPIO_CRL_CNF6);
+
+	//239.5 cycles of sampling (20us) for the transimpedance output, one conversion per trigger
+	ADC1 -> CR1 = 0;
+	ADC1 -> SMPR2 |= ADC_SMPR2_SMP6;
+	ADC1 -> SQR1 = 0;
+	ADC1 -> SQR3 = AdcChannel;
+	//EXTSEL = 0 is the TIM1 CC1 event. Left off, the registers keep their values with the clock gated
+	ADC1 -> CR2 = ADC_CR2_EXTTRIG | ADC_CR2_DMA;
+	RCC -> APB2ENR &= ~RCC_APB2ENR_ADC1EN;
+
+	//Circular, 16 bits both sides, both halves interrupt
+	DMA1_Channel1 -> CCR = 0;
+	DMA1_Channel1 -> CPAR = (uint32_t) &ADC1 -> DR;
+	DMA1_Channel1 -> CMAR = (uint32_t) DmaBuffer;
+	DMA1_Channel1 -> CNDTR = 2 * PhotodiodeHalf;
+	DMA1_Channel1 -> CCR = DMA_CCR_PL_1 | DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0 | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE;
+
+	//TIM1 PWM 1 on channel 1 only as the trigger, PA8 isn't in alternate function so nothing is driven
+	TIM1 -> CR1 = 0;
+	TIM1 -> PSC = 0;
+	TIM1 -> ARR = (SystemCoreClock / PhotodiodeRate) - 1;
+	TIM1 -> CCR1 = (TIM1 -> ARR + 1) / 2;
+	TIM1 -> CCMR1 = TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1;
+	TIM1 -> CCER = TIM_CCER_CC1E;
+	TIM1 -> BDTR = TIM_BDTR_MOE;
+	TIM1 -> EGR = TIM_EGR_UG;
+
+	HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 2, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+	//Cycle counter for the CPU load
+	CoreDebug -> DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT -> CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	memset((void *) &DiodeStatus, 0, sizeof(DiodeStatus));
+}
+
+//Gets every raw half before it's overwritten
+void Photodiode_SetHook(PhotodiodeBlockHook Hook)
+{
+	BlockHook = Hook;
+}
+
+void Photodiode_Start(void)
+{
+	if(DiodeStatus.Running)
+		return;
+	Photodiode_PowerUp();
+	Cic_Init(&Decimator, PhotodiodeDecimation);
+	HistoryHead = 0;
+	DMA1 -> IFCR = DMA_IFCR_CGIF1;
+	DMA1_Channel1 -> CNDTR = 2 * PhotodiodeHalf;
+	DMA1_Channel1 -> CCR |= DMA_CCR_EN;
+	WindowStart = DWT -> CYCCNT;
+	WindowSamples = DiodeStatus.Samples;
+	DiodeStatus.BusyCycles = 0;
+	DiodeStatus.MaxCycles = 0;
+	TIM1 -> CNT = 0;
+	TIM1 -> CR1 |= TIM_CR1_CEN;
+	DiodeStatus.Running = true;
+}
+
+void Photodiode_Stop(void)
+{
+	TIM1 -> CR1 &= ~TIM_CR1_CEN;
+	DMA1_Channel1 -> CCR &= ~DMA_CCR_EN;
+	ADC1 -> CR2 &= ~ADC_CR2_ADON;
+	RCC -> APB2ENR &= ~RCC_APB2ENR_ADC1EN;
+	DiodeStatus.Running = false;
+}
+
+//Q4 ADC counts
+bool Photodiode_Latest(uint16_t *Value)
+{
+	uint32_t Head;
+
+	do
+	{
+		Head = HistoryHead;
+		if(Head == 0)
+			return false;
+		*Value = History[(Head - 1) & HistoryMask];
+	}while(Head != HistoryHead);
+	return true;
+}
+
+//Oldest first, returns how many were copied
+uint16_t Photodiode_History(uint16_t *Out, uint16_t Length)
+{
+	uint32_t Head = HistoryHead;
+	uint16_t Available = (Head < PhotodiodeHistory) ? Head : PhotodiodeHistory;
+
+	if(Length > Available)
+		Length = Available;
+	for(uint16_t Index = 0; Index < Length; Index++)
+		Out[Index] = History[(Head - Length + Index) & HistoryMask];
+	return Length;
+}
+
+//Closes a measurement window every second, Load in per mille of the CPU
+bool Photodiode_Throughput(uint32_t *Rate, uint16_t *Load)
+{
+	uint32_t Now = DWT -> CYCCNT;
+	uint32_t Elapsed = Now - WindowStart;
+	uint32_t Busy, Samples;
+
+	if(Elapsed < SystemCoreClock)
+		return false;
+	HAL_NVIC_DisableIRQ(DMA1_Channel1_IRQn);
+	Busy = DiodeStatus.BusyCycles;
+	Samples = DiodeStatus.Samples - WindowSamples;
+	DiodeStatus.BusyCycles = 0;
+	WindowSamples = DiodeStatus.Samples;
+	WindowStart = Now;
+	HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+	*Rate = (uint32_t) (((uint64_t) Samples * SystemCoreClock) / Elapsed);
+	*Load = (uint16_t) (((uint64_t) Busy * 1000) / Elapsed);
+	return true;
+}
+
+//ISR Handlers
+void Photodiode_DMA_ISR(void)
+{
+	uint32_t Start = DWT -> CYCCNT;
+	uint32_t Flags = DMA1 -> ISR;
+	uint16_t Outputs[PhotodiodeHalf / PhotodiodeDecimation + 1];
+	uint16_t *Half;
+	uint16_t Count;
+	uint32_t Cycles;
+
+	DMA1 -> IFCR = DMA_IFCR_CGIF1;
+	if((Flags & DMA_ISR_HTIF1) && (Flags & DMA_ISR_TCIF1))
+	{
+		//Both halves finished, the first one is being written again
+		DiodeStatus.Overruns++;
+		Half = &DmaBuffer[PhotodiodeHalf];
+	}
+	else if(Flags & DMA_ISR_HTIF1)
+		Half = DmaBuffer;
+	else if(Flags & DMA_ISR_TCIF1)
+		Half = &DmaBuffer[PhotodiodeHalf];
+	else
+		return;
+	Count = Cic_Process(&Decimator, Half, PhotodiodeHalf, Outputs);
+	for(uint16_t Index = 0; Index < Count; Index++)
+	{
+		History[HistoryHead & HistoryMask] = Outputs[Index];
+		__DMB();
+		HistoryHead++;
+	}
+	if(BlockHook != NULL)
+		BlockHook(Half, PhotodiodeHalf);
+	DiodeStatus.Samples += PhotodiodeHalf;
+	DiodeStatus.Outputs += Count;
+	Cycles = DWT -> CYCCNT - Start;
+	DiodeStatus.BusyCycles += Cycles;
+	if(Cycles > DiodeStatus.MaxCycles)
+		DiodeStatus.MaxCycles = Cycles;
+}
+
+//Private functions
+//ADON from off only powers the ADC up, a second write would start a conversion
+static void Photodiode_PowerUp(void)
+{
+	uint32_t Start;
+
+	RCC -> APB2ENR |= RCC_APB2ENR_ADC1EN;
+	ADC1 -> CR2 |= ADC_CR2_ADON;
+	Start = DWT -> CYCCNT;
+	while(DWT -> CYCCNT - Start < AdcStabilization * (SystemCoreClock / 1000000));
+	ADC1 -> CR2 |= ADC_CR2_RSTCAL;
+	while(ADC1 -> CR2 & ADC_CR2_RSTCAL);
+	ADC1 -> CR2 |= ADC_CR2_CAL;
+	while(ADC1 -> CR2 & ADC_CR2_CAL);
+}
@@ -0,0 +1,113 @@
+/**
+ *  Streaming statistics of the lux samples
+ *  Only the update is in the sample path, the getters convert to float
+ *  when the values are printed.
+ */
+
+#include "Statistics.h"
+
+#define SampleShift 4  //Q4 samples
+#define MeanShift 12   //Extra fraction bits of the mean
+#define DeltaShift 6   //Keeps the product of the deltas inside 64 bits
+
+static uint32_t Statistics_Isqrt(uint64_t Value);
+
+void Statistics_Reset(Statistics *Stats)
+{
+	Stats->Count = 0;
+	Stats->Min = 0;
+	Stats->Max = 0;
+	Stats->Mean = 0;
+	Stats->M2 = 0;
+	Stats->Elapsed = 0;
+	Stats->LastTimestamp = 0;
+}
+
+void Statistics_Update(Statistics *Stats, float Lux, uint32_t Timestamp)
+{
+	int32_t Sample = (int32_t) (Lux * (1 << SampleShift) + 0.5f);
+	int64_t Delta, Delta2;
+	uint64_t Product;
+
+	if(Stats->Count == 0)
+	{
+		Stats->Min = Sample;
+		Stats->Max = Sample;
+	}
+	else
+	{
+		if(Sample < Stats->Min)
+			Stats->Min = Sample;
+		if(Sample > Stats->Max)
+			Stats->Max = Sample;
+		Stats->Elapsed += (uint32_t) (Timestamp - Stats->LastTimestamp);
+	}
+	Stats->LastTimestamp = Timestamp;
+	if(Stats->Count != UINT32_MAX)
+		Stats->Count++;
+	//Welford
+	Delta = ((int64_t) Sample << MeanShift) - Stats->Mean;
+	Stats->Mean += Delta / (int64_t) Stats->Count;
+	Delta2 = ((int64_t) Sample << MeanShift) - Stats->Mean;
+	Product = (uint64_t) ((Delta >> DeltaShift) * (Delta2 >> DeltaShift));
+	Product >>= 2 * (MeanShift - DeltaShift);
+	if(Stats->M2 > UINT64_MAX - Product)
+		Stats->M2 = UINT64_MAX;
+	else
+		Stats->M2 += Product;
+}
+
+float Statistics_Min(const Statistics *Stats)
+{
+	return (float) Stats->Min / (1 << SampleShift);
+}
+
+float Statistics_Max(const Statistics *Stats)
+{
+	return (float) Stats->Max / (1 << SampleShift);
+}
+
+float Statistics_Mean(const Statistics *Stats)
+{
+	return (float) Stats->Mean / (1 << (SampleShift + MeanShift));
+}
+
+//Sample standard deviation
+float Statistics_StdDev(const Statistics *Stats)
+{
+	uint64_t Variance;
+
+	if(Stats->Count < 2)
+		return 0;
+	Variance = Stats->M2 / (Stats->Count - 1);
+	if(Variance < ((uint64_t) 1 << 55)) //8 more bits for the root, Q8 lux
+		return (float) Statistics_Isqrt(Variance << 8) / (1 << (2 * SampleShift));
+	return (float) Statistics_Isqrt(Variance) / (1 << SampleShift);
+}
+
+uint32_t Statistics_ElapsedSeconds(const Statistics *Stats)
+{
+	return (uint32_t) (Stats->Elapsed / 1000000);
+}
+
+//Private functions
+static uint32_t Statistics_Isqrt(uint64_t Value)
+{
+	uint64_t Root = 0;
+	uint64_t Bit = (uint64_t) 1 << 62;
+
+	while(Bit > Value)
+		Bit >>= 2;
+	while(Bit != 0)
+	{
+		if(Value >= Root + Bit)
+		{
+			Value -= Root + Bit;
+			Root = (Root >> 1) + Bit;
+		}
+		else
+			Root >>= 1;
+		Bit >>= 2;
+	}
+	return (uint32_t) Root;
+}
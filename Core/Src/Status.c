@@ -0,0 +1,107 @@
+/**
+ *  Error status
+ *  Status_Update has to run every loop, the time on each level is charged
+ *  to the level that was active since the previous call.
+ */
+
+#include "Status.h"
+#include <string.h>
+
+SystemErrors SystemStatus;
+
+static const ErrorLevel Levels[Error_Codes] = {
+		[Error_Sensor_NoConn] = Level_Blocked,
+		[Error_Sensor_Fatal] = Level_Blocked,
+		[Error_EEPROM] = Level_Degraded
+};
+
+//3 characters, they fit in the corner of every screen
+static const char Tags[Error_Codes][4] = {
+		[Error_Sensor_NoConn] = "SNC",
+		[Error_Sensor_Fatal] = "SNF",
+		[Error_EEPROM] = "EEP"
+};
+
+void Status_Init(void)
+{
+	memset(&SystemStatus, 0, sizeof(SystemErrors));
+	SystemStatus.LastUpdate = HAL_GetTick();
+}
+
+void Status_Raise(ErrorCode Code)
+{
+	if(SystemStatus.Entries[Code].Active)
+		return;
+	Status_Update(); //The time so far belongs to the old level
+	SystemStatus.Entries[Code].Active = true;
+	SystemStatus.Entries[Code].Count++;
+	SystemStatus.Entries[Code].Raised = HAL_GetTick();
+	SystemStatus.Newest = Code;
+}
+
+void Status_Clear(ErrorCode Code)
+{
+	if(!SystemStatus.Entries[Code].Active)
+		return;
+	Status_Update();
+	SystemStatus.Entries[Code].Active = false;
+}
+
+bool Status_IsActive(ErrorCode Code)
+{
+	return SystemStatus.Entries[Code].Active;
+}
+
+//The worst level of the active errors
+ErrorLevel Status_Level(void)
+{
+	ErrorLevel Level = Level_Ok;
+
+	for(uint16_t Code = 0; Code < Error_Codes; Code++)
+		if(SystemStatus.Entries[Code].Active && Levels[Code] > Level)
+			Level = Levels[Code];
+	return Level;
+}
+
+void Status_Update(void)
+{
+	uint32_t Now = HAL_GetTick();
+
+	switch(Status_Level())
+	{
+		case Level_Degraded:
+			SystemStatus.DegradedTime += Now - SystemStatus.LastUpdate;
+		break;
+		case Level_Blocked:
+			SystemStatus.BlockedTime += Now - SystemStatus.LastUpdate;
+		break;
+		case Level_Ok:
+		default:
+		break;
+	}
+	SystemStatus.LastUpdate = Now;
+}
+
+//True while an error is active, Code is the newest active one
+bool Status_Banner(ErrorCode *Code)
+{
+	if(SystemStatus.Entries[SystemStatus.Newest].Active)
+	{
+		*Code = SystemStatus.Newest;
+		return true;
+	}
+	for(uint16_t Index = 0; Index < Error_Codes; Index++)
+	{
+		if(SystemStatus.Entries[Index].Active)
+		{
+			*Code = (ErrorCode) Index;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *Status_Tag(ErrorCode Code)
+{
+	return Tags[Code];
+}
@@ -0,0 +1,113 @@
+/**
+ *  Swinging door compression
+ *  The lower door doesn't go under the line from the anchor to zero at
+ *  the point, so no stored point is below zero (a sunset with a wide
+ *  corridor would end the line there).
+ */
+
+#include "SwingDoor.h"
+
+static uint32_t SwingDoor_Close(SwingDoor *Door);
+static void SwingDoor_Open(SwingDoor *Door, uint32_t Time, uint32_t Lux);
+
+void SwingDoor_Init(SwingDoor *Door, uint16_t Deadband)
+{
+	Door->Deadband = Deadband;
+	Door->Started = false;
+	Door->Open = false;
+	Door->Points = 0;
+	Door->Stored = 0;
+}
+
+//True with a point to store, it's never the one given but an older one
+bool SwingDoor_Add(SwingDoor *Door, uint32_t Time, uint32_t Lux, uint32_t *StoreTime, uint32_t *StoreLux)
+{
+	float Corridor = Door->Deadband - 0.5f;
+	float Elapsed, Low, High;
+
+	Door->Points++;
+	if(Door->Deadband == 0 || !Door->Started)
+	{
+		//Every point, or the first one
+		Door->Started = true;
+		Door->Open = false;
+		Door->AnchorTime = *StoreTime = Time;
+		Door->AnchorLux = *StoreLux = Lux;
+		Door->Stored++;
+		return true;
+	}
+	if(Time == Door->AnchorTime || (Door->Open && Time == Door->LastTime))
+		return false;
+	if(!Door->Open)
+	{
+		SwingDoor_Open(Door, Time, Lux);
+		return false;
+	}
+	Elapsed = Time - Door->AnchorTime;
+	Low = ((float) Lux - Corridor - Door->AnchorLux) / Elapsed;
+	High = ((float) Lux + Corridor - Door->AnchorLux) / Elapsed;
+	if(Low < -(float) Door->AnchorLux / Elapsed)
+		Low = -(float) Door->AnchorLux / Elapsed;
+	if(Low < Door->Low)
+		Low = Door->Low;
+	if(High > Door->High)
+		High = Door->High;
+	if(Low <= High && Time - Door->AnchorTime <= SwingDoorMaxSpan)
+	{
+		Door->Low = Low;
+		Door->High = High;
+		Door->LastTime = Time;
+		Door->LastLux = Lux;
+		return false;
+	}
+	//Closed, the last point ends the segment and starts the next one
+	*StoreTime = Door->LastTime;
+	*StoreLux = SwingDoor_Close(Door);
+	SwingDoor_Open(Door, Time, Lux);
+	return true;
+}
+
+//The pending point, before changing the deadband or to see the latest value
+bool SwingDoor_Flush(SwingDoor *Door, uint32_t *StoreTime, uint32_t *StoreLux)
+{
+	if(!Door->Open)
+		return false;
+	*StoreTime = Door->LastTime;
+	*StoreLux = SwingDoor_Close(Door);
+	Door->Open = false;
+	return true;
+}
+
+//Private functions
+//The last point moved onto the doors, it's the new anchor
+static uint32_t SwingDoor_Close(SwingDoor *Door)
+{
+	float Elapsed = Door->LastTime - Door->AnchorTime;
+	float Slope = ((float) Door->LastLux - Door->AnchorLux) / Elapsed;
+	float Value;
+
+	if(Slope < Door->Low)
+		Slope = Door->Low;
+	if(Slope > Door->High)
+		Slope = Door->High;
+	Value = Door->AnchorLux + Slope * Elapsed + 0.5f;
+	Door->AnchorTime = Door->LastTime;
+	Door->AnchorLux = (Value < 0) ? 0 : (uint32_t) Value;
+	Door->Stored++;
+	return Door->AnchorLux;
+}
+
+//First point after the anchor, the doors as wide as its corridor
+static void SwingDoor_Open(SwingDoor *Door, uint32_t Time, uint32_t Lux)
+{
+	float Corridor = Door->Deadband - 0.5f;
+	float Elapsed = Time - Door->AnchorTime;
+
+	Door->Low = ((float) Lux - Corridor - Door->AnchorLux) / Elapsed;
+	Door->High = ((float) Lux + Corridor - Door->AnchorLux) / Elapsed;
+	if(Door->Low < -(float) Door->AnchorLux / Elapsed)
+		Door->Low = -(float) Door->AnchorLux / Elapsed;
+	Door->LastTime = Time;
+	Door->LastLux = Lux;
+	Door->Open = true;
+}
@@ -0,0 +1,56 @@
+/**
+ *  Illuminance uniformity between measurement heads
+ *  Each reading is folded into the running sweep with Uniformity_Update,
+ *  Uniformity_Publish closes the sweep and computes the ratios
+ */
+
+#include "Uniformity.h"
+
+void Uniformity_Init(Uniformity *Metrics)
+{
+	Metrics->Readings = 0;
+	Metrics->Sum = 0;
+	Metrics->Min = 0;
+	Metrics->Max = 0;
+	Metrics->MinHead = 0;
+	Metrics->Emin = 0;
+	Metrics->Eavg = 0;
+	Metrics->Emax = 0;
+	Metrics->U0 = 0;
+	Metrics->Ud = 0;
+	Metrics->WeakestHead = 0;
+	Metrics->Heads = 0;
+	Metrics->Ready = false;
+}
+
+void Uniformity_Update(Uniformity *Metrics, uint16_t Head, float Measure)
+{
+	if(Metrics->Readings == 0 || Measure < Metrics->Min)
+	{
+		Metrics->Min = Measure;
+		Metrics->MinHead = Head;
+	}
+	if(Metrics->Readings == 0 || Measure > Metrics->Max)
+		Metrics->Max = Measure;
+	Metrics->Sum += Measure;
+	Metrics->Readings++;
+}
+
+//Returns false if no head was read during the sweep
+bool Uniformity_Publish(Uniformity *Metrics)
+{
+	if(Metrics->Readings == 0)
+		return false;
+	Metrics->Emin = Metrics->Min;
+	Metrics->Emax = Metrics->Max;
+	Metrics->Eavg = Metrics->Sum / Metrics->Readings;
+	Metrics->U0 = (Metrics->Eavg > 0) ? Metrics->Emin / Metrics->Eavg : 0;
+	Metrics->Ud = (Metrics->Emax > 0) ? Metrics->Emin / Metrics->Emax : 0;
+	Metrics->WeakestHead = Metrics->MinHead;
+	Metrics->Heads = Metrics->Readings;
+	Metrics->Ready = true;
+	//Start the next sweep
+	Metrics->Readings = 0;
+	Metrics->Sum = 0;
+	return true;
+}
@@ -5,11 +5,13 @@
  *  EEPROM Memory Map
  *  Memory regions
  *  0x0000 - 0x0002 Menu Configurations
+ *  0x0008 - 0x003F Configuration image, see ConfigImage.h
+ *  0x0040 - 0x00FF Measurement log, see Logger.h
  *  Variables
  *	//Menu Configurations
  *	0x0000: Variable that contains if the system is in Factory Values : 8 bits
- *	0x0001: Variable Mode : 8 bits
- *	0x0002: Variable Resolutions : 8 bits
+ *	0x0001: Variable Mode : 8 bits, before the image (version 0)
+ *	0x0002: Variable Resolutions : 8 bits, before the image (version 0)
  *
  *	Version 0.3.1
  *	Version E.3.1
@@ -20,11 +22,35 @@
 #include "ssd1306.h"
 #include "fonts.h"
 #include "Rojo_BH1750.h"
+#include "BH1750_Continuous.h"
+#include "Uniformity.h"
+#include "Acquisition.h"
+#include "Statistics.h"
+#include "Percentile.h"
+#include "Dose.h"
+#include "AutoHold.h"
+#include "AdaptiveRate.h"
+#include "Alarm.h"
+#include "Burst.h"
+#include "Photodiode.h"
+#include "Flicker.h"
+#include "Status.h"
+#include "I2cBus.h"
+#include "I2cQueue.h"
+#include "FlashStore.h"
+#include "Export.h"
+#include "EepromCache.h"
+#include "ConfigImage.h"
+#include "Logger.h"
+#include "I2cMaster.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #define EEPROM_ADDR 0b10100000
+#define EEPROM_FACTORY 0x0
+#define EEPROM_MODE 0x1
 #define ReadMask (uint32_t) 0x1F
 #define EndOfCounts250ms 65454 //@274PSC: 250ms
 #define EndOfCounts50ms 13139  //@274PS: 50ms
@@ -32,6 +58,16 @@
 #define Seconds(x) x*4 //Only valid for the Timer_Delay_250ms
 #define DefaultSampleTime 10
 #define DefaultResolution 54612
+#define DisplayAddress 0x78
+#define DisplayFlushBytes 1112 //8 pages of 3 commands plus 128 bytes of data
+#define DisplayFlushTransactions 32
+#define SensorProbePeriod 500 //ms between the address probes while the sensor is missing
+#define MaxLogDeadband 500    //0.1lx
+#define MaxAlarmHigh 54000    //lux, under the BH1750 full scale
+#define MaxAlarmLow 9990      //lux
+#define MaxAlarmHysteresis 995 //lux
+#define MaxHoldRelative 1000  //Tenths of percent, the whole mean
+#define MaxHoldAbsolute 1000  //lux
 
 //#define USER_PLOT_DEBUG
 //#define USER_CONF_P_DEBUG
@@ -41,6 +77,12 @@
 #define USER_DEBUG
 #define ECONOMIC_VERSION //For the versions of the instrument that doesn't have the EEPROM
 
+#ifdef ONE_SENSOR
+#define NumberOfHeads 1
+#else
+#define NumberOfHeads 2 //BH1750 heads on I2C2, ADDR pin low and high
+#endif
+
 #ifdef ECONOMIC_VERSION
 #define VERSION "Version E.3"
 #else
@@ -49,6 +91,7 @@
 
 I2C_HandleTypeDef hi2c1;
 I2C_HandleTypeDef hi2c2;
+TIM_HandleTypeDef htim2; //Acquisition clock, 1MHz timebase, CC1 paces the sensor reads
 TIM_HandleTypeDef htim3; //Paused Cycle handler, ISR @ 10ms
 TIM_HandleTypeDef htim4; //Used for generic delay proposes, PSC@274, Period of 0.000003806
 IWDG_HandleTypeDef hiwdg;
@@ -88,18 +131,19 @@ typedef enum Mode
 	Plot,
 	Config_Plot,
 	Select_Sensor,
+	Diagnostics,
+	Percentiles,
+	Light_Dose,
+	Auto_Hold,
+	Threshold_Alarm,
+	Burst_Capture,
+	Select_Diode,
+	Flicker_Metrics,
+	History,
 	Reset_Sensor,
 	Idle,
-	Select_Diode,
 }Modes;
 
-struct Errors
-{
-	bool EEPROM_Fatal;
-	bool BH1750_Fatal;
-	bool BH1750_NoConn;
-}Errors;
-
 struct Configs
 {
 	uint8_t Factory_Values;
@@ -134,11 +178,19 @@ typedef struct PlotConfigs
 	bool PrintLegends;
 }PlotConfigs;
 
+typedef struct FlashField
+{
+	FlashKey Key;
+	uint8_t Offset; //In ConfigImageBody
+	uint8_t Size;
+}FlashField;
+
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
 static void MX_I2C1_Init(void);
 static void MX_I2C2_Init(void);
 static void MX_IWDG_Init(void);
+static void MX_TIM2_Init(void);
 static void MX_TIM3_Init(void);
 static void MX_TIM4_Init(void);
 void Continous_mode(void);
@@ -151,7 +203,23 @@ void Config_plot_mode(void);
 void Config_PlotSelectAnim(char *string, uint16_t CoordinateX, uint16_t CoordinateY);
 
 void Reset_sensor_mode(void);
+void Select_sensor_mode(void);
+void Diagnostics_mode(void);
+void Percentiles_mode(void);
+void Light_dose_mode(void);
+void Auto_hold_mode(void);
+void Threshold_alarm_mode(void);
+void Burst_capture_mode(void);
+void Select_diode_mode(void);
+void Flicker_metrics_mode(void);
+void History_mode(void);
 void Flash_configs(void);
+void Flash_save(void);
+void Configs_load(void);
+void Configs_save(void);
+bool Configs_ValidMode(uint32_t Mode);
+void Configs_pack(ConfigImageBody *Body);
+void Configs_unpack(const ConfigImageBody *Body);
 void MenuGUI(void);
 void MCU_Reset_Subrutine(void);
 void Fatal_Error_EEPROM(void);
@@ -159,12 +227,24 @@ void Fatal_Error_BH1750(void);
 void NoConnected_BH1750(void);
 void Select_animation(char String[], uint16_t x, uint16_t y);
 void Print_Measure(float Measure, uint16_t x, uint16_t y);
+void Print_SmallValue(char *Label, float Value, uint16_t x, uint16_t y);
+void Print_Statistics(const Statistics *Stats, float Value);
 void wait_until_press(Buttons Button);
 void Timer_Delay_250ms(uint16_t Value);
 void Timer_Delay_50ms(uint16_t Value);
 void Timer_Delay_at_274PSC(uint16_t Counts, uint16_t Overflows); //Period of 0.000003806
 void SensorRead(void);
-void Errors_init();
+bool Sensor_Source(float *Lux);
+void Sensor_SetRate(BH1750_Resolutions Resolution, uint32_t Period, bool OneShot);
+void Statistics_task(void);
+void Sampling_task(void);
+void Background_tasks(void);
+void Sensor_Fastest(void);
+void Sample_hooks(const Sample *New);
+void Flicker_hook(const uint16_t *Block, uint16_t Length);
+void Status_task(void);
+void Sensor_Reattach(void);
+void Display_Update(void);
 void Configs_init(void);
 void CharNumberFromFloat(float Number, uint16_t DecimalsToConsider, uint16_t CountStringFinisher, uint16_t *NumberOfIntegers, uint16_t *NumberOfDecimals);
 uint16_t CharsNumberFromInt(uint32_t Number, uint16_t CountFinisherChar);
@@ -189,11 +269,87 @@ PlotConfigs GlobalConfigs  = {
 		.PrintLegends = DefaultPlotSettings.PrintLegends
 };
 
+const AutoHoldConfigs DefaultAutoHoldSettings = {
+		.RelativeThreshold = 10, //1% of the mean
+		.AbsoluteThreshold = 4,  //One count of the BH1750 low resolution mode
+		.Timeout = 10
+};
+
+AutoHoldConfigs AutoHoldSettings = {
+		.RelativeThreshold = DefaultAutoHoldSettings.RelativeThreshold,
+		.AbsoluteThreshold = DefaultAutoHoldSettings.AbsoluteThreshold,
+		.Timeout = DefaultAutoHoldSettings.Timeout
+};
+
+const AlarmConfigs DefaultAlarmSettings = {
+		.High = 1000,
+		.Low = 0, //Disabled
+		.Hysteresis = 20
+};
+
+AlarmConfigs AlarmSettings = {
+		.High = DefaultAlarmSettings.High,
+		.Low = DefaultAlarmSettings.Low,
+		.Hysteresis = DefaultAlarmSettings.Hysteresis
+};
+
+const RateSettings AdaptiveSettings = {
+		.NoiseFloor = 4,       //One count of the BH1750 low resolution mode
+		.NoiseRelative = 5,    //0.5%
+		.RiseThreshold = 200,  //20% per second
+		.FallThreshold = 20,   //2% per second
+		.Calm = 3
+};
+
+//The flash store keys of the configuration image fields
+const FlashField FlashFields[FlashStoreKeys] = {
+		{FlashKey_Mode, offsetof(ConfigImageBody, Mode), 1},
+		{FlashKey_Resolution, offsetof(ConfigImageBody, Resolution), 1},
+		{FlashKey_PlotType, offsetof(ConfigImageBody, PlotType), 1},
+		{FlashKey_PrintLegends, offsetof(ConfigImageBody, PrintLegends), 1},
+		{FlashKey_SampleTime, offsetof(ConfigImageBody, SampleTime), 2},
+		{FlashKey_PlotResolution, offsetof(ConfigImageBody, PlotResolution), 2},
+		{FlashKey_HoldRelative, offsetof(ConfigImageBody, HoldRelative), 2},
+		{FlashKey_HoldAbsolute, offsetof(ConfigImageBody, HoldAbsolute), 2},
+		{FlashKey_HoldTimeout, offsetof(ConfigImageBody, HoldTimeout), 2},
+		{FlashKey_AlarmHigh, offsetof(ConfigImageBody, AlarmHigh), 2},
+		{FlashKey_AlarmLow, offsetof(ConfigImageBody, AlarmLow), 2},
+		{FlashKey_AlarmHysteresis, offsetof(ConfigImageBody, AlarmHysteresis), 2},
+		{FlashKey_LogDeadband, offsetof(ConfigImageBody, LogDeadband), 2}
+};
+
 const char Slots[5][7] = {"Slot 1", "Slot 2", "Slot 3", "Slot 5", "Slot 6"};
 float Measure;
 Rojo_BH1750 BH1750;
+#ifndef ONE_SENSOR
+Rojo_BH1750 BH1750_Aux;
+Rojo_BH1750 *Heads[NumberOfHeads] = {&BH1750, &BH1750_Aux};
+#else
+Rojo_BH1750 *Heads[NumberOfHeads] = {&BH1750};
+#endif
+Uniformity UniformityMetrics;
+Statistics SessionStats;
+Statistics HeldStats;
+Percentile SessionPercentiles;
+Dose LightDose __attribute__((section(".noinit"))); //Survives the warm resets
+AutoHold AutoHoldState;
+SampleReader AutoHoldReader;
+SampleReader StatsReader;
+AdaptiveRate RateControl;
+SampleReader RateReader;
+RateLevel SensorLevel = Rate_Normal; //Rate_Levels forces the next Sampling_task to configure the sensor
+volatile bool SensorOneShot = false;
+AlarmCapture AlarmReview;
+Burst BurstCapture;
+Flicker FlickerMeter;
+bool StatsOverlay = false;
+bool DisplayPending = false; //A flush refused by the queue, done again from the main loop
+Logger MeasureLog;
+uint16_t LogDeadband = 0; //0.1lx, 0 logs every record
 uint16_t IDR_Read;
-uint8_t Config_buffer[2]; /*Solve here*/
+ConfigImageResult ConfigLoad = Image_Invalid;
+uint8_t ConfigLoadVersion = 0; //Of the image found on the boot, 0 for the layout before the image
+uint32_t ConfigLoadTime = 0; //us, EEPROM read and decode on the boot
 bool comeFromMenu = false;
 
 int main(void)
@@ -203,12 +359,23 @@ int main(void)
   MX_GPIO_Init();
   MX_I2C1_Init();
   MX_I2C2_Init();
+  I2cBus_Init(&hi2c1, &hi2c2);
+  I2cQueue_Init(&hi2c1, &hi2c2);
+  I2cBus_Name(&hi2c1, DisplayAddress, "OLED");
+  I2cBus_Name(&hi2c1, EEPROM_ADDR, "EEP");
+  I2cBus_Name(&hi2c2, Address_Low, "LUX");
+#ifndef ONE_SENSOR
+  I2cBus_Name(&hi2c2, Address_High, "AUX");
+#endif
   MX_IWDG_Init();
+  MX_TIM2_Init();
   MX_TIM3_Init();
   MX_TIM4_Init();
   HAL_IWDG_Init(&hiwdg);
   SSD1306_Init();
   Configs_init();
+  Status_Init();
+  FlashStore_Init();
   //Initial Prints
 #ifdef SHOW_LOADING
   SSD1306_GotoXY(7, 5);
@@ -226,33 +393,46 @@ int main(void)
   SSD1306_Puts("Firmware Version", &Font_7x10, 1);
   SSD1306_GotoXY(3, 37);
   SSD1306_Puts(VERSION, &Font_11x18, 1);
-  SSD1306_UpdateScreen();
+  Display_Update();
   HAL_IWDG_Refresh(&hiwdg);
   switch(Sensor)
   {
   	  case _BH1750:
-  		  if(BH1750_Init(&BH1750, &hi2c2, Address_Low) != Rojo_OK)
+  		  if(BH1750_Init(&BH1750, &hi2c2, Address_Low) != Rojo_OK ||
+  			 BH1750_ContinuousStart(&BH1750, Configs.Resolution) != Rojo_OK)
+  			  NoConnected_BH1750();
+#ifndef ONE_SENSOR
+  		  if(BH1750_Init(&BH1750_Aux, &hi2c2, Address_High) != Rojo_OK ||
+  			 BH1750_ContinuousStart(&BH1750_Aux, Configs.Resolution) != Rojo_OK)
   			  NoConnected_BH1750();
+#endif
 	  break;
 	  case _TSL2561:
 	  break;
   }
+  Acquisition_Init(&htim2, Sensor_Source, DefaultSamplePeriod);
+  Photodiode_Init();
+  Flicker_Init(&FlickerMeter);
+  Photodiode_SetHook(Flicker_hook);
   //EEPROM Check & Configurations Read
-#ifndef ECONOMIC_VERSION
-  if(HAL_I2C_Mem_Read(&hi2c1, EEPROM_ADDR, 0x0, 1, &Configs.Factory_Values, 1, 100) != HAL_OK)
+#ifdef ECONOMIC_VERSION
+  Flash_configs();
+#else
+  //The factory flag and the configuration image in one read, the rest comes from the cache
+  ConfigLoadTime = DWT -> CYCCNT;
+  if(EepromCache_Init(&hi2c1, EEPROM_ADDR) != HAL_OK)
 	  Fatal_Error_EEPROM();
-  if(Errors.EEPROM_Fatal || Configs.Factory_Values)
+  else
+	  EepromCache_Read(EEPROM_FACTORY, &Configs.Factory_Values, 1);
+  if(Status_IsActive(Error_EEPROM) || Configs.Factory_Values)
 	  Flash_configs(); //Start by the FLASH configurations
-  //Code here the backup EEPROM settings
-  else if(!Configs.Factory_Values)
-  {
-	  if(HAL_I2C_Mem_Read(&hi2c1, EEPROM_ADDR, 0x1, 1, Config_buffer, 2/*@TODO Change the neccesary buffer*/, 100) != HAL_OK)
-		  Fatal_Error_EEPROM();
-	  HAL_IWDG_Refresh(&hiwdg);
-	  /*@TODO Check all the configurations*/
-	  Config_buffer[0] = Configs.Mode;
-	  Config_buffer[1] = Configs.Resolution;
-  }
+  else
+	  Configs_load();
+  ConfigLoadTime = (DWT -> CYCCNT - ConfigLoadTime) / (SystemCoreClock / 1000000);
+  HAL_IWDG_Refresh(&hiwdg);
+  if(!Status_IsActive(Error_EEPROM))
+	  Logger_Init(&MeasureLog, &hi2c1, EEPROM_ADDR);
+  Logger_Deadband(&MeasureLog, LogDeadband);
 #endif
   //Final
   HAL_IWDG_Refresh(&hiwdg);
@@ -263,9 +443,22 @@ int main(void)
 #endif
   //Final Clear
   SSD1306_Clear();
-  SSD1306_UpdateScreen();
-  //Starting the paused cycle handler
+  Display_Update();
+  //Starting the paused cycle handler and the sampling clock
   HAL_TIM_Base_Start_IT(&htim3);
+  Statistics_Reset(&SessionStats);
+  Percentile_Reset(&SessionPercentiles);
+  Dose_Init(&LightDose);
+  AutoHold_Init(&AutoHoldState);
+  AdaptiveRate_Init(&RateControl, Rate_Normal);
+  Acquisition_ReaderInit(&StatsReader);
+  Acquisition_ReaderInit(&RateReader);
+  Export_Init(&MeasureLog); //Live samples, and the log without the EEPROM is empty
+  //The alarm pin and the burst capture run from the acquisition ISR
+  Alarm_Init(&AlarmSettings);
+  Burst_Init(&BurstCapture);
+  Acquisition_SetHook(Sample_hooks);
+  Acquisition_Start();
   while (1)
   {
 	  //Check ISR's
@@ -283,6 +476,10 @@ int main(void)
 	  	  default:
 	  	  break;
 	  }
+	  Background_tasks();
+	  //The photodiode ADC only runs in its modes
+	  if(Configs.Mode != Select_Diode && Configs.Mode != Flicker_Metrics && DiodeStatus.Running)
+		  Photodiode_Stop();
 	  //Check & Run the mode
 #ifdef USER_PLOT_DEBUG
 	  Configs.Mode = Plot;
@@ -307,8 +504,34 @@ int main(void)
 	  		  Config_plot_mode();
 	  	  break;
 	  	  case Select_Sensor: //IR Software mode
+	  		  Select_sensor_mode();
+	  	  break;
+	  	  case Diagnostics: //Basic Software mode
+	  		  Diagnostics_mode();
+	  	  break;
+	  	  case Percentiles: //Basic Software mode
+	  		  Percentiles_mode();
+	  	  break;
+	  	  case Light_Dose: //Basic Software mode
+	  		  Light_dose_mode();
+	  	  break;
+	  	  case Auto_Hold: //Basic Software mode
+	  		  Auto_hold_mode();
+	  	  break;
+	  	  case Threshold_Alarm: //Basic Software mode
+	  		  Threshold_alarm_mode();
+	  	  break;
+	  	  case Burst_Capture: //Basic Software mode
+	  		  Burst_capture_mode();
 	  	  break;
 	  	  case Select_Diode: //IR Software mode
+	  		  Select_diode_mode();
+	  	  break;
+	  	  case Flicker_Metrics: //Basic Software mode
+	  		  Flicker_metrics_mode();
+	  	  break;
+	  	  case History: //Basic Software mode
+	  		  History_mode();
 	  	  break;
 	  	  case Idle:
 	  	  break;
@@ -330,19 +553,52 @@ int main(void)
 //Basic software modes
 void Continous_mode(void)
 {
+	static uint32_t Past_IDR_Read = 0xFF;
+	static uint32_t Drawn = 0;
+	bool Reprint = false;
+
 	HAL_IWDG_Refresh(&hiwdg);
-	if(Configs.Last_Mode != Continuous || comeFromMenu)
+	//Up toggles the statistics overlay, Down restarts the statistics window
+	IDR_Read = (GPIOA -> IDR & ReadMask);
+	if(Past_IDR_Read != IDR_Read)
+	{
+		switch(IDR_Read)
+		{
+			case Up:
+				StatsOverlay = !StatsOverlay;
+				Reprint = true;
+			break;
+			case Down:
+				Statistics_Reset(&SessionStats);
+				Percentile_Reset(&SessionPercentiles);
+			break;
+		}
+	}
+	Past_IDR_Read = IDR_Read;
+	if(Configs.Last_Mode != Continuous || comeFromMenu || Reprint)
 	{
 		SSD1306_Clear();
-		SSD1306_GotoXY(36, 8);
-		SSD1306_Puts("Valor", &Font_11x18, 1);
-		SSD1306_GotoXY(28, 53);
-		SSD1306_Puts("Continuous", &Font_7x10, 1);
-		SSD1306_UpdateScreen();
+		if(!StatsOverlay)
+		{
+			SSD1306_GotoXY(36, 8);
+			SSD1306_Puts("Valor", &Font_11x18, 1);
+			SSD1306_GotoXY(28, 53);
+			SSD1306_Puts("Continuous", &Font_7x10, 1);
+		}
+		Display_Update();
+		Drawn = AcqStatus.Samples - 1;
 	}
 	SensorRead();
 	HAL_IWDG_Refresh(&hiwdg);
-	Print_Measure(Measure, 14, 30);
+	//The screen only changes with a new sample, the I2C flush is ~25ms
+	if(Drawn != AcqStatus.Samples)
+	{
+		Drawn = AcqStatus.Samples;
+		if(StatsOverlay)
+			Print_Statistics(&SessionStats, Measure);
+		else
+			Print_Measure(Measure, 14, 30);
+	}
 	Configs.Last_Mode = Continuous;
 	comeFromMenu = false;
 }
@@ -352,20 +608,257 @@ void Hold_mode(void)
 	if(Configs.Last_Mode != Hold || comeFromMenu)
 	{
 		SSD1306_Clear();
-		SSD1306_GotoXY(36, 8);
-		SSD1306_Puts("Valor", &Font_11x18, 1);
-		SSD1306_GotoXY(43, 53);
-		SSD1306_Puts("Hold", &Font_7x10, 1);
-		SSD1306_UpdateScreen();
+		if(!StatsOverlay)
+		{
+			SSD1306_GotoXY(36, 8);
+			SSD1306_Puts("Valor", &Font_11x18, 1);
+			SSD1306_GotoXY(43, 53);
+			SSD1306_Puts("Hold", &Font_7x10, 1);
+		}
+		Display_Update();
 	}
 	SensorRead();
-	Print_Measure(Measure, 14, 30);
+	//The statistics are frozen together with the value
+	HeldStats = SessionStats;
+	if(StatsOverlay)
+		Print_Statistics(&HeldStats, Measure);
+	else
+		Print_Measure(Measure, 14, 30);
 	wait_until_press(Ok);
 	Configs.Last_Mode = Hold;
 	comeFromMenu = false;
 }
 
 
+//Holds the reading by itself once the sensor has settled
+void Auto_hold_mode(void)
+{
+	char Buffer[19];
+	Sample New;
+	bool Settled = false;
+
+	HAL_IWDG_Refresh(&hiwdg);
+	if(Configs.Last_Mode != Auto_Hold || comeFromMenu)
+	{
+		SSD1306_Clear();
+		SSD1306_GotoXY(36, 8);
+		SSD1306_Puts("Valor", &Font_11x18, 1);
+		SSD1306_GotoXY(32, 53);
+		SSD1306_Puts("Auto Hold", &Font_7x10, 1);
+		Display_Update();
+		Sensor_Fastest();
+		AutoHold_Start(&AutoHoldState);
+		Acquisition_ReaderInit(&AutoHoldReader);
+	}
+	while(!Settled && Acquisition_Pop(&AutoHoldReader, &New))
+		Settled = AutoHold_Update(&AutoHoldState, &AutoHoldSettings, New.Lux, New.Timestamp);
+	if(Settled)
+	{
+		Print_Measure(AutoHoldState.Value, 14, 30);
+		sprintf(Buffer, "Cf %3d%% +-%3d.%01d", AutoHoldState.Confidence, (int) AutoHoldState.StdDev, (int) (AutoHoldState.StdDev * 10) % 10);
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "t%3d.%02ds avg%2d.%02ds", (int) (AutoHoldState.TimeToHold / 1000000), (int) (AutoHoldState.TimeToHold / 10000) % 100,
+				(int) (AutoHold_AverageTimeToHold(&AutoHoldState) / 1000000), (int) (AutoHold_AverageTimeToHold(&AutoHoldState) / 10000) % 100);
+		SSD1306_GotoXY(0, 53);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		Display_Update();
+		wait_until_press(Ok);
+		//Arm again
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts("               ", &Font_7x10, 1);
+		SSD1306_GotoXY(0, 53);
+		SSD1306_Puts("                  ", &Font_7x10, 1);
+		SSD1306_GotoXY(32, 53);
+		SSD1306_Puts("Auto Hold", &Font_7x10, 1);
+		AutoHold_Start(&AutoHoldState);
+		Acquisition_ReaderInit(&AutoHoldReader);
+	}
+	else if(!AutoHoldState.Held)
+	{
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts("Settling...", &Font_7x10, 1);
+		Display_Update();
+	}
+	Configs.Last_Mode = Auto_Hold;
+	comeFromMenu = false;
+}
+
+//Thresholds edition and review of the last crossing
+void Threshold_alarm_mode(void)
+{
+	static uint32_t Past_IDR_Read = 0xFF;
+	static uint16_t Field = 0;
+	char Buffer[19];
+	const char StateNames[3][5] = {"Ok", "High", "Low"};
+	const uint16_t GraphTop = 34;
+	const uint16_t GraphHeight = 29;
+	uint16_t *Fields[3] = {&AlarmSettings.High, &AlarmSettings.Low, &AlarmSettings.Hysteresis};
+	const uint16_t Steps[3] = {10, 10, 5};
+	const uint16_t Limits[3] = {MaxAlarmHigh, MaxAlarmLow, MaxAlarmHysteresis};
+	float Min, Max;
+	uint16_t x0, y0, x1, y1;
+
+	HAL_IWDG_Refresh(&hiwdg);
+	if(Configs.Last_Mode != Threshold_Alarm || comeFromMenu)
+		SSD1306_Clear();
+	//Ok selects the field, Up & Down change it
+	IDR_Read = (GPIOA -> IDR & ReadMask);
+	if(Past_IDR_Read != IDR_Read)
+	{
+		switch(IDR_Read)
+		{
+			case Ok:
+				Field = (Field + 1) % 3;
+			break;
+			case Up:
+				if(*Fields[Field] + Steps[Field] <= Limits[Field])
+					*Fields[Field] += Steps[Field];
+			break;
+			case Down:
+				*Fields[Field] = (*Fields[Field] > Steps[Field]) ? *Fields[Field] - Steps[Field] : 0;
+			break;
+		}
+	}
+	Past_IDR_Read = IDR_Read;
+	//The field being set is inverted
+	sprintf(Buffer, "H%5d", AlarmSettings.High);
+	SSD1306_GotoXY(0, 0);
+	SSD1306_Puts(Buffer, &Font_7x10, Field != 0);
+	sprintf(Buffer, "L%4d", AlarmSettings.Low);
+	SSD1306_GotoXY(42, 0);
+	SSD1306_Puts(Buffer, &Font_7x10, Field != 1);
+	sprintf(Buffer, "h%3d", AlarmSettings.Hysteresis);
+	SSD1306_GotoXY(77, 0);
+	SSD1306_Puts(Buffer, &Font_7x10, Field != 2);
+	sprintf(Buffer, "%-4s %4d/%4dus", StateNames[AlarmInfo.State], (int) AlarmInfo.Latency, (int) AlarmInfo.MaxLatency);
+	SSD1306_GotoXY(0, 11);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	sprintf(Buffer, "Cross %5d >%3dus", (int) AlarmInfo.Crossings, AlarmLatencyBound);
+	SSD1306_GotoXY(0, 22);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	//Last complete capture, the crossing is the dotted line
+	if(Alarm_GetCapture(&AlarmReview) && AlarmReview.Filled > 1)
+	{
+		SSD1306_DrawFilledRectangle(0, GraphTop, 127, GraphHeight, 0);
+		Min = Max = AlarmReview.Samples[0].Lux;
+		for(uint16_t Index = 1; Index < AlarmReview.Filled; Index++)
+		{
+			if(AlarmReview.Samples[Index].Lux < Min)
+				Min = AlarmReview.Samples[Index].Lux;
+			if(AlarmReview.Samples[Index].Lux > Max)
+				Max = AlarmReview.Samples[Index].Lux;
+		}
+		if(Max - Min < 1)
+			Max = Min + 1;
+		for(uint16_t Index = 1; Index < AlarmReview.Filled; Index++)
+		{
+			x0 = ((Index - 1) * 127) / (AlarmCaptureSize - 1);
+			x1 = (Index * 127) / (AlarmCaptureSize - 1);
+			y0 = GraphTop + GraphHeight - (uint16_t) (((AlarmReview.Samples[Index - 1].Lux - Min) * GraphHeight) / (Max - Min));
+			y1 = GraphTop + GraphHeight - (uint16_t) (((AlarmReview.Samples[Index].Lux - Min) * GraphHeight) / (Max - Min));
+			SSD1306_DrawLine(x0, y0, x1, y1, 1);
+		}
+		x0 = (AlarmReview.Trigger * 127) / (AlarmCaptureSize - 1);
+		for(y0 = GraphTop; y0 <= GraphTop + GraphHeight; y0 += 2)
+			SSD1306_DrawPixel(x0, y0, 1);
+	}
+	HAL_IWDG_Refresh(&hiwdg);
+	Display_Update();
+	Configs.Last_Mode = Threshold_Alarm;
+	comeFromMenu = false;
+}
+
+//Fast transients, the ISR fills the buffer and the screen is left alone until it's done
+void Burst_capture_mode(void)
+{
+	static uint32_t Past_IDR_Read = 0xFF;
+	static bool Triggered = true;
+	static bool Shown = false;
+	char Buffer[19];
+	const uint16_t GraphTop = 11;
+	const uint16_t GraphHeight = 41;
+	const uint16_t BurstTrigger = 20; //lux
+	uint32_t Duration, Seconds;
+	float Min, Max;
+	uint16_t x0, y0, x1, y1;
+
+	HAL_IWDG_Refresh(&hiwdg);
+	if(Configs.Last_Mode != Burst_Capture || comeFromMenu)
+	{
+		Sensor_Fastest();
+		Burst_Init(&BurstCapture);
+		Shown = false;
+		Past_IDR_Read = (GPIOA -> IDR & ReadMask); //The Ok that closed the menu doesn't arm it
+		SSD1306_Clear();
+		SSD1306_GotoXY(CenterXPrint("Burst", 0, 128, Font_11x18), 8);
+		SSD1306_Puts("Burst", &Font_11x18, 1);
+		SSD1306_GotoXY(0, 42);
+		SSD1306_Puts("Ok starts", &Font_7x10, 1);
+		SSD1306_GotoXY(0, 53);
+		SSD1306_Puts(Triggered ? "Up: on change" : "Up: now      ", &Font_7x10, 1);
+		Display_Update();
+	}
+	//Up swaps the trigger, Ok arms the capture
+	IDR_Read = (GPIOA -> IDR & ReadMask);
+	if(Past_IDR_Read != IDR_Read && BurstCapture.State != Burst_Armed && BurstCapture.State != Burst_Recording)
+	{
+		switch(IDR_Read)
+		{
+			case Up:
+				Triggered = !Triggered;
+				SSD1306_GotoXY(0, 53);
+				SSD1306_Puts(Triggered ? "Up: on change" : "Up: now      ", &Font_7x10, 1);
+				Display_Update();
+			break;
+			case Ok:
+				SSD1306_Clear();
+				SSD1306_GotoXY(CenterXPrint("Capturing", 0, 128, Font_7x10), 27);
+				SSD1306_Puts("Capturing", &Font_7x10, 1);
+				Display_Update();
+				Shown = false;
+				Burst_Arm(&BurstCapture, BurstSize * BH1750_ConversionTime(Low_Res), Triggered ? BurstTrigger : 0);
+			break;
+		}
+	}
+	Past_IDR_Read = IDR_Read;
+	if(BurstCapture.State == Burst_Done && !Shown)
+	{
+		Shown = true;
+		Duration = Burst_Duration(&BurstCapture);
+		Min = Max = BurstCapture.Samples[0].Lux;
+		for(uint16_t Index = 1; Index < BurstCapture.Count; Index++)
+		{
+			if(BurstCapture.Samples[Index].Lux < Min)
+				Min = BurstCapture.Samples[Index].Lux;
+			if(BurstCapture.Samples[Index].Lux > Max)
+				Max = BurstCapture.Samples[Index].Lux;
+		}
+		SSD1306_Clear();
+		sprintf(Buffer, "%5d-%5dlx", (int) Min, (int) Max);
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		if(Max - Min < 1)
+			Max = Min + 1;
+		for(uint16_t Index = 1; Index < BurstCapture.Count && Duration; Index++)
+		{
+			x0 = (uint16_t) (((uint64_t) (BurstCapture.Samples[Index - 1].Timestamp - BurstCapture.Samples[0].Timestamp) * 127) / Duration);
+			x1 = (uint16_t) (((uint64_t) (BurstCapture.Samples[Index].Timestamp - BurstCapture.Samples[0].Timestamp) * 127) / Duration);
+			y0 = GraphTop + GraphHeight - (uint16_t) (((BurstCapture.Samples[Index - 1].Lux - Min) * GraphHeight) / (Max - Min));
+			y1 = GraphTop + GraphHeight - (uint16_t) (((BurstCapture.Samples[Index].Lux - Min) * GraphHeight) / (Max - Min));
+			SSD1306_DrawLine(x0, y0, x1, y1, 1);
+		}
+		Seconds = Duration / 10000;
+		sprintf(Buffer, "%3d %d.%02ds %2dms", BurstCapture.Count, (int) Seconds / 100, (int) Seconds % 100, (int) (Burst_MaxInterval(&BurstCapture) / 1000));
+		SSD1306_GotoXY(0, 54);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		HAL_IWDG_Refresh(&hiwdg);
+		Display_Update();
+	}
+	Configs.Last_Mode = Burst_Capture;
+	comeFromMenu = false;
+}
+
 //@TODO Initial configurations done, print in sequence time, do first the config menu
 void Plot_mode(void)
 {
@@ -450,7 +943,7 @@ void Plot_mode(void)
 		//Y Arrow
 		SSD1306_DrawFilledTriangle(YAxis_Offset-3, YAxis_LimitUP+5, YAxis_Offset+3, YAxis_LimitUP+5, YAxis_Offset, YAxis_LimitUP, 1);
 		HAL_IWDG_Refresh(&hiwdg);
-		SSD1306_UpdateScreen();
+		Display_Update();
 		switch(GlobalConfigs.PlotType)
 		{
 			case BothAxis:
@@ -487,7 +980,7 @@ void Print_OkToContinue(uint16_t XOffset, uint16_t YLimit)
 	SSD1306_Puts("to start", &Font_7x10, 1);
 	SSD1306_GotoXY(XCoordinate, YInitialCoordinate + (CharYDim*2) + YPixelStep);
 	SSD1306_Puts("the plot", &Font_7x10, 1);
-	SSD1306_UpdateScreen();
+	Display_Update();
 	wait_until_press(Ok);
 	SSD1306_GotoXY(XCoordinate, YInitialCoordinate);
 	SSD1306_Puts("        ", &Font_7x10, 1);
@@ -495,7 +988,7 @@ void Print_OkToContinue(uint16_t XOffset, uint16_t YLimit)
 	SSD1306_Puts("        ", &Font_7x10, 1);
 	SSD1306_GotoXY(XCoordinate, YInitialCoordinate + (CharYDim*2) + YPixelStep);
 	SSD1306_Puts("        ", &Font_7x10, 1);
-	SSD1306_UpdateScreen();
+	Display_Update();
 }
 
 //@TODO Solve cursor bugs, all the other stages
@@ -561,7 +1054,7 @@ void Config_plot_mode(void)
 			SSD1306_Clear();
 			SSD1306_GotoXY(CenterXPrint("Fatal Error, code: 0xAF", 0, 128, Font_11x18), 20);
 			SSD1306_Puts("Fatal Error, code: 0xAF", &Font_11x18, 1);
-			SSD1306_UpdateScreen();
+			Display_Update();
 			return;
 		}
 		else
@@ -577,7 +1070,7 @@ void Config_plot_mode(void)
 			SSD1306_Clear();
 			SSD1306_GotoXY(CenterXPrint("Fatal Error, code: 0xAA", 0, 128, Font_11x18), 20);
 			SSD1306_Puts("Fatal Error, code: 0xAA", &Font_11x18, 1);
-			SSD1306_UpdateScreen();
+			Display_Update();
 			return;
 		}
 		else
@@ -597,7 +1090,7 @@ void Config_plot_mode(void)
 		SSD1306_Puts(GeneralBuffers.ResBuffer, &Font_7x10, 1);
 		SSD1306_GotoXY(XOffset + (NumberOfCharsUsed((char *) GeneralBuffers.SamplePrint, false) * 7) + 5, 25);
 		SSD1306_Puts(GeneralBuffers.SampleBuffer, &Font_7x10, 1);
-		SSD1306_UpdateScreen();
+		Display_Update();
 	}
 	//Start the configuration
 	HAL_IWDG_Refresh(&hiwdg);
@@ -696,7 +1189,7 @@ void Config_plot_mode(void)
 						default:
 						break;
 					}
-					SSD1306_UpdateScreen();
+					Display_Update();
 					Timer_Delay_50ms(1);
 				}
 				else
@@ -709,7 +1202,7 @@ void Config_plot_mode(void)
 			SSD1306_DrawRectangle(XOffset - 2, ResY - 3, (NumberOfCharsUsed((char *) GeneralBuffers.ResolutionPrint, false) * 7) + 3, 13, 0);
 			//Draw cursor on the number
 			SSD1306_DrawRectangle(XOffset + (NumberOfCharsUsed((char *) GeneralBuffers.ResolutionPrint, false) * 7) - 2, ResY - 3, (NumberOfCharsUsed((char *) GeneralBuffers.ResBuffer, false) * 7) + 3, 13, 1);
-			SSD1306_UpdateScreen();
+			Display_Update();
 		break;
 		case SampleTime:
 		break;
@@ -743,8 +1236,12 @@ void Reset_sensor_mode(void)
 	switch(Sensor)
 	{
 		case _BH1750:
-			if(BH1750_ReCalibrate(&BH1750) != Rojo_OK)
+			Acquisition_Stop();
+			if(BH1750_ReCalibrate(&BH1750) != Rojo_OK ||
+			   BH1750_ContinuousStart(&BH1750, BH1750.Resolution) != Rojo_OK)
 				Fatal_Error_BH1750();
+			Acquisition_Start();
+			SensorLevel = Rate_Levels;
 		break;
 		case _TSL2561:
 		break;
@@ -757,7 +1254,7 @@ void Reset_sensor_mode(void)
 	SSD1306_Puts("Press OK", &Font_7x10, 1);
 	SSD1306_GotoXY(25, 41);
 	SSD1306_Puts("to continue", &Font_7x10, 1);
-	SSD1306_UpdateScreen();
+	Display_Update();
 	wait_until_press(Ok);
 	if(Configs.Last_Mode == Reset_Sensor)
 		Configs.Last_Mode = Continuous;
@@ -765,11 +1262,661 @@ void Reset_sensor_mode(void)
 	Configs.Last_Mode = Reset_Sensor;
 }
 
-//@TODO All select sensor mode
-void Select_sensor_mode(void);
-//@TODO All select diode sensor mode
-void Select_diode_mode(void);
+//Uniformity between the measurement heads
+void Select_sensor_mode(void)
+{
+	static uint32_t Swept = 0; //Reads of the main head when the last sweep ran
+	char Buffer[17];
+	float HeadMeasure;
+	Sample Latest;
+	bool Failed[NumberOfHeads];
+	uint32_t Reads = AcqStatus.Samples + AcqStatus.ReadErrors;
+	const uint16_t HeadsY = 54;
+	const uint16_t HeadStep = 24;
+
+	HAL_IWDG_Refresh(&hiwdg);
+	if(Configs.Last_Mode != Select_Sensor || comeFromMenu)
+	{
+		Uniformity_Init(&UniformityMetrics);
+		SSD1306_Clear();
+		SSD1306_GotoXY(CenterXPrint("Uniformity", 0, 128, Font_7x10), 0);
+		SSD1306_Puts("Uniformity", &Font_7x10, 1);
+		for(uint16_t Head = 0; Head < NumberOfHeads; Head++)
+		{
+			sprintf(Buffer, "H%d", Head + 1);
+			SSD1306_GotoXY(4 + (Head * HeadStep), HeadsY);
+			SSD1306_Puts(Buffer, &Font_7x10, 1);
+		}
+		Display_Update();
+	}
+	//One sweep per read of the main head, which the acquisition clock already samples. Right after
+	//it, so holding the ISR off I2C2 while the other heads are read only delays its next sample
+	if(Reads != Swept || comeFromMenu)
+	{
+		Swept = Reads;
+		Failed[0] = AcqStatus.LastReadFailed || !Acquisition_Latest(&Latest);
+		if(!Failed[0])
+			Uniformity_Update(&UniformityMetrics, 0, Latest.Lux);
+		Acquisition_Stop();
+		for(uint16_t Head = 1; Head < NumberOfHeads; Head++)
+		{
+			Failed[Head] = true;
+			switch(Sensor)
+			{
+				case _BH1750:
+					Failed[Head] = BH1750_ContinuousRead(Heads[Head], &HeadMeasure) != Rojo_OK;
+					if(!Failed[Head])
+						Uniformity_Update(&UniformityMetrics, Head, HeadMeasure);
+				break;
+				case _TSL2561:
+				break;
+			}
+			HAL_IWDG_Refresh(&hiwdg);
+		}
+		Acquisition_Start();
+		//A head that didn't answer is shown inverted, it's left out of the sweep
+		for(uint16_t Head = 0; Head < NumberOfHeads; Head++)
+		{
+			sprintf(Buffer, "H%d", Head + 1);
+			SSD1306_DrawFilledRectangle(3 + (Head * HeadStep), HeadsY, 15, 8, Failed[Head]);
+			SSD1306_GotoXY(4 + (Head * HeadStep), HeadsY);
+			SSD1306_Puts(Buffer, &Font_7x10, !Failed[Head]);
+		}
+		if(Uniformity_Publish(&UniformityMetrics))
+		{
+			Print_SmallValue("Min", UniformityMetrics.Emin, 0, 11);
+			Print_SmallValue("Avg", UniformityMetrics.Eavg, 0, 22);
+			Print_SmallValue("Max", UniformityMetrics.Emax, 0, 33);
+			sprintf(Buffer, "U0 %d.%02d Ud %d.%02d",
+					(int) UniformityMetrics.U0, (int) (UniformityMetrics.U0 * 100) % 100,
+					(int) UniformityMetrics.Ud, (int) (UniformityMetrics.Ud * 100) % 100);
+			SSD1306_GotoXY(0, 44);
+			SSD1306_Puts(Buffer, &Font_7x10, 1);
+			//Highlight the weakest head
+			for(uint16_t Head = 0; Head < NumberOfHeads; Head++)
+				SSD1306_DrawRectangle(2 + (Head * HeadStep), HeadsY - 1, 17, 10, Head == UniformityMetrics.WeakestHead);
+		}
+		HAL_IWDG_Refresh(&hiwdg);
+		Display_Update();
+	}
+	Configs.Last_Mode = Select_Sensor;
+	comeFromMenu = false;
+}
+
+//Photodiode on PA6, ADC at 9.6kHz decimated to 100Hz
+void Select_diode_mode(void)
+{
+	static uint32_t Rate = 0;
+	static uint16_t Load = 0;
+	char Buffer[27]; //Worst case of the throughput line, wider than the 18 characters shown
+	uint16_t Trace[PhotodiodeHistory];
+	uint16_t Value, Count, Min, Max, Span;
+	uint32_t Millivolts;
+	const uint16_t GraphTop = 44;
+	const uint16_t GraphHeight = 19;
+	const uint16_t Step = 128 / PhotodiodeHistory;
+
+	HAL_IWDG_Refresh(&hiwdg);
+	if(Configs.Last_Mode != Select_Diode || comeFromMenu)
+	{
+		SSD1306_Clear();
+		SSD1306_GotoXY(CenterXPrint("Photodiode", 0, 128, Font_7x10), 0);
+		SSD1306_Puts("Photodiode", &Font_7x10, 1);
+		Display_Update();
+		Photodiode_Start();
+	}
+	if(Photodiode_Latest(&Value))
+	{
+		//Q4 counts to mV of the 3.3V reference
+		Millivolts = ((uint32_t) Value * 3300) / (PhotodiodeFullScale << 4);
+		snprintf(Buffer, sizeof(Buffer), "%5dmV", (int) Millivolts);
+		SSD1306_GotoXY(14, 12);
+		SSD1306_Puts(Buffer, &Font_11x18, 1);
+	}
+	Photodiode_Throughput(&Rate, &Load);
+	snprintf(Buffer, sizeof(Buffer), "%5dHz %2d.%01d%% ov%d", (int) Rate, Load / 10, Load % 10, (int) (DiodeStatus.Overruns % 100));
+	SSD1306_GotoXY(0, 32);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	//Decimated trace, autoscaled
+	Count = Photodiode_History(Trace, PhotodiodeHistory);
+	SSD1306_DrawFilledRectangle(0, GraphTop, 127, GraphHeight, 0);
+	if(Count > 1)
+	{
+		Min = Max = Trace[0];
+		for(uint16_t Index = 1; Index < Count; Index++)
+		{
+			if(Trace[Index] < Min)
+				Min = Trace[Index];
+			if(Trace[Index] > Max)
+				Max = Trace[Index];
+		}
+		Span = (Max - Min) ? (Max - Min) : 1;
+		for(uint16_t Index = 1; Index < Count; Index++)
+			SSD1306_DrawLine((Index - 1) * Step, GraphTop + GraphHeight - ((uint32_t) (Trace[Index - 1] - Min) * GraphHeight) / Span,
+					Index * Step, GraphTop + GraphHeight - ((uint32_t) (Trace[Index] - Min) * GraphHeight) / Span, 1);
+	}
+	HAL_IWDG_Refresh(&hiwdg);
+	Display_Update();
+	Configs.Last_Mode = Select_Diode;
+	comeFromMenu = false;
+}
+
+//Percent flicker, flicker index and dominant frequency of the photodiode
+void Flicker_metrics_mode(void)
+{
+	char Buffer[19];
+	FlickerMetrics Metrics;
+	const uint16_t BarsBottom = 63;
+	const uint16_t BarsHeight = 17;
+	const uint16_t BarWidth = 128 / FlickerBins;
+	uint16_t Height;
+
+	HAL_IWDG_Refresh(&hiwdg);
+	if(Configs.Last_Mode != Flicker_Metrics || comeFromMenu)
+	{
+		SSD1306_Clear();
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts("Flicker", &Font_7x10, 1);
+		Display_Update();
+		Photodiode_Stop(); //The ISR can't be in the middle of a window while it's cleared
+		Flicker_Init(&FlickerMeter);
+		Photodiode_Start();
+		Configs.Last_Mode = Flicker_Metrics;
+		comeFromMenu = false;
+	}
+	if(!Flicker_Get(&FlickerMeter, &Metrics))
+		return;
+	sprintf(Buffer, "%5dcy", (int) DiodeStatus.MaxCycles);
+	SSD1306_GotoXY(56, 0);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	sprintf(Buffer, "Pct   %3d.%01d%%", Metrics.PercentFlicker / 10, Metrics.PercentFlicker % 10);
+	SSD1306_GotoXY(0, 12);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	sprintf(Buffer, "Index %d.%03d", Metrics.Index / 1000, Metrics.Index % 1000);
+	SSD1306_GotoXY(0, 23);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	if(Metrics.Frequency)
+		sprintf(Buffer, "Freq  %3dHz", Metrics.Frequency);
+	else
+		sprintf(Buffer, "Freq  none ");
+	SSD1306_GotoXY(0, 34);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	//Modulation of every bin, full height is 100%
+	for(uint16_t Bin = 0; Bin < FlickerBins; Bin++)
+	{
+		Height = (Metrics.Modulation[Bin] >= 1000) ? BarsHeight : (Metrics.Modulation[Bin] * BarsHeight) / 1000;
+		if(Metrics.Modulation[Bin] >= FlickerMinModulation && !Height)
+			Height = 1;
+		SSD1306_DrawFilledRectangle(Bin * BarWidth, BarsBottom - BarsHeight, BarWidth - 3, BarsHeight, 0);
+		if(Height)
+			SSD1306_DrawFilledRectangle(Bin * BarWidth, BarsBottom - Height, BarWidth - 3, Height, 1);
+	}
+	HAL_IWDG_Refresh(&hiwdg);
+	Display_Update();
+	Configs.Last_Mode = Flicker_Metrics;
+	comeFromMenu = false;
+}
 
+//Minimum, maximum and mean of a window of the log, from its index
+void History_mode(void)
+{
+	static uint32_t Past_IDR_Read = 0xFF;
+	static uint16_t Width = 0;
+	static uint16_t Back = 0;    //Windows before the current one
+	static uint32_t LastQuery = 0;
+	char Buffer[19];
+	const char WidthNames[4][4] = {"1m", "5m", "15m", "1h"};
+	const uint32_t Widths[4] = {60000, 300000, 900000, 3600000}; //ms
+	uint32_t Span = Logger_Span(&MeasureLog); //0 without the EEPROM
+	uint16_t Last;
+	bool Query = false;
+#ifndef ECONOMIC_VERSION
+	LogRange Range;
+	uint32_t To, From, Reads, Start, Mean;
+#endif
+
+	HAL_IWDG_Refresh(&hiwdg);
+	if(Configs.Last_Mode != History || comeFromMenu)
+		Query = true;
+	//Up goes a window back, Down forward, Ok changes the width
+	IDR_Read = (GPIOA -> IDR & ReadMask);
+	if(Past_IDR_Read != IDR_Read)
+	{
+		switch(IDR_Read)
+		{
+			case Up:
+				Back++;
+				Query = true;
+			break;
+			case Down:
+				if(Back)
+					Back--;
+				Query = true;
+			break;
+			case Ok:
+				Width = (Width + 1) % 4;
+				if(Widths[Width] > Span)
+					Width = 0;
+				Back = 0;
+				Query = true;
+			break;
+		}
+	}
+	Past_IDR_Read = IDR_Read;
+	//The windows stay on the blocks of the log, a width over its span would show the same records as a shorter one
+	while(Width && Widths[Width] > Span)
+		Width--;
+	Last = Span ? (Span - 1) / Widths[Width] : 0;
+	if(Back > Last)
+		Back = Last;
+	//Again every record, the window follows the clock
+	if(!Query && HAL_GetTick() - LastQuery < LogPeriod)
+		return;
+	LastQuery = HAL_GetTick();
+	SSD1306_Clear();
+	sprintf(Buffer, "Win %-3s back%3d", WidthNames[Width], Back);
+	SSD1306_GotoXY(0, 0);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+#ifdef ECONOMIC_VERSION
+	SSD1306_GotoXY(0, 11);
+	SSD1306_Puts("No EEPROM", &Font_7x10, 1);
+#else
+	To = Logger_Now(&MeasureLog) - Back * Widths[Width];
+	From = (To > Widths[Width]) ? To - Widths[Width] : 0;
+	Reads = MeasureLog.Reads;
+	Start = DWT -> CYCCNT;
+	if(Logger_Range(&MeasureLog, From, To, &Range))
+	{
+		Start = (DWT -> CYCCNT - Start) / (SystemCoreClock / 1000000);
+		Mean = (uint32_t) (Range.Sum / Range.Count);
+		sprintf(Buffer, "Min %7d.%dlx", (int) (Range.Min / 10), (int) (Range.Min % 10));
+		SSD1306_GotoXY(0, 11);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Max %7d.%dlx", (int) (Range.Max / 10), (int) (Range.Max % 10));
+		SSD1306_GotoXY(0, 22);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Avg %7d.%dlx", (int) (Mean / 10), (int) (Mean % 10));
+		SSD1306_GotoXY(0, 33);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		//Records, blocks read and the time of the query
+		sprintf(Buffer, "N%5d r%d %6dus", (int) Range.Count, (int) (MeasureLog.Reads - Reads), (int) Start);
+		SSD1306_GotoXY(0, 54);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+	}
+	else
+	{
+		SSD1306_GotoXY(0, 11);
+		SSD1306_Puts("No records", &Font_7x10, 1);
+	}
+#endif
+	HAL_IWDG_Refresh(&hiwdg);
+	Display_Update();
+	Configs.Last_Mode = History;
+	comeFromMenu = false;
+}
+
+
+//Acquisition timing, histogram of the sample interval jitter
+void Diagnostics_mode(void)
+{
+	char Buffer[22];
+	uint32_t Peak = 1;
+	uint16_t Height;
+	const uint16_t BarsBottom = 63;
+	const uint16_t BarsHeight = 40;
+	const uint16_t BarWidth = 128 / JitterBins;
+
+	static uint32_t Past_IDR_Read = 0xFF;
+	static uint16_t Page = 0;
+	const char LevelNames[Rate_Levels][10] = {"Heartbeat", "Normal", "Fast"};
+	RateEstimate Estimate;
+	static I2cMasterComparison Comparison;
+#ifndef ECONOMIC_VERSION
+	const uint16_t Deadbands[7] = {0, 1, 5, 10, 50, 100, MaxLogDeadband};
+	uint16_t Step;
+#endif
+
+	HAL_IWDG_Refresh(&hiwdg);
+	//Up goes through the jitter, sampling rate, errors, I2C, I2C queue, I2C traffic, log, export and HAL/LL pages
+	IDR_Read = (GPIOA -> IDR & ReadMask);
+	if(Past_IDR_Read != IDR_Read && IDR_Read == Up)
+	{
+		Page = (Page + 1) % 9;
+		SSD1306_Clear();
+	}
+#ifndef ECONOMIC_VERSION
+	else if(Past_IDR_Read != IDR_Read && IDR_Read == Down && Page == 6)
+	{
+		//Next deadband, kept with the rest of the configurations
+		for(Step = 0; Step < 6 && Deadbands[Step] <= LogDeadband; Step++);
+		LogDeadband = (Deadbands[Step] > LogDeadband) ? Deadbands[Step] : 0;
+		Logger_Deadband(&MeasureLog, LogDeadband);
+		Configs_save();
+	}
+#endif
+	else if(Past_IDR_Read != IDR_Read && IDR_Read == Down && Page == 8 && Sensor == _BH1750)
+	{
+		//Same 2 byte reads of the sensor both ways, the acquisition ISR is held off the bus meanwhile
+		Acquisition_Stop();
+		I2cMaster_Compare(BH1750.I2C, BH1750.Address, 2, 32, BH1750_ReadTimeout, &Comparison);
+		Acquisition_Start();
+	}
+	Past_IDR_Read = IDR_Read;
+	if(Configs.Last_Mode != Diagnostics || comeFromMenu)
+		SSD1306_Clear();
+	if(Page == 8)
+	{
+		//Cycles and us per sensor read, CPU share of the reads at the running sample period
+		const uint32_t Mhz = SystemCoreClock / 1000000;
+		uint32_t Period = Acquisition_GetPeriod();
+		uint32_t HalLoad = (uint32_t) (((uint64_t) Comparison.HalCycles * 10000) / ((uint64_t) Period * Mhz));
+		uint32_t LlLoad = (uint32_t) (((uint64_t) Comparison.LlCycles * 10000) / ((uint64_t) Period * Mhz));
+
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts("Read   HAL   LL", &Font_7x10, 1);
+		sprintf(Buffer, "cy %6d %6d", (int) Comparison.HalCycles, (int) Comparison.LlCycles);
+		SSD1306_GotoXY(0, 11);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "us %6d %6d", (int) (Comparison.HalCycles / Mhz), (int) (Comparison.LlCycles / Mhz));
+		SSD1306_GotoXY(0, 22);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "CPU%3d.%02d %3d.%02d", (int) (HalLoad / 100), (int) (HalLoad % 100), (int) (LlLoad / 100),
+				(int) (LlLoad % 100));
+		SSD1306_GotoXY(0, 33);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Period %7dus", (int) Period);
+		SSD1306_GotoXY(0, 44);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Down:run %2d %3d", (int) Comparison.Runs, (int) Comparison.Failures);
+		SSD1306_GotoXY(0, 54);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		HAL_IWDG_Refresh(&hiwdg);
+		Display_Update();
+		Configs.Last_Mode = Diagnostics;
+		comeFromMenu = false;
+		return;
+	}
+	if(Page == 7)
+	{
+		//Serial export: frames, link use against its capacity, samples lost while it was busy
+		sprintf(Buffer, "Export %7d", ExportBaud);
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Frames %9d", (int) SerialExport.Sent);
+		SSD1306_GotoXY(0, 11);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "%6d/%6dB/s", (int) SerialExport.BytesPerSecond, ExportBaud / 10);
+		SSD1306_GotoXY(0, 22);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Lost %6d", (int) SerialExport.Reader.Lost);
+		SSD1306_GotoXY(0, 33);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Dumped %5d blk", (int) SerialExport.Blocks);
+		SSD1306_GotoXY(0, 44);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		HAL_IWDG_Refresh(&hiwdg);
+		Display_Update();
+		Configs.Last_Mode = Diagnostics;
+		comeFromMenu = false;
+		return;
+	}
+	if(Page == 6)
+	{
+		//Records through the deadband, stored and their bytes, encode cost
+		sprintf(Buffer, "Log band%3d.%dlx", LogDeadband / 10, LogDeadband % 10);
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+#ifdef ECONOMIC_VERSION
+		SSD1306_GotoXY(0, 11);
+		SSD1306_Puts("No EEPROM", &Font_7x10, 1);
+#else
+		sprintf(Buffer, "In %6d Out%5d", (int) MeasureLog.Door.Points, (int) MeasureLog.Door.Stored);
+		SSD1306_GotoXY(0, 11);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		Step = MeasureLog.Door.Stored ? (MeasureLog.Door.Points * 10) / MeasureLog.Door.Stored : 0;
+		sprintf(Buffer, "Ratio %4d.%dx", Step / 10, Step % 10);
+		SSD1306_GotoXY(0, 22);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Blk %3d %6dB", (int) MeasureLog.Blocks, (int) MeasureLog.EncodedBytes);
+		SSD1306_GotoXY(0, 33);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Enc %4d/%5dcy", MeasureLog.Puts ? (int) (MeasureLog.EncodeCycles / MeasureLog.Puts) : 0,
+				(int) MeasureLog.MaxEncodeCycles);
+		SSD1306_GotoXY(0, 44);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		SSD1306_GotoXY(0, 54);
+		SSD1306_Puts("Down: band", &Font_7x10, 1);
+#endif
+		HAL_IWDG_Refresh(&hiwdg);
+		Display_Update();
+		Configs.Last_Mode = Diagnostics;
+		comeFromMenu = false;
+		return;
+	}
+	if(Page == 5)
+	{
+		//Per device: bytes per second and the share of the bus, transactions and errors per second
+		for(uint16_t Index = 0; Index < I2cDeviceCount && Index < 3; Index++)
+		{
+			sprintf(Buffer, "%-4s%6dB %3d.%d%%", I2cDevices[Index].Name, (int) I2cDevices[Index].BytesPerSecond,
+					I2cDevices[Index].BusyPerMille / 10, I2cDevices[Index].BusyPerMille % 10);
+			SSD1306_GotoXY(0, Index * 22);
+			SSD1306_Puts(Buffer, &Font_7x10, 1);
+			sprintf(Buffer, "  %4dt/s err%4d", (int) I2cDevices[Index].TransactionsPerSecond, (int) I2cDevices[Index].ErrorsPerSecond);
+			SSD1306_GotoXY(0, Index * 22 + 11);
+			SSD1306_Puts(Buffer, &Font_7x10, 1);
+		}
+		HAL_IWDG_Refresh(&hiwdg);
+		Display_Update();
+		Configs.Last_Mode = Diagnostics;
+		comeFromMenu = false;
+		return;
+	}
+	if(Page == 4)
+	{
+		//Per priority: completed and the longest wait, then the throughput
+		const char PriorityNames[I2cPriorities][4] = {"Sen", "Dsp", "Sto"};
+		uint32_t Bytes, Transactions;
+
+		sprintf(Buffer, "Queue %2d/%2d %3d", I2cQueues[0].Depth, I2cQueues[0].MaxDepth, (int) I2cQueues[0].Dropped);
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		for(uint16_t Priority = 0; Priority < I2cPriorities; Priority++)
+		{
+			sprintf(Buffer, "%s %5d %5du", PriorityNames[Priority], (int) I2cQueues[0].Stats[Priority].Completed,
+					(int) I2cQueues[0].Stats[Priority].WaitMax);
+			SSD1306_GotoXY(0, 11 + Priority * 11);
+			SSD1306_Puts(Buffer, &Font_7x10, 1);
+		}
+		//Sensor bus on the register level master, against the 400kHz ceiling
+		Bytes = I2cMaster_Throughput(&hi2c2);
+		sprintf(Buffer, "LL %5dB/s %3d%%", (int) Bytes, (int) ((Bytes * 100) / I2cMasterCeiling));
+		SSD1306_GotoXY(0, 44);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		I2cQueue_Throughput(&hi2c1, &Bytes, &Transactions);
+		sprintf(Buffer, "%5dB/s %4dt/s", (int) Bytes, (int) Transactions);
+		SSD1306_GotoXY(0, 54);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		HAL_IWDG_Refresh(&hiwdg);
+		Display_Update();
+		Configs.Last_Mode = Diagnostics;
+		comeFromMenu = false;
+		return;
+	}
+	if(Page == 3)
+	{
+		//Per device NACKs and bus faults, per bus recoveries, stuck lines and the longest recovery
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts("I2C  Nack   Bus", &Font_7x10, 1);
+		for(uint16_t Index = 0; Index < I2cDeviceCount && Index < 3; Index++)
+		{
+			sprintf(Buffer, "%-4s%5d %5d", I2cDevices[Index].Name, (int) I2cDevices[Index].Faults[I2c_Nack],
+					(int) (I2cBus_DeviceFaults(&I2cDevices[Index]) - I2cDevices[Index].Faults[I2c_Nack]));
+			SSD1306_GotoXY(0, 11 + Index * 11);
+			SSD1306_Puts(Buffer, &Font_7x10, 1);
+		}
+		for(uint16_t Index = 0; Index < I2cBuses; Index++)
+		{
+			sprintf(Buffer, "B%d R%3d S%2d %3du%s", Index + 1, (int) I2cBusInfo[Index].Recoveries, (int) I2cBusInfo[Index].Stuck,
+					(int) I2cBusInfo[Index].MaxRecovery, I2cBusInfo[Index].Parked ? "P" : " ");
+			SSD1306_GotoXY(0, 44 + Index * 10);
+			SSD1306_Puts(Buffer, &Font_7x10, 1);
+		}
+		HAL_IWDG_Refresh(&hiwdg);
+		Display_Update();
+		Configs.Last_Mode = Diagnostics;
+		comeFromMenu = false;
+		return;
+	}
+	if(Page == 2)
+	{
+		Status_Update();
+		//With the configuration image version and its load time on the boot
+		sprintf(Buffer, "Err v%d %5dus", ConfigLoadVersion, (int) ConfigLoadTime);
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		for(uint16_t Code = 0; Code < Error_Codes; Code++)
+		{
+			sprintf(Buffer, "%s %6d %s", Status_Tag(Code), (int) SystemStatus.Entries[Code].Count, Status_IsActive(Code) ? "on " : "   ");
+			SSD1306_GotoXY(0, 11 + Code * 11);
+			SSD1306_Puts(Buffer, &Font_7x10, 1);
+		}
+		sprintf(Buffer, "Deg %7ds", (int) (SystemStatus.DegradedTime / 1000));
+		SSD1306_GotoXY(0, 44);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Blk %7ds", (int) (SystemStatus.BlockedTime / 1000));
+		SSD1306_GotoXY(0, 54);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		HAL_IWDG_Refresh(&hiwdg);
+		Display_Update();
+		Configs.Last_Mode = Diagnostics;
+		comeFromMenu = false;
+		return;
+	}
+	if(Page == 1)
+	{
+		AdaptiveRate_Estimate(&RateControl, &Estimate);
+		sprintf(Buffer, "Rate %-9s", LevelNames[RateControl.Applied]);
+		SSD1306_GotoXY(0, 0);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Act %6d o/oo/s", (int) RateControl.Activity);
+		SSD1306_GotoXY(0, 11);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "I2C %7d tr/min", (int) Estimate.TransactionsPerMinute);
+		SSD1306_GotoXY(0, 22);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "    %7dkB/min", (int) (Estimate.BytesPerMinute / 1000));
+		SSD1306_GotoXY(0, 33);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Est %7d uA", (int) Estimate.MicroAmps);
+		SSD1306_GotoXY(0, 44);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		sprintf(Buffer, "Changes %6d", (int) RateControl.Transitions);
+		SSD1306_GotoXY(0, 54);
+		SSD1306_Puts(Buffer, &Font_7x10, 1);
+		HAL_IWDG_Refresh(&hiwdg);
+		Display_Update();
+		Configs.Last_Mode = Diagnostics;
+		comeFromMenu = false;
+		return;
+	}
+	sprintf(Buffer, "Jitter %6dus", (int) SampleJitter.Max);
+	SSD1306_GotoXY(0, 0);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	sprintf(Buffer, "N %6d Err %4d", (int) AcqStatus.Samples, (int) AcqStatus.ReadErrors);
+	SSD1306_GotoXY(0, 11);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	//Bin n holds the deviations of n bits, the bars are scaled to the peak bin
+	for(uint16_t Bin = 0; Bin < JitterBins; Bin++)
+		if(SampleJitter.Histogram[Bin] > Peak)
+			Peak = SampleJitter.Histogram[Bin];
+	for(uint16_t Bin = 0; Bin < JitterBins; Bin++)
+	{
+		Height = (SampleJitter.Histogram[Bin] * BarsHeight) / Peak;
+		if(SampleJitter.Histogram[Bin] && !Height)
+			Height = 1;
+		SSD1306_DrawFilledRectangle(Bin * BarWidth, BarsBottom - BarsHeight, BarWidth - 2, BarsHeight, 0);
+		if(Height)
+			SSD1306_DrawFilledRectangle(Bin * BarWidth, BarsBottom - Height, BarWidth - 2, Height, 1);
+	}
+	HAL_IWDG_Refresh(&hiwdg);
+	Display_Update();
+	//Ok clears the histogram
+	if((GPIOA -> IDR & ReadMask) == Ok)
+		Acquisition_JitterReset();
+	Configs.Last_Mode = Diagnostics;
+	comeFromMenu = false;
+}
+
+//Session percentiles for the lighting audits
+void Percentiles_mode(void)
+{
+	char Buffer[17];
+
+	HAL_IWDG_Refresh(&hiwdg);
+	if(Configs.Last_Mode != Percentiles || comeFromMenu)
+	{
+		SSD1306_Clear();
+		SSD1306_GotoXY(CenterXPrint("Percentiles", 0, 128, Font_7x10), 0);
+		SSD1306_Puts("Percentiles", &Font_7x10, 1);
+		Display_Update();
+	}
+	//Down restarts the statistics window
+	if((GPIOA -> IDR & ReadMask) == Down)
+	{
+		Statistics_Reset(&SessionStats);
+		Percentile_Reset(&SessionPercentiles);
+	}
+	Print_SmallValue("P5", Percentile_Get(&SessionPercentiles, P5), 0, 14);
+	Print_SmallValue("P50", Percentile_Get(&SessionPercentiles, P50), 0, 26);
+	Print_SmallValue("P95", Percentile_Get(&SessionPercentiles, P95), 0, 38);
+	sprintf(Buffer, "n %10d", (int) SessionPercentiles.Count);
+	SSD1306_GotoXY(0, 54);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	HAL_IWDG_Refresh(&hiwdg);
+	Display_Update();
+	Configs.Last_Mode = Percentiles;
+	comeFromMenu = false;
+}
+
+//Integrated illuminance, keeps running in every mode
+void Light_dose_mode(void)
+{
+	char Buffer[19];
+	uint32_t Seconds = Dose_ElapsedSeconds(&LightDose);
+	uint64_t LuxSeconds;
+
+	HAL_IWDG_Refresh(&hiwdg);
+	if(Configs.Last_Mode != Light_Dose || comeFromMenu)
+	{
+		SSD1306_Clear();
+		SSD1306_GotoXY(CenterXPrint("Light dose", 0, 128, Font_7x10), 0);
+		SSD1306_Puts("Light dose", &Font_7x10, 1);
+		Display_Update();
+	}
+	//Down starts a new dose
+	if((GPIOA -> IDR & ReadMask) == Down)
+		Dose_Reset(&LightDose);
+	//Whole lx*s, the int of the float overflowed in days of sunlight
+	LuxSeconds = LightDose.LuxSeconds;
+	sprintf(Buffer, "%9lu.%02ulxh", (unsigned long) (LuxSeconds / 3600), (unsigned) (LuxSeconds % 3600 / 36));
+	SSD1306_GotoXY(0, 14);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	if(LuxSeconds < 1000000000000ULL)
+		sprintf(Buffer, "%9luklxs", (unsigned long) (LuxSeconds / 1000));
+	else
+		sprintf(Buffer, "%9luMlxs", (unsigned long) (LuxSeconds / 1000000));
+	SSD1306_GotoXY(0, 26);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	Print_SmallValue("Avg", Dose_Average(&LightDose), 0, 38);
+	sprintf(Buffer, "t %3dd %02d:%02d:%02d", (int) (Seconds / 86400), (int) (Seconds / 3600) % 24, (int) (Seconds / 60) % 60, (int) Seconds % 60);
+	SSD1306_GotoXY(0, 54);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	HAL_IWDG_Refresh(&hiwdg);
+	Display_Update();
+	Configs.Last_Mode = Light_Dose;
+	comeFromMenu = false;
+}
 
 void MenuGUI(void)
 {
@@ -782,7 +1929,7 @@ void MenuGUI(void)
 	SSD1306_Clear();
 	SSD1306_GotoXY(31, 5);
 	SSD1306_Puts("Mode", &Font_16x26, 1);
-	SSD1306_UpdateScreen();
+	Display_Update();
 	Mode_Displayed = Configs.Last_Mode;
 	HAL_IWDG_Refresh(&hiwdg);
 	do
@@ -826,6 +1973,60 @@ void MenuGUI(void)
 					SSD1306_Puts("Sel Sensor", &Font_11x18, 1);
 				break;
 #endif
+				case Diagnostics:
+					SSD1306_GotoXY(3, 37);
+					SSD1306_Puts("             ", &Font_11x18, 1);
+					SSD1306_GotoXY(3, 37);
+					SSD1306_Puts("Diagnostics", &Font_11x18, 1);
+				break;
+				case Percentiles:
+					SSD1306_GotoXY(3, 37);
+					SSD1306_Puts("             ", &Font_11x18, 1);
+					SSD1306_GotoXY(3, 37);
+					SSD1306_Puts("Percentiles", &Font_11x18, 1);
+				break;
+				case Light_Dose:
+					SSD1306_GotoXY(3, 37);
+					SSD1306_Puts("             ", &Font_11x18, 1);
+					SSD1306_GotoXY(14, 37);
+					SSD1306_Puts("Light Dose", &Font_11x18, 1);
+				break;
+				case Auto_Hold:
+					SSD1306_GotoXY(3, 37);
+					SSD1306_Puts("             ", &Font_11x18, 1);
+					SSD1306_GotoXY(14, 37);
+					SSD1306_Puts("Auto Hold", &Font_11x18, 1);
+				break;
+				case Threshold_Alarm:
+					SSD1306_GotoXY(3, 37);
+					SSD1306_Puts("             ", &Font_11x18, 1);
+					SSD1306_GotoXY(36, 37);
+					SSD1306_Puts("Alarm", &Font_11x18, 1);
+				break;
+				case Burst_Capture:
+					SSD1306_GotoXY(3, 37);
+					SSD1306_Puts("             ", &Font_11x18, 1);
+					SSD1306_GotoXY(36, 37);
+					SSD1306_Puts("Burst", &Font_11x18, 1);
+				break;
+				case Select_Diode:
+					SSD1306_GotoXY(3, 37);
+					SSD1306_Puts("             ", &Font_11x18, 1);
+					SSD1306_GotoXY(9, 37);
+					SSD1306_Puts("Photodiode", &Font_11x18, 1);
+				break;
+				case Flicker_Metrics:
+					SSD1306_GotoXY(3, 37);
+					SSD1306_Puts("             ", &Font_11x18, 1);
+					SSD1306_GotoXY(25, 37);
+					SSD1306_Puts("Flicker", &Font_11x18, 1);
+				break;
+				case History:
+					SSD1306_GotoXY(3, 37);
+					SSD1306_Puts("             ", &Font_11x18, 1);
+					SSD1306_GotoXY(25, 37);
+					SSD1306_Puts("History", &Font_11x18, 1);
+				break;
 				case Reset_Sensor:
 					SSD1306_GotoXY(3, 37);
 					SSD1306_Puts("             ", &Font_11x18, 1);
@@ -835,7 +2036,7 @@ void MenuGUI(void)
 				case Idle:
 				break;
 			}
-			SSD1306_UpdateScreen();
+			Display_Update();
 			HAL_IWDG_Refresh(&hiwdg);
 			//Reading for the selection
 			switch(IDR_Read)
@@ -844,7 +2045,7 @@ void MenuGUI(void)
 					Mode_Displayed++;
 #ifdef ECONOMIC_VERSION //Disabling the complete version modes
 					if(Mode_Displayed == Plot)
-						Mode_Displayed = Reset_Sensor;
+						Mode_Displayed = Select_Sensor + 1;
 #endif
 					if(Mode_Displayed > Reset_Sensor)
 						Mode_Displayed = Continuous;
@@ -852,7 +2053,7 @@ void MenuGUI(void)
 				case Left:
 					Mode_Displayed--;
 #ifdef ECONOMIC_VERSION //Disabling the complete version modes
-					if(Mode_Displayed >= Select_Sensor)
+					if(Mode_Displayed >= Plot && Mode_Displayed <= Select_Sensor)
 						Mode_Displayed = Hold;
 #endif
 					if(Mode_Displayed < Continuous)
@@ -861,7 +2062,11 @@ void MenuGUI(void)
 				case Ok:
 					Configs.Mode = Mode_Displayed;
 					Not_Filled = false;
-					HAL_I2C_Mem_Write(&hi2c1, EEPROM_ADDR, 0x1, 1, (uint8_t *) &Mode_Displayed, 1, 100);
+					Flash_save();
+#ifndef ECONOMIC_VERSION
+					//Only the cache, written in the background if it changed
+					Configs_save();
+#endif
 					HAL_IWDG_Refresh(&hiwdg);
 					for(uint16_t i = 0; i < animation_counts; i++)
 					{
@@ -884,6 +2089,33 @@ void MenuGUI(void)
 								Select_animation("Sel Sensor ", 9, 37);
 							break;
 #endif
+							case Diagnostics:
+								Select_animation("Diagnostics", 3, 37);
+							break;
+							case Percentiles:
+								Select_animation("Percentiles", 3, 37);
+							break;
+							case Light_Dose:
+								Select_animation("Light Dose ", 14, 37);
+							break;
+							case Auto_Hold:
+								Select_animation("Auto Hold  ", 14, 37);
+							break;
+							case Threshold_Alarm:
+								Select_animation("Alarm      ", 36, 37);
+							break;
+							case Burst_Capture:
+								Select_animation("Burst      ", 36, 37);
+							break;
+							case Select_Diode:
+								Select_animation("Photodiode ", 9, 37);
+							break;
+							case Flicker_Metrics:
+								Select_animation("Flicker    ", 25, 37);
+							break;
+							case History:
+								Select_animation("History    ", 25, 37);
+							break;
 							case Reset_Sensor:
 								Select_animation("Reset Sense", 3, 37);
 							break;
@@ -910,12 +2142,12 @@ void Select_animation(char String[], uint16_t x, uint16_t y)
 	HAL_IWDG_Refresh(&hiwdg);
 	SSD1306_GotoXY(x, y);
 	SSD1306_Puts(String, &Font_11x18, 1);
-	SSD1306_UpdateScreen();
+	Display_Update();
 	//Timer_Delay_250ms(1);
 	Timer_Delay_at_274PSC(30000, 1); //114.18ms
 	SSD1306_GotoXY(3, 37);
 	SSD1306_Puts("            ", &Font_11x18, 1);
-	SSD1306_UpdateScreen();
+	Display_Update();
 
 	if(i == animation_counts)
 	{
@@ -924,65 +2156,23 @@ void Select_animation(char String[], uint16_t x, uint16_t y)
 
 }
 
-//Error handlers
+//Error handlers, none of them stops the measurement, see Status_task
 #ifndef ECONOMIC_VERSION
 void Fatal_Error_EEPROM(void)
 {
-	if(!Errors.EEPROM_Fatal)
-	{
-		SSD1306_Clear();
-		SSD1306_GotoXY(3, 18);
-		SSD1306_Puts("Fatal Error: EEPROM", &Font_7x10, 1);
-		SSD1306_GotoXY(6, 33);
-		SSD1306_Puts("Press OK to continue", &Font_7x10, 1);
-		SSD1306_UpdateScreen();
-		HAL_IWDG_Refresh(&hiwdg);
-		wait_until_press(Ok);
-		Errors.EEPROM_Fatal = true;
-		HAL_IWDG_Refresh(&hiwdg);
-	}
+	//The configurations come from the flash instead
+	Status_Raise(Error_EEPROM);
 }
 #endif
 
 void Fatal_Error_BH1750(void)
 {
-	if(!Errors.BH1750_Fatal)
-	{
-		SSD1306_Clear();
-		SSD1306_GotoXY(3, 18);
-		SSD1306_Puts("Fatal Error: EEPROM", &Font_7x10, 1);
-		SSD1306_GotoXY(6, 33);
-		SSD1306_Puts("Press OK to continue", &Font_7x10, 1);
-		SSD1306_UpdateScreen();
-		SSD1306_UpdateScreen();
-		HAL_IWDG_Refresh(&hiwdg);
-		wait_until_press(Ok);
-		Errors.BH1750_Fatal = true;
-		HAL_IWDG_Refresh(&hiwdg);
-	}
+	Status_Raise(Error_Sensor_Fatal);
 }
 
-//@TODO Bad prints, doesn't wait of the button ok
 void NoConnected_BH1750(void)
 {
-	if(!Errors.BH1750_NoConn)
-	{
-		SSD1306_Clear();
-		SSD1306_GotoXY(42, 10);
-		SSD1306_Puts("BH1750", &Font_7x10, 1);
-		SSD1306_GotoXY(21, 21);
-		SSD1306_Puts("No Connected", &Font_7x10, 1);
-		SSD1306_GotoXY(35, 36);
-		SSD1306_Puts("Press OK", &Font_7x10, 1);
-		SSD1306_GotoXY(25, 47);
-		SSD1306_Puts("to continue", &Font_7x10, 1);
-		SSD1306_UpdateScreen();
-		//ISR = None;
-		HAL_IWDG_Refresh(&hiwdg);
-		wait_until_press(Ok);
-		Errors.BH1750_NoConn = true;
-		HAL_IWDG_Refresh(&hiwdg);
-	}
+	Status_Raise(Error_Sensor_NoConn);
 }
 
 //Auxiliar functions
@@ -1009,27 +2199,66 @@ void Print_Measure(float Measure, uint16_t x, uint16_t y)
 	SSD1306_Puts(Fraccional_part, &Font_11x18, 1);
 	SSD1306_Puts("lx", &Font_11x18, 1);
 	HAL_IWDG_Refresh(&hiwdg);
-	SSD1306_UpdateScreen();
+	Display_Update();
+	RateControl.Redraws++;
+}
+
+void Print_SmallValue(char *Label, float Value, uint16_t x, uint16_t y)
+{
+	char Buffer[17];
+	uint32_t Integer_measure = (uint32_t) Value;
+	uint32_t Fraccional_measure = (uint32_t) ((Value - Integer_measure) * 100);
+
+	sprintf(Buffer, "%-4s%6d.%02dlx", Label, (int) Integer_measure, (int) Fraccional_measure);
+	SSD1306_GotoXY(x, y);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+}
+
+void Print_Statistics(const Statistics *Stats, float Value)
+{
+	char Buffer[19];
+	uint32_t Seconds = Statistics_ElapsedSeconds(Stats);
+	uint32_t Count = (Stats->Count > 9999999) ? 9999999 : Stats->Count; //The line holds 18 characters
+
+	Print_SmallValue("Now", Value, 0, 0);
+	Print_SmallValue("Min", Statistics_Min(Stats), 0, 11);
+	Print_SmallValue("Max", Statistics_Max(Stats), 0, 22);
+	Print_SmallValue("Avg", Statistics_Mean(Stats), 0, 33);
+	Print_SmallValue("Std", Statistics_StdDev(Stats), 0, 44);
+	snprintf(Buffer, sizeof(Buffer), "n%7d %3d:%02d:%02d", (int) Count, (int) (Seconds / 3600) % 1000, (int) (Seconds / 60) % 60, (int) Seconds % 60);
+	SSD1306_GotoXY(0, 54);
+	SSD1306_Puts(Buffer, &Font_7x10, 1);
+	HAL_IWDG_Refresh(&hiwdg);
+	Display_Update();
+	RateControl.Redraws++;
 }
 
+//The sample consumers keep running while a mode waits, the FIFO would overflow otherwise
 void wait_until_press(Buttons Button)
 {
 	do{
 		IDR_Read = (GPIOA -> IDR & ReadMask);
 		HAL_IWDG_Refresh(&hiwdg);
+		Background_tasks();
 	}while(IDR_Read != Button && ISR == None);
 }
 
-void Errors_init()
+//Everything the main loop runs besides the modes, also from the modal waits
+void Background_tasks(void)
 {
-	bool *Pointer = &Errors.EEPROM_Fatal;
-	for(uint16_t i = 0; i < sizeof(Errors); i++)
-	{
-		*Pointer = false;
-		Pointer++;
-		if(i == sizeof(Errors)/2)
-			HAL_IWDG_Refresh(&hiwdg);
-	}
+	Statistics_task();
+	Sampling_task();
+	I2cBus_task();
+	I2cQueue_task();
+	FlashStore_task();
+#ifndef ECONOMIC_VERSION
+	EepromCache_task();
+	Logger_task(&MeasureLog);
+#endif
+	Export_task();
+	Status_task();
+	if(DisplayPending)
+		Display_Update();
 }
 
 void Timer_Delay_250ms(uint16_t Value)
@@ -1066,22 +2295,223 @@ void MCU_Reset_Subrutine(void)
 	SSD1306_Clear();
 	SSD1306_GotoXY(23, 17);
 	SSD1306_Puts("Reset", &Font_16x26, 1);
-	SSD1306_UpdateScreen();
+	Display_Update();
+	//Settings still waiting in RAM
+	FlashStore_Flush();
+#ifndef ECONOMIC_VERSION
+	EepromCache_Flush();
+#endif
 	Timer_Delay_250ms(Seconds(1.5f));
 	NVIC_SystemReset(); //Reset de MCU
 }
 
+//Takes the newest sample of the acquisition clock
 void SensorRead(void)
 {
+	Sample Latest;
+
+	//The read errors are followed by Status_task
+	if(Acquisition_Latest(&Latest))
+		Measure = Latest.Lux; //Saving the value into a global
+}
+
+//Folds the new samples into the session statistics and the measurement log
+void Statistics_task(void)
+{
+	Sample New;
+
+	while(Acquisition_Pop(&StatsReader, &New))
+	{
+		Statistics_Update(&SessionStats, New.Lux, New.Timestamp);
+		Percentile_Update(&SessionPercentiles, New.Lux);
+		Dose_Update(&LightDose, New.Lux, New.Timestamp);
+		Logger_Add(&MeasureLog, &New); //Nothing without the EEPROM
+	}
+}
+
+//Feeds the adaptive rate controller and moves the sensor to the rate it asks for
+void Sampling_task(void)
+{
+	Sample New;
+	RateLevel Level = RateControl.Level;
+
+	while(Acquisition_Pop(&RateReader, &New))
+		Level = AdaptiveRate_Update(&RateControl, &AdaptiveSettings, New.Lux, New.Timestamp);
+	if(Configs.Mode == Auto_Hold || Configs.Mode == Burst_Capture || Level == SensorLevel)
+		return;
+	//Every rate keeps the user's resolution, the statistics never mix resolutions
+	Sensor_SetRate(Configs.Resolution, AdaptiveRate_Period(Level, BH1750_ConversionTime(Configs.Resolution)),
+			RateTiers[Level].OneShot);
+	SensorLevel = Level;
+	AdaptiveRate_Apply(&RateControl, Level);
+}
+
+//Auto hold and the burst capture own the sensor, the adaptive rate takes it back when leaving
+void Sensor_Fastest(void)
+{
+	Sensor_SetRate(Low_Res, BH1750_ConversionTime(Low_Res), false);
+	SensorLevel = Rate_Fast;
+	AdaptiveRate_Apply(&RateControl, Rate_Fast);
+}
+
+//Sensor errors from the acquisition, background recovery and the error tag at the top right corner.
+//The modes keep their first line to 15 characters of Font_7x10, x 105 and on is left to the tag
+void Status_task(void)
+{
+	static uint32_t LastProbe = 0;
+	static uint32_t LastSamples = 0;
+	static bool TagShown = false;
+	static bool TagInverted = false;
+	ErrorCode Code;
+	uint32_t Age;
+	bool Shown, Inverted = false;
+
+	if(AcqStatus.Running && AcqStatus.LastReadFailed)
+		NoConnected_BH1750();
+	else if(AcqStatus.Samples != LastSamples)
+	{
+		Status_Clear(Error_Sensor_NoConn);
+		Status_Clear(Error_Sensor_Fatal);
+	}
+	LastSamples = AcqStatus.Samples;
+	Status_Update();
+	//A missing sensor keeps the acquisition off the bus, only its address is probed until it answers
+	if(Status_IsActive(Error_Sensor_NoConn) || Status_IsActive(Error_Sensor_Fatal))
+	{
+		if(AcqStatus.Running)
+			Acquisition_Stop();
+		if(HAL_GetTick() - LastProbe >= SensorProbePeriod)
+		{
+			LastProbe = HAL_GetTick();
+			if(I2cBus_Probe(BH1750.I2C, BH1750.Address))
+				Sensor_Reattach();
+		}
+	}
+	//The tag blinks for a while after the error is raised, then it stays inverted
+	Shown = Status_Banner(&Code);
+	if(Shown)
+	{
+		Age = HAL_GetTick() - SystemStatus.Entries[Code].Raised;
+		Inverted = (Age < StatusBannerTime) ? (Age / 250) % 2 : true;
+		SSD1306_GotoXY(107, 0);
+		SSD1306_Puts((char *) Status_Tag(Code), &Font_7x10, !Inverted);
+	}
+	else if(TagShown)
+	{
+		SSD1306_GotoXY(107, 0);
+		SSD1306_Puts("   ", &Font_7x10, 1);
+	}
+	//The modes flush the tag with their own updates, only the changes are flushed here
+	if(Shown != TagShown || Inverted != TagInverted)
+		Display_Update();
+	TagShown = Shown;
+	TagInverted = Inverted;
+}
+
+//The sensor comes back powered down and with its registers cleared, the measurement
+//mode and resolution that were in use are set again
+void Sensor_Reattach(void)
+{
+	HAL_IWDG_Refresh(&hiwdg);
+	if(BH1750_Init(&BH1750, BH1750.I2C, BH1750.Address) != Rojo_OK)
+		return;
+	//Cleared here, otherwise Status_task stops the acquisition again before the first sample
+	Status_Clear(Error_Sensor_NoConn);
+	Status_Clear(Error_Sensor_Fatal);
+	if(Configs.Mode == Auto_Hold || Configs.Mode == Burst_Capture)
+		Sensor_Fastest();
+	else
+		SensorLevel = Rate_Levels; //Sampling_task sets the level in use with its resolution
+}
+
+//The library flushes its private frame buffer with its own blocking HAL calls, the I2C1 queue is held
+//meanwhile. It doesn't return their results: the handle keeps the error of the last one and a bus
+//fault parks the bus. The transactions and bytes are only charged to the display when neither
+//happened, a failed flush only charges the bus time it took, like the failures of I2cMaster
+void Display_Update(void)
+{
+	uint32_t Start, Cycles;
+	HAL_StatusTypeDef Result;
+
+	DisplayPending = !I2cQueue_Lock(&hi2c1, I2cPrio_Display);
+	if(DisplayPending)
+		return;
+	if(!I2cBus_Ready(&hi2c1))
+	{
+		//Parked, counted as skipped. The frame goes out once the bus is recovered
+		I2cBus_Report(&hi2c1, DisplayAddress, HAL_BUSY);
+		I2cQueue_Unlock(&hi2c1, 0);
+		DisplayPending = true;
+		return;
+	}
+	Start = DWT -> CYCCNT;
+	SSD1306_UpdateScreen();
+	Cycles = DWT -> CYCCNT - Start;
+	Result = (hi2c1.ErrorCode == HAL_I2C_ERROR_NONE && I2cBus_Ready(&hi2c1)) ? HAL_OK : HAL_ERROR;
+	if(I2cBus_Report(&hi2c1, DisplayAddress, Result) != HAL_OK)
+	{
+		I2cBus_Traffic(&hi2c1, DisplayAddress, 0, 0, Cycles);
+		I2cQueue_Unlock(&hi2c1, 0);
+		return;
+	}
+	I2cBus_Traffic(&hi2c1, DisplayAddress, DisplayFlushTransactions, DisplayFlushBytes, Cycles);
+	I2cQueue_Unlock(&hi2c1, DisplayFlushBytes);
+}
+
+//Every raw photodiode block goes through here from the DMA ISR
+void Flicker_hook(const uint16_t *Block, uint16_t Length)
+{
+	if(Configs.Mode == Flicker_Metrics)
+		Flicker_Process(&FlickerMeter, Block, Length);
+}
+
+//Every sample goes through here from the TIM2 ISR
+void Sample_hooks(const Sample *New)
+{
+	Alarm_SampleISR(New);
+	Burst_SampleISR(&BurstCapture, New);
+}
+
+//Sensor resolution and sample period always change together
+void Sensor_SetRate(BH1750_Resolutions Resolution, uint32_t Period, bool OneShot)
+{
+	Rojo_Status Status;
+
+	Acquisition_Stop();
 	switch(Sensor)
 	{
 		case _BH1750:
-			if(BH1750_Read(&BH1750, &Measure) != Rojo_OK) //Saving the value into a global
+			if(OneShot)
+				Status = BH1750_OneShotStart(&BH1750, Resolution);
+			else
+				Status = BH1750_ContinuousStart(&BH1750, Resolution);
+			if(Status != Rojo_OK)
 				NoConnected_BH1750();
+			SensorOneShot = OneShot;
 		break;
 		case _TSL2561:
 		break;
 	}
+	Acquisition_SetPeriod(Period);
+	Acquisition_Start();
+}
+
+//Called by the acquisition clock from the TIM2 ISR
+bool Sensor_Source(float *Lux)
+{
+	switch(Sensor)
+	{
+		case _BH1750:
+			if(BH1750_ContinuousRead(&BH1750, Lux) != Rojo_OK)
+				return false;
+			//The conversion for the next sample starts right after this read
+			if(SensorOneShot)
+				return BH1750_OneShotStart(&BH1750, BH1750.Resolution) == Rojo_OK;
+			return true;
+		case _TSL2561:
+		break;
+	}
+	return false;
 }
 
 uint16_t CenterXPrint(char *string, uint16_t InitialCoordinate, uint16_t LastCoordinate, FontDef_t Font)
@@ -1160,10 +2590,123 @@ void Configs_init(void)
 	Configs.Resolution = Medium_Res;
 }
 
-//@TODO Flash configurations
+//From the flash store, a value it doesn't have or that doesn't fit this version keeps the default.
+//The keys go through the image body, Configs_unpack checks them like the EEPROM ones
 void Flash_configs(void)
 {
+	ConfigImageBody Body;
+	uint32_t Value;
+
+	Configs_pack(&Body);
+	for(uint16_t Field = 0; Field < FlashStoreKeys; Field++)
+	{
+		if(FlashStore_Read(FlashFields[Field].Key, &Value) && (Value >> (8 * FlashFields[Field].Size)) == 0)
+			memcpy((uint8_t *) &Body + FlashFields[Field].Offset, &Value, FlashFields[Field].Size);
+	}
+	Configs_unpack(&Body);
+}
+
+//Only the keys that changed get a record, FlashStore_task programs them
+void Flash_save(void)
+{
+	ConfigImageBody Body;
+	uint32_t Value;
+
+	Configs_pack(&Body);
+	for(uint16_t Field = 0; Field < FlashStoreKeys; Field++)
+	{
+		Value = 0;
+		memcpy(&Value, (const uint8_t *) &Body + FlashFields[Field].Offset, FlashFields[Field].Size);
+		FlashStore_Write(FlashFields[Field].Key, Value);
+	}
+}
+
+//The EEPROM configuration image, an old one is saved again in the current version
+void Configs_load(void)
+{
+	uint8_t Area[sizeof(ConfigImageHeader) + ConfigImageMaxBody];
+	uint8_t Legacy[2];
+	ConfigImageBody Body;
+	//Version 0 modes, the later versions inserted modes before Reset_Sensor
+	const Modes LegacyModes[8] = {Continuous, Hold, Plot, Config_Plot, Select_Sensor, Reset_Sensor, Idle, Select_Diode};
+
+	Configs_pack(&Body); //The fields the image doesn't have keep the defaults
+	EepromCache_Read(ConfigImageAddress, Area, sizeof(Area));
+	ConfigLoad = ConfigImage_Open(Area, &Body, &ConfigLoadVersion);
+	if(ConfigLoad == Image_Invalid && EepromCache_Read(EEPROM_MODE, Legacy, sizeof(Legacy)))
+	{
+		//Version 0, only the mode and the resolution bytes
+		Body.Mode = (Legacy[0] < 8) ? (uint8_t) LegacyModes[Legacy[0]] : Legacy[0];
+		Body.Resolution = Legacy[1];
+	}
+	Configs_unpack(&Body);
+	if(ConfigLoad != Image_Ok)
+		Configs_save();
+}
+
+//Into the EEPROM cache, only the bytes that changed get written
+void Configs_save(void)
+{
+	ConfigImage Image;
+	ConfigImageBody Body;
 
+	Configs_pack(&Body);
+	ConfigImage_Seal(&Image, &Body);
+	EepromCache_Write(ConfigImageAddress, (const uint8_t *) &Image, sizeof(ConfigImage));
+}
+
+void Configs_pack(ConfigImageBody *Body)
+{
+	Body->Mode = (uint8_t) Configs.Mode;
+	Body->Resolution = (uint8_t) Configs.Resolution;
+	Body->PlotType = (uint8_t) GlobalConfigs.PlotType;
+	Body->PrintLegends = GlobalConfigs.PrintLegends;
+	Body->SampleTime = GlobalConfigs.SampleTime;
+	Body->PlotResolution = GlobalConfigs.Resolution;
+	Body->HoldRelative = AutoHoldSettings.RelativeThreshold;
+	Body->HoldAbsolute = AutoHoldSettings.AbsoluteThreshold;
+	Body->HoldTimeout = AutoHoldSettings.Timeout;
+	Body->AlarmHigh = AlarmSettings.High;
+	Body->AlarmLow = AlarmSettings.Low;
+	Body->AlarmHysteresis = AlarmSettings.Hysteresis;
+	Body->LogDeadband = LogDeadband;
+}
+
+//The values out of range keep what's in RAM, the thresholds are clamped to what the screens can set
+void Configs_unpack(const ConfigImageBody *Body)
+{
+	if(Configs_ValidMode(Body->Mode))
+		Configs.Mode = (Modes) Body->Mode;
+	if(Body->Resolution == High_Res || Body->Resolution == Medium_Res || Body->Resolution == Low_Res)
+		Configs.Resolution = (BH1750_Resolutions) Body->Resolution;
+	if(Body->PlotType <= YAxis)
+		GlobalConfigs.PlotType = (PlotType) Body->PlotType;
+	GlobalConfigs.PrintLegends = (Body->PrintLegends != 0);
+	if(Body->SampleTime != 0)
+		GlobalConfigs.SampleTime = Body->SampleTime;
+	if(Body->PlotResolution != 0)
+		GlobalConfigs.Resolution = Body->PlotResolution;
+	AutoHoldSettings.RelativeThreshold = (Body->HoldRelative > MaxHoldRelative) ? MaxHoldRelative : Body->HoldRelative;
+	AutoHoldSettings.AbsoluteThreshold = (Body->HoldAbsolute > MaxHoldAbsolute) ? MaxHoldAbsolute : Body->HoldAbsolute;
+	if(Body->HoldTimeout != 0)
+		AutoHoldSettings.Timeout = Body->HoldTimeout;
+	AlarmSettings.High = (Body->AlarmHigh > MaxAlarmHigh) ? MaxAlarmHigh : Body->AlarmHigh;
+	AlarmSettings.Low = (Body->AlarmLow > MaxAlarmLow) ? MaxAlarmLow : Body->AlarmLow;
+	AlarmSettings.Hysteresis = (Body->AlarmHysteresis > MaxAlarmHysteresis) ? MaxAlarmHysteresis : Body->AlarmHysteresis;
+	if(Body->LogDeadband <= MaxLogDeadband)
+		LogDeadband = Body->LogDeadband;
+}
+
+//The reset and idle modes aren't kept, neither the ones this version doesn't have
+bool Configs_ValidMode(uint32_t Mode)
+{
+	if(Mode >= Reset_Sensor)
+		return false;
+#ifdef ECONOMIC_VERSION //Disabling the complete version modes
+	if(Mode >= Plot && Mode <= Select_Sensor)
+		return false;
+#endif
+	return true;
 }
 
 //ISR Handlers
@@ -1180,20 +2723,45 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 {
+	if(htim->Instance == TIM2)
+		Acquisition_OverflowISR();
 #ifdef USER_DEBUG
 	//Breaks the while in the main function
-	PauseFlag = false;
+	if(htim->Instance == TIM3)
+		PauseFlag = false;
 #endif
 }
 
-void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+void HAL_TIM_OC_DelayElapsedCallback(TIM_HandleTypeDef *htim)
+{
+	if(htim->Instance == TIM2)
+		Acquisition_CompareISR();
+}
+
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	I2cQueue_DoneISR(hi2c, HAL_OK);
+}
+
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
 {
-  /* Prevent unused argument(s) compilation warning */
-  UNUSED(hi2c);
+	I2cQueue_DoneISR(hi2c, HAL_OK);
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	I2cQueue_DoneISR(hi2c, HAL_OK);
+}
 
-  /* NOTE : This function should not be modified, when the callback is needed,
-            the HAL_I2C_ErrorCallback could be implemented in the user file
-   */
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	I2cQueue_DoneISR(hi2c, HAL_OK);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	I2cBus_ErrorISR(hi2c);
+	I2cQueue_DoneISR(hi2c, HAL_ERROR);
 }
 
 void Borrame(void)
@@ -1351,6 +2919,64 @@ static void MX_IWDG_Init(void)
 
 }
 
+/**
+  * @brief TIM2 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_TIM2_Init(void)
+{
+
+  /* USER CODE BEGIN TIM2_Init 0 */
+
+  /* USER CODE END TIM2_Init 0 */
+
+  TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+  TIM_MasterConfigTypeDef sMasterConfig = {0};
+  TIM_OC_InitTypeDef sConfigOC = {0};
+
+  /* USER CODE BEGIN TIM2_Init 1 */
+
+  /* USER CODE END TIM2_Init 1 */
+  htim2.Instance = TIM2;
+  htim2.Init.Prescaler = 71;
+  htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim2.Init.Period = 65535;
+  htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_Base_Init(&htim2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+  if (HAL_TIM_ConfigClockSource(&htim2, &sClockSourceConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  if (HAL_TIM_OC_Init(&htim2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+  sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+  if (HAL_TIMEx_MasterConfigSynchronization(&htim2, &sMasterConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sConfigOC.OCMode = TIM_OCMODE_TIMING;
+  sConfigOC.Pulse = 0;
+  sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+  sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+  if (HAL_TIM_OC_ConfigChannel(&htim2, &sConfigOC, TIM_CHANNEL_1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE BEGIN TIM2_Init 2 */
+
+  /* USER CODE END TIM2_Init 2 */
+
+}
+
 /**
   * @brief TIM3 Initialization Function
   * @param None
@@ -1459,6 +3085,9 @@ static void MX_GPIO_Init(void)
   /*Configure GPIO pin Output Level */
   HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, GPIO_PIN_RESET);
 
+  /*Configure GPIO pin Output Level */
+  HAL_GPIO_WritePin(WP_GPIO_Port, WP_Pin, GPIO_PIN_SET);
+
   /*Configure GPIO pin : PC13 */
   GPIO_InitStruct.Pin = GPIO_PIN_13;
   GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
@@ -1467,13 +3096,20 @@ static void MX_GPIO_Init(void)
   HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
 
   /*Configure GPIO pins : Arriba_Pin Abajo_Pin Derecha_Pin Izquierda_Pin
-                           Ok_Pin WP_Pin */
+                           Ok_Pin */
   GPIO_InitStruct.Pin = Arriba_Pin|Abajo_Pin|Derecha_Pin|Izquierda_Pin
-                          |Ok_Pin|WP_Pin;
+                          |Ok_Pin;
   GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
   GPIO_InitStruct.Pull = GPIO_NOPULL;
   HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
+  /*Configure GPIO pin : WP_Pin */
+  GPIO_InitStruct.Pin = WP_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(WP_GPIO_Port, &GPIO_InitStruct);
+
   /*Configure GPIO pins : Menu_IT_Pin Reset_IT_Pin */
   GPIO_InitStruct.Pin = Menu_IT_Pin|Reset_IT_Pin;
   GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
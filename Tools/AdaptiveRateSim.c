@@ -0,0 +1,119 @@
+/**
+ *  Adaptive sampling rate simulation, runs on the PC
+ *  Runs Core/Src/AdaptiveRate.c with the settings of main.c over a 10
+ *  minute scene: steady 500lx, a 2s ramp down to 200lx at 3min, a step to
+ *  800lx at 6min and 5s of 0.8Hz flicker at 7min. For each resolution the
+ *  user can choose, the rates run the periods of Sampling_task
+ *  (AdaptiveRate_Period with the conversion time of the resolution) and
+ *  the samples are the register counts the firmware divides: 1.2 counts
+ *  per lux (2.4 on H2), the L resolution in 4lx steps, one count of noise
+ *  on the H ones. Both runs redraw once per sample, the fixed one samples
+ *  continuously at the conversion time, the adaptive one at its rates.
+ *  Build: gcc -O2 -ICore/Inc -o AdaptiveRateSim Tools/AdaptiveRateSim.c Core/Src/AdaptiveRate.c -lm
+ */
+
+#include "AdaptiveRate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define SceneTime 600 //s
+
+typedef enum Resolution
+{
+	Res_Low,
+	Res_High,  //H, Medium_Res in main.c
+	Res_High2, //H2, High_Res in main.c
+	Resolutions
+}Resolution;
+
+static const RateSettings Settings = {
+		.NoiseFloor = 4,
+		.NoiseRelative = 5,
+		.RiseThreshold = 200,
+		.FallThreshold = 20,
+		.Calm = 3
+};
+
+static const char *ResolutionNames[Resolutions] = {"L", "H", "H2"};
+static const uint32_t Conversions[Resolutions] = {16000, 120000, 120000}; //us, BH1750_ConversionTime
+static const double CountsPerLux[Resolutions] = {1.2, 1.2, 2.4};
+
+static double Sim_Scene(double Time);
+static float Sim_Read(double Lux, Resolution Res);
+static void Sim_Print(const char *Name, const AdaptiveRate *Rate);
+
+int main(void)
+{
+	AdaptiveRate Rate;
+	RateLevel Level, Wanted;
+	double Time;
+	uint32_t Period;
+
+	srand(1);
+	for(Resolution Res = 0; Res < Resolutions; Res++)
+	{
+		printf("Resolution %s\n", ResolutionNames[Res]);
+		//Fixed rate: continuous at the conversion time, accounted on the normal rate
+		AdaptiveRate_Init(&Rate, Rate_Normal);
+		Rate.Time[Rate_Normal] = (uint64_t) SceneTime * 1000000;
+		Rate.Samples[Rate_Normal] = SceneTime * 1000000 / Conversions[Res];
+		Rate.Redraws = Rate.Samples[Rate_Normal];
+		Sim_Print("Fixed", &Rate);
+		//Adaptive
+		Level = Rate_Normal;
+		AdaptiveRate_Init(&Rate, Level);
+		Period = AdaptiveRate_Period(Level, Conversions[Res]);
+		for(Time = 0; Time < SceneTime; Time += Period / 1e6)
+		{
+			Wanted = AdaptiveRate_Update(&Rate, &Settings, Sim_Read(Sim_Scene(Time), Res), (uint32_t) (Time * 1e6));
+			Rate.Redraws++;
+			if(Wanted != Level)
+			{
+				printf("  %7.3fs: rate %d to %d, activity %u o/oo/s\n", Time, Level, Wanted, Rate.Activity);
+				Level = Wanted;
+				AdaptiveRate_Apply(&Rate, Level);
+				Period = AdaptiveRate_Period(Level, Conversions[Res]);
+			}
+		}
+		Sim_Print("Adaptive", &Rate);
+	}
+	return 0;
+}
+
+//Private functions
+static double Sim_Scene(double Time)
+{
+	if(Time >= 420 && Time < 425)
+		return 800 + 200 * sin(2 * M_PI * 0.8 * (Time - 420));
+	if(Time >= 360)
+		return 800;
+	if(Time >= 182)
+		return 200;
+	if(Time > 180)
+		return 500 - 150 * (Time - 180);
+	return 500;
+}
+
+//Register counts over the divisor of BH1750_ContinuousRead
+static float Sim_Read(double Lux, Resolution Res)
+{
+	double Counts;
+
+	if(Res == Res_Low)
+		Counts = floor(floor(Lux / 4) * 4 * CountsPerLux[Res] + 0.5);
+	else
+		Counts = floor(Lux * CountsPerLux[Res]) + rand() % 3 - 1;
+	return (float) (Counts / CountsPerLux[Res]);
+}
+
+static void Sim_Print(const char *Name, const AdaptiveRate *Rate)
+{
+	RateEstimate Estimate;
+
+	AdaptiveRate_Estimate(Rate, &Estimate);
+	printf("  %-8s %6u tr/min %8u B/min %4u uA, time on heartbeat/normal/fast %u/%u/%u s\n", Name,
+			Estimate.TransactionsPerMinute, Estimate.BytesPerMinute, Estimate.MicroAmps,
+			(unsigned) (Rate->Time[Rate_Heartbeat] / 1000000), (unsigned) (Rate->Time[Rate_Normal] / 1000000),
+			(unsigned) (Rate->Time[Rate_Fast] / 1000000));
+}
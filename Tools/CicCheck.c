@@ -0,0 +1,96 @@
+/**
+ *  Photodiode CIC decimator check, runs on the PC
+ *  Feeds Core/Src/Cic.c the ADC stream of Select_Diode: 9.6kHz, 2000
+ *  counts of DC with a +-800 count ripple and +-4 counts of noise, in DMA
+ *  halves of 96 samples. The ripple of 50Hz lamps (100Hz) falls on a null
+ *  of the filter, the output has to stay within 2 counts of the DC once
+ *  the combs are filled. 60Hz lamps (120Hz) and a lamp flickering at the
+ *  mains frequency (50Hz) aren't nulled: the output keeps the ripple times
+ *  the response of the filter, |sin(pi f R / Fs) / (R sin(pi f / Fs))|^3,
+ *  aliased below 50Hz, and its peak has to be that within 2 counts.
+ *  Then times the filter alone
+ *  on the host, the figure only compares builds, the Cortex-M3 cost is
+ *  measured on the device (the DMA ISR load on the Select_Diode screen).
+ *  Build: gcc -O2 -ICore/Inc -o CicCheck Tools/CicCheck.c Core/Src/Cic.c -lm
+ */
+
+#include "Cic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#define AdcRate 9600.0
+#define HalfBuffer 96
+#define CheckHalves 200000
+#define TimedHalves 2000000
+#define DcCounts 2000
+#define RippleCounts 800
+#define MaxDeviation 2.0 //Counts
+
+static const double Ripples[] = {100, 120, 50}; //Hz
+
+static double Check_Ripple(double Frequency);
+static double Check_Response(double Frequency);
+
+int main(void)
+{
+	Cic Filter;
+	uint16_t In[HalfBuffer], Out[4];
+	double Worst, Expected, Seconds;
+	int Failures = 0;
+	clock_t Start;
+
+	srand(1);
+	for(uint16_t Case = 0; Case < sizeof(Ripples) / sizeof(Ripples[0]); Case++)
+	{
+		Worst = Check_Ripple(Ripples[Case]);
+		Expected = RippleCounts * Check_Response(Ripples[Case]);
+		printf("%3.0fHz ripple: worst %.2f counts off the DC, %.2f expected\n", Ripples[Case], Worst, Expected);
+		if(fabs(Worst - Expected) > MaxDeviation)
+			Failures++;
+	}
+	Cic_Init(&Filter, HalfBuffer);
+	Start = clock();
+	for(uint32_t Half = 0; Half < TimedHalves; Half++)
+		Cic_Process(&Filter, In, HalfBuffer, Out);
+	Seconds = (double) (clock() - Start) / CLOCKS_PER_SEC;
+	printf("Host: %.2f ns per sample\n", Seconds / ((double) TimedHalves * HalfBuffer) * 1e9);
+	return Failures != 0;
+}
+
+//Private functions
+//Largest distance of the output to the DC once the combs are filled
+static double Check_Ripple(double Frequency)
+{
+	Cic Filter;
+	uint16_t In[HalfBuffer], Out[4];
+	uint32_t Sample = 0, Outputs = 0;
+	uint16_t Count;
+	double Deviation, Worst = 0;
+
+	Cic_Init(&Filter, HalfBuffer);
+	for(uint32_t Half = 0; Half < CheckHalves; Half++)
+	{
+		for(uint16_t Index = 0; Index < HalfBuffer; Index++, Sample++)
+			In[Index] = (uint16_t) (DcCounts + RippleCounts * sin(2 * M_PI * Frequency * Sample / AdcRate) + rand() % 9 - 4);
+		Count = Cic_Process(&Filter, In, HalfBuffer, Out);
+		for(uint16_t Index = 0; Index < Count; Index++)
+		{
+			//Q4 output
+			Deviation = fabs(Out[Index] / 16.0 - DcCounts);
+			if(++Outputs > CicOrder && Deviation > Worst)
+				Worst = Deviation;
+		}
+	}
+	return Worst;
+}
+
+//Gain of the filter at Frequency, 0 on the multiples of the output rate
+static double Check_Response(double Frequency)
+{
+	double Comb = sin(M_PI * Frequency * HalfBuffer / AdcRate);
+	double Integrator = HalfBuffer * sin(M_PI * Frequency / AdcRate);
+
+	return pow(fabs(Comb / Integrator), CicOrder);
+}
@@ -0,0 +1,175 @@
+/**
+ *  Export decoder, runs on the PC
+ *  Reads the frames of the serial export (see Core/Inc/Export.h) from a
+ *  serial port, a pseudo-terminal or a capture file and writes CSV:
+ *  	live,<frame>,<timestamp us>,<lux>
+ *  	log,<block sequence>,<log clock ms>,<lux>
+ *  The log blocks are decoded with the LogCodec of the firmware. Frames
+ *  with a bad CRC are dropped, the gaps in the frame sequences counted
+ *  as lost, the totals go to stderr at the end.
+ *  Build: gcc -O2 -ICore/Inc -o ExportDecode Tools/ExportDecode.c Core/Src/ExportFrame.c Core/Src/LogCodec.c
+ *  Use:   ExportDecode /dev/ttyUSB0 [-d] > log.csv   (-d asks for a dump of the log)
+ */
+
+#include "ExportFrame.h"
+#include "LogBlock.h"
+#include "LogCodec.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+typedef struct __attribute__((packed)) WireSample
+{
+	uint32_t Timestamp;  //us
+	float Lux;
+}WireSample;
+
+typedef struct Totals
+{
+	uint32_t Frames;
+	uint32_t Damaged;    //Bad CRC or COBS
+	uint32_t Lost;       //Sequence gaps
+	uint32_t Samples;
+	uint32_t Blocks;
+	uint32_t Records;
+}Totals;
+
+static void Decode_Frame(const uint8_t *Payload, uint16_t Length, Totals *Count);
+static void Decode_Block(const LogBlock *Block, Totals *Count);
+static int Decode_Port(const char *Path);
+
+int main(int argc, char *argv[])
+{
+	uint8_t Wire[ExportFrameSize], Payload[ExportFrameSize], Byte;
+	uint16_t Filled = 0, Length;
+	bool Overflow = false;
+	Totals Count = {0};
+	int Port;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "Use: %s <port or file> [-d]\n", argv[0]);
+		return 1;
+	}
+	Port = Decode_Port(argv[1]);
+	if(Port < 0)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	if(argc > 2 && strcmp(argv[2], "-d") == 0)
+	{
+		Byte = 'D';
+		if(write(Port, &Byte, 1) != 1)
+			perror("Dump request");
+	}
+	printf("kind,sequence,time,lux\n");
+	while(read(Port, &Byte, 1) == 1)
+	{
+		if(Byte != 0)
+		{
+			//Longer than a frame, dropped up to the next delimiter
+			if(Filled < sizeof(Wire))
+				Wire[Filled++] = Byte;
+			else
+				Overflow = true;
+			continue;
+		}
+		if(Filled == 0)
+			continue;
+		Length = Overflow ? 0 : ExportFrame_Open(Wire, Filled, Payload);
+		if(Length)
+			Decode_Frame(Payload, Length, &Count);
+		else
+			Count.Damaged++;
+		Filled = 0;
+		Overflow = false;
+	}
+	fprintf(stderr, "Frames %u damaged %u lost %u, samples %u, blocks %u with %u records\n", Count.Frames, Count.Damaged,
+			Count.Lost, Count.Samples, Count.Blocks, Count.Records);
+	close(Port);
+	return 0;
+}
+
+//Payload: type, sequence, body and the CRC already checked
+static void Decode_Frame(const uint8_t *Payload, uint16_t Length, Totals *Count)
+{
+	static bool Started = false;
+	static uint16_t Expected;
+	uint16_t Sequence = Payload[1] | (Payload[2] << 8);
+	uint16_t Body = Length - 3 - 4;
+	const uint8_t *Data = Payload + 3;
+	WireSample Sample;
+	LogBlock Block;
+	uint16_t Blocks;
+	uint32_t Now;
+
+	if(Started && Sequence != Expected)
+		Count->Lost += (uint16_t) (Sequence - Expected);
+	Started = true;
+	Expected = Sequence + 1;
+	Count->Frames++;
+	switch(Payload[0])
+	{
+		case Export_Samples:
+			for(uint16_t Index = 0; Index + sizeof(WireSample) <= Body; Index += sizeof(WireSample))
+			{
+				memcpy(&Sample, Data + Index, sizeof(WireSample));
+				printf("live,%u,%u,%.2f\n", Sequence, Sample.Timestamp, Sample.Lux);
+				Count->Samples++;
+			}
+		break;
+		case Export_Begin:
+			if(Body < sizeof(Blocks) + sizeof(Now))
+				break;
+			memcpy(&Blocks, Data, sizeof(Blocks));
+			memcpy(&Now, Data + sizeof(Blocks), sizeof(Now));
+			fprintf(stderr, "Log dump: %u blocks, log clock %u ms\n", Blocks, Now);
+		break;
+		case Export_Block:
+			if(Body != sizeof(LogBlock))
+				break;
+			memcpy(&Block, Data, sizeof(LogBlock));
+			Decode_Block(&Block, Count);
+		break;
+		case Export_End:
+			fprintf(stderr, "Log dump done\n");
+		break;
+	}
+	fflush(stdout);
+}
+
+static void Decode_Block(const LogBlock *Block, Totals *Count)
+{
+	LogDecoder Decoder;
+	uint32_t Time, Lux;
+
+	LogCodec_Open(&Decoder, Block->Data, LogDataSize, Block->Count, Block->Step);
+	while(LogCodec_Get(&Decoder, &Time, &Lux))
+	{
+		printf("log,%u,%u,%u.%u\n", Block->Sequence, Block->Start + Time * 100, Lux / 10, Lux % 10);
+		Count->Records++;
+	}
+	Count->Blocks++;
+}
+
+//Raw at the export baud when it's a terminal, as it is otherwise
+static int Decode_Port(const char *Path)
+{
+	struct termios Settings;
+	int Port = open(Path, O_RDWR | O_NOCTTY);
+
+	if(Port < 0)
+		Port = open(Path, O_RDONLY);
+	if(Port < 0 || !isatty(Port) || tcgetattr(Port, &Settings) != 0)
+		return Port;
+	cfmakeraw(&Settings);
+	cfsetispeed(&Settings, B921600);
+	cfsetospeed(&Settings, B921600);
+	Settings.c_cc[VMIN] = 1;
+	Settings.c_cc[VTIME] = 0;
+	tcsetattr(Port, TCSANOW, &Settings);
+	return Port;
+}
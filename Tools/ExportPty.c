@@ -0,0 +1,312 @@
+/**
+ *  Serial export on a pseudo-terminal, runs on the PC
+ *  Builds Core/Src/Export.c and Core/Src/Logger.c of the firmware against
+ *  host shims to try the export without the board: USART1, DMA1 channel 4,
+ *  RCC and GPIOA are structures in the RAM and the EEPROM a RAM image
+ *  (EepromSize, the 24C02 unless it's given with -D).
+ *  - The pty writer plays the DMA: when the channel is enabled it writes
+ *    the buffer being sent at the pace of ExportBaud, sets the transfer
+ *    complete flag and runs Export_DMA_ISR, which starts the next frame.
+ *  - A byte read from the pty is the USART RX, Export_task polls it.
+ *  - The samples are a sawtooth of light, one every 10ms, popped by the export
+ *    reader and logged. The log starts with an hour of records.
+ *  - The EEPROM doesn't answer for 5ms after a page, its write cycle, and
+ *    the dump command starts one, so the dump has to read again the
+ *    blocks it's refused.
+ *  Build: gcc -O2 -DUSE_HAL_DRIVER -DSTM32F103xB -ICore/Inc -ICore/Src -IDrivers/STM32F1xx_HAL_Driver/Inc
+ *         -IDrivers/CMSIS/Device/ST/STM32F1xx/Include -IDrivers/CMSIS/Include -o ExportPty Tools/ExportPty.c
+ *         Core/Src/ExportFrame.c Core/Src/LogCodec.c Core/Src/LogIndex.c Core/Src/SwingDoor.c -lm
+ *  Use:   ExportPty [seconds] & then ExportDecode <the printed port> -d
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include "Export.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <termios.h>
+
+//Output delays of termios, the registers of the USART here
+#undef CR1
+#undef CR2
+#undef CR3
+
+//The peripherals the firmware sets with the CMSIS registers
+static USART_TypeDef ModelUsart;
+static DMA_TypeDef ModelDma;
+static DMA_Channel_TypeDef ModelChannel;
+static RCC_TypeDef ModelRcc;
+static GPIO_TypeDef ModelGpio;
+static DWT_Type ModelDwt;
+#undef USART1
+#define USART1 (&ModelUsart)
+#undef DMA1
+#define DMA1 (&ModelDma)
+#undef DMA1_Channel4
+#define DMA1_Channel4 (&ModelChannel)
+#undef RCC
+#define RCC (&ModelRcc)
+#undef GPIOA
+#define GPIOA (&ModelGpio)
+#undef DWT
+#define DWT (&ModelDwt)
+
+#define SamplePeriod 10   //ms
+#define WriteCycle 5      //ms
+#define PrefillTime 3600000 //ms of log before the link starts
+
+EepromCache ConfigCache;
+static uint8_t Eeprom[EepromSize];
+static uint32_t Tick;
+static uint32_t BusyUntil;
+static uint32_t Refused;  //Reads during the write cycle
+static uint32_t NextPop;  //Time of the next sample of the export reader
+static uint32_t NextLog;  //And of the logger
+
+uint32_t HAL_GetTick(void)
+{
+	return Tick;
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq(void)
+{
+	return 72000000;
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+	(void) IRQn;
+	(void) PreemptPriority;
+	(void) SubPriority;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+	(void) IRQn;
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+	(void) IRQn;
+}
+
+uint32_t Acquisition_Micros(void)
+{
+	return Tick * 1000;
+}
+
+void Acquisition_ReaderInit(SampleReader *Reader)
+{
+	(void) Reader;
+}
+
+//Sawtooth from 100 to 1100lx, 0.25lx per sample
+static float Pty_Lux(uint32_t Time)
+{
+	return 100 + (Time / SamplePeriod % 4000) * 0.25f;
+}
+
+bool Acquisition_Pop(SampleReader *Reader, Sample *Out)
+{
+	(void) Reader;
+	if((int32_t) (Tick - NextPop) < 0)
+		return false;
+	Out->Timestamp = NextPop * 1000;
+	Out->Lux = Pty_Lux(NextPop);
+	NextPop += SamplePeriod;
+	return true;
+}
+
+bool I2cQueue_Lock(I2C_HandleTypeDef *Handle, I2cPriority Priority)
+{
+	(void) Handle;
+	(void) Priority;
+	return true;
+}
+
+void I2cQueue_Unlock(I2C_HandleTypeDef *Handle, uint32_t Bytes)
+{
+	(void) Handle;
+	(void) Bytes;
+}
+
+HAL_StatusTypeDef I2cBus_Report(I2C_HandleTypeDef *Handle, uint16_t Address, HAL_StatusTypeDef Result)
+{
+	(void) Handle;
+	(void) Address;
+	return Result;
+}
+
+//NACK during the write cycle
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *Handle, uint16_t Address, uint16_t Register, uint16_t Size,
+		uint8_t *Data, uint16_t Length, uint32_t Timeout)
+{
+	(void) Handle;
+	(void) Address;
+	(void) Size;
+	(void) Timeout;
+	if(ConfigCache.State != Eeprom_Idle)
+	{
+		Refused++;
+		return HAL_ERROR;
+	}
+	memcpy(Data, Eeprom + Register, Length);
+	return HAL_OK;
+}
+
+uint32_t ConfigImage_Crc(const uint8_t *Data, uint16_t Length)
+{
+	return ExportFrame_Crc(Data, Length);
+}
+
+bool EepromCache_WritePage(uint16_t Register, const uint8_t *Data, uint16_t Length)
+{
+	if(ConfigCache.State != Eeprom_Idle)
+		return false;
+	memcpy(Eeprom + Register, Data, Length);
+	ConfigCache.PagesWritten++;
+	ConfigCache.State = Eeprom_Polling;
+	BusyUntil = Tick + WriteCycle;
+	return true;
+}
+
+#include "Export.c"
+#include "Logger.c"
+
+static Logger Log;
+static uint64_t Written;
+
+static void Pty_Step(void);
+static void Pty_Receive(int Port);
+static void Pty_Dma(int Port, const struct timespec *Start);
+
+int main(int argc, char *argv[])
+{
+	int Port = posix_openpt(O_RDWR | O_NOCTTY);
+	double Seconds = (argc > 1) ? atof(argv[1]) : 10;
+	struct termios Settings;
+	struct timespec Start, Now;
+	uint32_t Base;
+	double Elapsed;
+
+	if(Port < 0 || grantpt(Port) != 0 || unlockpt(Port) != 0)
+	{
+		perror("Pseudo-terminal");
+		return 1;
+	}
+	//Raw both ways, the slave keeps it for whoever opens it
+	tcgetattr(Port, &Settings);
+	cfmakeraw(&Settings);
+	tcsetattr(Port, TCSANOW, &Settings);
+	printf("%s\n", ptsname(Port));
+	fflush(stdout);
+	fcntl(Port, F_SETFL, fcntl(Port, F_GETFL) | O_NONBLOCK);
+	memset(Eeprom, 0xFF, sizeof(Eeprom));
+	Logger_Init(&Log, NULL, 0xA0);
+	for(Tick = 0; Tick < PrefillTime; Tick++)
+		Pty_Step();
+	Export_Init(&Log);
+	NextPop = Base = Tick;
+	clock_gettime(CLOCK_MONOTONIC, &Start);
+	do
+	{
+		clock_gettime(CLOCK_MONOTONIC, &Now);
+		Elapsed = (Now.tv_sec - Start.tv_sec) + (Now.tv_nsec - Start.tv_nsec) / 1e9;
+		//The main loop catches up with the clock a ms at a time
+		while((int32_t) (Base + (uint32_t) (Elapsed * 1000) - Tick) > 0)
+		{
+			Tick++;
+			Pty_Step();
+		}
+		Pty_Receive(Port);
+		Export_task();
+		//Cleared by the read of DR in Export_task
+		ModelUsart.SR &= ~USART_SR_RXNE;
+		if(ModelChannel.CCR & DMA_CCR_EN)
+			Pty_Dma(Port, &Start);
+		else
+			usleep(1000);
+	}while(Elapsed < Seconds);
+	fprintf(stderr, "Sent %u frames, %llu bytes in %.2fs, %u dumped blocks, %u reads refused in the write cycle, %u read again\n",
+			SerialExport.Sent, (unsigned long long) Written, Elapsed, SerialExport.Blocks, Refused, SerialExport.Busy);
+	//Until the reader has it all
+	tcdrain(Port);
+	sleep(1);
+	close(Port);
+	return 0;
+}
+
+//Private functions
+//A ms of the board: the EEPROM write cycle, the logger and its samples
+static void Pty_Step(void)
+{
+	Sample New;
+
+	if(ConfigCache.State != Eeprom_Idle && (int32_t) (Tick - BusyUntil) >= 0)
+		ConfigCache.State = Eeprom_Idle;
+	if((int32_t) (Tick - NextLog) >= 0)
+	{
+		New.Timestamp = NextLog * 1000;
+		New.Lux = Pty_Lux(NextLog);
+		Logger_Add(&Log, &New);
+		NextLog += SamplePeriod;
+	}
+	Logger_task(&Log);
+}
+
+static void Pty_Receive(int Port)
+{
+	uint8_t Byte;
+
+	if(read(Port, &Byte, 1) == 1)
+	{
+		ModelUsart.DR = Byte;
+		ModelUsart.SR |= USART_SR_RXNE;
+		//The worst case, the dump starts in the write cycle of a page
+		if(Byte == ExportDumpCommand && ConfigCache.State == Eeprom_Idle)
+		{
+			ConfigCache.State = Eeprom_Polling;
+			BusyUntil = Tick + WriteCycle;
+		}
+	}
+}
+
+//The channel is enabled: the buffer being sent at the link rate, then the transfer complete interrupt
+static void Pty_Dma(int Port, const struct timespec *Start)
+{
+	uint16_t Buffer, Bytes = (uint16_t) ModelChannel.CNDTR;
+	double Due = (Written + Bytes) * 10.0 / ExportBaud;
+	struct timespec Now, Wait;
+	ssize_t Done;
+
+	for(Buffer = 0; Buffer < 2 && SerialExport.States[Buffer] != Buffer_Sending; Buffer++);
+	if(Buffer == 2)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	Due -= (Now.tv_sec - Start->tv_sec) + (Now.tv_nsec - Start->tv_nsec) / 1e9;
+	if(Due > 0)
+	{
+		Wait.tv_sec = (time_t) Due;
+		Wait.tv_nsec = (long) ((Due - Wait.tv_sec) * 1e9);
+		nanosleep(&Wait, NULL);
+	}
+	for(uint16_t Sent = 0; Sent < Bytes; Sent += Done)
+	{
+		Done = write(Port, SerialExport.Frames[Buffer] + Sent, Bytes - Sent);
+		if(Done < 0)
+		{
+			usleep(1000);
+			Done = 0;
+		}
+	}
+	Written += Bytes;
+	ModelChannel.CNDTR = 0;
+	ModelDma.ISR = DMA_ISR_TCIF4 | DMA_ISR_GIF4;
+	Export_DMA_ISR();
+	//Cleared by the write to IFCR
+	ModelDma.ISR = 0;
+}
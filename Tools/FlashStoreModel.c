@@ -0,0 +1,215 @@
+/**
+ *  Power loss and wear model of the flash configuration store, runs on the PC
+ *  Builds Core/Src/FlashStore.c against a RAM image of the two flash pages.
+ *  The flash stubs count every half word programmed and every page erased,
+ *  the power is cut after a random number of them:
+ *  - A cut half word only gets a random part of the bits it was clearing.
+ *  - A cut erase sets a random part of the page back to 0xFF.
+ *  After each cut the store boots again (the boot can be cut too) and the
+ *  value read has to be the one stored before the flush or the one the flush
+ *  was writing. The wear run stores every key, then flushes a new value of
+ *  one every time and reports the erases of each page per change and the
+ *  changes 10k erase cycles last.
+ *  Build: gcc -O2 -ICore/Inc -ICore/Src -o FlashStoreModel Tools/FlashStoreModel.c
+ *  Use:   FlashStoreModel [cuts] [changes]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+
+//The HAL the store uses, main.h is left out
+#define __MAIN_H
+typedef enum
+{
+	HAL_OK,
+	HAL_ERROR
+}HAL_StatusTypeDef;
+#define FLASH_TYPEERASE_PAGES 0
+#define FLASH_BANK_1 1
+#define FLASH_TYPEPROGRAM_HALFWORD 1
+typedef struct
+{
+	uint32_t TypeErase;
+	uint32_t Banks;
+	uint32_t PageAddress;
+	uint32_t NbPages;
+}FLASH_EraseInitTypeDef;
+
+#include "FlashStore.h"
+
+#define PageEndurance 10000
+
+static uint32_t Tick;
+static long Budget = -1;  //Flash operations before the cut, -1 never
+static jmp_buf Cut;
+static uint32_t PageErases[2];
+
+static bool Model_Cut(void);
+
+uint32_t HAL_GetTick(void)
+{
+	return Tick;
+}
+
+void HAL_FLASH_Unlock(void)
+{
+}
+
+void HAL_FLASH_Lock(void)
+{
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t Type, uint32_t Address, uint64_t Data)
+{
+	volatile uint16_t *Cell = (volatile uint16_t *) (uintptr_t) Address;
+
+	(void) Type;
+	if(Model_Cut())
+	{
+		//Only some of the bits going to 0 made it
+		*Cell &= (uint16_t) (Data | rand());
+		longjmp(Cut, 1);
+	}
+	*Cell &= (uint16_t) Data;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *Erase, uint32_t *PageError)
+{
+	uint8_t *Page = (uint8_t *) (uintptr_t) Erase->PageAddress;
+
+	(void) PageError;
+	PageErases[Erase->PageAddress == FlashStorePageA ? 0 : 1]++;
+	if(Model_Cut())
+	{
+		for(uint16_t Index = 0; Index < FlashStorePageSize; Index++)
+			if(rand() % 2)
+				Page[Index] = 0xFF;
+		longjmp(Cut, 1);
+	}
+	memset(Page, 0xFF, FlashStorePageSize);
+	return HAL_OK;
+}
+
+#include "FlashStore.c"
+
+static bool Model_Boot(void);
+static uint32_t Model_Cuts(uint32_t Cuts);
+static void Model_Wear(uint32_t Changes);
+
+int main(int argc, char **argv)
+{
+	uint32_t Cuts = (argc > 1) ? strtoul(argv[1], NULL, 0) : 100000;
+	uint32_t Changes = (argc > 2) ? strtoul(argv[2], NULL, 0) : 1000000;
+	void *Flash = mmap((void *) (uintptr_t) (FlashStorePageA & ~0xFFF), 0x1000, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+	uint32_t Failures;
+
+	if(Flash == MAP_FAILED)
+	{
+		perror("mmap");
+		return 1;
+	}
+	srand(1);
+	memset((void *) (uintptr_t) FlashStorePageA, 0xFF, 2 * FlashStorePageSize);
+	Failures = Model_Cuts(Cuts);
+	memset((void *) (uintptr_t) FlashStorePageA, 0xFF, 2 * FlashStorePageSize);
+	Model_Wear(Changes);
+	return Failures != 0;
+}
+
+//Private functions
+static bool Model_Cut(void)
+{
+	if(Budget < 0)
+		return false;
+	return Budget-- == 0;
+}
+
+//False if the power was cut before the store was up
+static bool Model_Boot(void)
+{
+	Budget = (rand() % 2) ? rand() % 4 : -1; //The boot only programs after a cut, in a few steps
+	if(setjmp(Cut))
+	{
+		Budget = -1;
+		return false;
+	}
+	FlashStore_Init();
+	Budget = -1;
+	return true;
+}
+
+static uint32_t Model_Cuts(uint32_t Cuts)
+{
+	//Changed between the setjmp and the longjmp, kept out of the registers
+	volatile uint32_t Stored = 0;
+	volatile bool Present = false;
+	volatile uint32_t Failures = 0, Done = 0, Torn = 0, Boots = 0;
+
+	while(!Model_Boot())
+		Boots++;
+	while(Done < Cuts)
+	{
+		uint32_t Writing = rand(), Read = 0;
+		bool Found;
+
+		FlashStore_Write(FlashKey_Mode, Writing);
+		Tick += FlashStoreMinInterval;
+		//Most flushes are cut, some go through so the pages fill and compact
+		Budget = (rand() % 4) ? rand() % 2000 : -1;
+		if(setjmp(Cut) == 0)
+		{
+			FlashStore_Flush();
+			Budget = -1;
+			Stored = Writing;
+			Present = true;
+			continue;
+		}
+		Done++;
+		do
+			Boots++;
+		while(!Model_Boot());
+		Torn += ConfigStore.Torn;
+		Found = FlashStore_Read(FlashKey_Mode, &Read);
+		if(Found ? (Read != Writing && !(Present && Read == Stored)) : Present)
+		{
+			if(Failures++ < 10)
+				printf("Cut %u: read %s%u, stored %u, writing %u\n", Done, Found ? "" : "nothing ", Read, Stored, Writing);
+			continue;
+		}
+		Present = Found;
+		Stored = Read;
+	}
+	printf("Power cuts: %u, boots %u, torn records skipped %u, failures %u\n", Done, Boots, Torn, Failures);
+	return Failures;
+}
+
+static void Model_Wear(uint32_t Changes)
+{
+	uint32_t Worst;
+
+	Budget = -1;
+	FlashStore_Init();
+	//Every key live, the compactions copy them all
+	for(uint16_t Key = 0; Key < FlashStoreKeys; Key++)
+		FlashStore_Write(Key, Key);
+	FlashStore_Flush();
+	PageErases[0] = PageErases[1] = 0;
+	for(uint32_t Change = 0; Change < Changes; Change++)
+	{
+		FlashStore_Write(FlashKey_Mode, Change);
+		FlashStore_Flush();
+	}
+	Worst = (PageErases[0] > PageErases[1]) ? PageErases[0] : PageErases[1];
+	if(Worst == 0)
+		Worst = 1; //Not enough changes to fill a page
+	printf("Wear: %u changes, erases A %u B %u, %.1f changes per erase of a page, %.2fM changes for %u cycles\n",
+			Changes, PageErases[0], PageErases[1], (double) Changes / Worst,
+			(double) Changes / Worst * PageEndurance / 1e6, PageEndurance);
+}
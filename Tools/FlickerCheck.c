@@ -0,0 +1,175 @@
+/**
+ *  Flicker metrics check, runs on the PC
+ *  Feeds Core/Src/Flicker.c synthetic photodiode waveforms at 9.6kHz in
+ *  DMA halves of 96 samples and compares the percent flicker, the flicker
+ *  index, the dominant frequency and the modulation of its bin with the
+ *  ones of the waveform itself, integrated 100 times finer over a window.
+ *  Fails past 0.5% on the percent flicker, 0.01 on the index, on a wrong
+ *  frequency or past 2% of the modulation plus its 0.1% step: the Q15
+ *  coefficients put the bins up to 0.065 of a bin off their frequency
+ *  (50Hz), the 20% sine on it reads 19.7%. Then times
+ *  the kernel alone on the host, the figure only compares builds, the
+ *  Cortex-M3 cost is the longest DMA ISR run the Flicker screen shows.
+ *  Build: gcc -O2 -ICore/Inc -o FlickerCheck Tools/FlickerCheck.c Core/Src/Flicker.c -lm
+ */
+
+#include "Flicker.h"
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#define AdcRate 9600.0
+#define AdcMax 4095
+#define HalfBuffer 96
+#define CheckHalves 100
+#define Oversampling 100
+#define TimedHalves 2000000
+
+typedef struct Waveform
+{
+	const char *Name;
+	double (*Level)(double Time);
+	uint16_t Frequency; //Expected, Hz
+}Waveform;
+
+static double Check_Sine100(double Time);
+static double Check_Sine120(double Time);
+static double Check_Square100(double Time);
+static double Check_Rectified50(double Time);
+static double Check_Pwm240(double Time);
+static double Check_Dc(double Time);
+static double Check_Sine50(double Time);
+static double Check_Sample(const Waveform *Wave, double Time);
+static void Check_Exact(const Waveform *Wave, double *Percent, double *Index, double *Modulation);
+static uint16_t Check_Bin(uint16_t Frequency);
+
+static const Waveform Waveforms[] = {
+		{"30% sine at 100Hz", Check_Sine100, 100},
+		{"20% sine at 50Hz", Check_Sine50, 50},
+		{"10% sine at 120Hz", Check_Sine120, 120},
+		{"100Hz square", Check_Square100, 100},
+		{"Rectified 50Hz", Check_Rectified50, 100},
+		{"25% PWM at 240Hz", Check_Pwm240, 240},
+		{"DC", Check_Dc, 0}
+};
+
+int main(void)
+{
+	Flicker Meter;
+	FlickerMetrics Metrics;
+	uint16_t Block[HalfBuffer];
+	uint32_t Sample, Failures = 0;
+	double Percent, Index, Modulation, Measured, Seconds;
+	clock_t Start;
+
+	for(uint16_t Wave = 0; Wave < sizeof(Waveforms) / sizeof(Waveform); Wave++)
+	{
+		Flicker_Init(&Meter);
+		Sample = 0;
+		for(uint16_t Half = 0; Half < CheckHalves; Half++)
+		{
+			for(uint16_t Index = 0; Index < HalfBuffer; Index++, Sample++)
+				Block[Index] = (uint16_t) (Check_Sample(&Waveforms[Wave], Sample / AdcRate) + 0.5);
+			Flicker_Process(&Meter, Block, HalfBuffer);
+		}
+		Flicker_Get(&Meter, &Metrics);
+		Check_Exact(&Waveforms[Wave], &Percent, &Index, &Modulation);
+		Measured = Waveforms[Wave].Frequency ? Metrics.Modulation[Check_Bin(Waveforms[Wave].Frequency)] / 10.0 : 0;
+		printf("%-18s PF %5.1f%% (%5.1f)  FI %.3f (%.3f)  %3dHz (%3dHz)  mod %5.1f%% (%5.1f)\n", Waveforms[Wave].Name,
+				Metrics.PercentFlicker / 10.0, Percent, Metrics.Index / 1000.0, Index,
+				Metrics.Frequency, Waveforms[Wave].Frequency, Measured, Modulation);
+		if(fabs(Metrics.PercentFlicker / 10.0 - Percent) > 0.5 || fabs(Metrics.Index / 1000.0 - Index) > 0.01 ||
+				Metrics.Frequency != Waveforms[Wave].Frequency || fabs(Measured - Modulation) > Modulation * 0.02 + 0.1)
+			Failures++;
+	}
+	Flicker_Init(&Meter);
+	for(uint16_t Index = 0; Index < HalfBuffer; Index++)
+		Block[Index] = 2000 + Index * 7;
+	Start = clock();
+	for(uint32_t Half = 0; Half < TimedHalves; Half++)
+		Flicker_Process(&Meter, Block, HalfBuffer);
+	Seconds = (double) (clock() - Start) / CLOCKS_PER_SEC;
+	printf("Host: %.2f ns per sample, failures %u\n", Seconds / ((double) TimedHalves * HalfBuffer) * 1e9, Failures);
+	return Failures != 0;
+}
+
+//Private functions
+static double Check_Sine100(double Time)
+{
+	return 2000 * (1 + 0.3 * sin(2 * M_PI * 100 * Time));
+}
+
+static double Check_Sine120(double Time)
+{
+	return 1500 * (1 + 0.1 * sin(2 * M_PI * 120 * Time));
+}
+
+static double Check_Square100(double Time)
+{
+	return (fmod(Time * 100, 1.0) < 0.5) ? 3000 : 0;
+}
+
+static double Check_Rectified50(double Time)
+{
+	return 3500 * fabs(sin(2 * M_PI * 50 * Time));
+}
+
+static double Check_Pwm240(double Time)
+{
+	return (fmod(Time * 240, 1.0) < 0.25) ? 4000 : 400;
+}
+
+static double Check_Sine50(double Time)
+{
+	return 2500 * (1 + 0.2 * sin(2 * M_PI * 50 * Time));
+}
+
+static double Check_Dc(double Time)
+{
+	(void) Time;
+	return 1800;
+}
+
+static double Check_Sample(const Waveform *Wave, double Time)
+{
+	double Level = Wave->Level(Time);
+
+	return (Level > AdcMax) ? AdcMax : (Level < 0) ? 0 : Level;
+}
+
+//Of the waveform over a window, %. The modulation is the amplitude at the expected frequency over the mean
+static void Check_Exact(const Waveform *Wave, double *Percent, double *Index, double *Modulation)
+{
+	uint32_t Points = FlickerWindow * Oversampling;
+	double Level, Time, Min = AdcMax, Max = 0, Sum = 0, Above = 0, Mean, Real = 0, Imaginary = 0;
+
+	for(uint32_t Point = 0; Point < Points; Point++)
+	{
+		Time = Point / (AdcRate * Oversampling);
+		Level = Check_Sample(Wave, Time);
+		Min = (Level < Min) ? Level : Min;
+		Max = (Level > Max) ? Level : Max;
+		Sum += Level;
+		Real += Level * cos(2 * M_PI * Wave->Frequency * Time);
+		Imaginary += Level * sin(2 * M_PI * Wave->Frequency * Time);
+	}
+	Mean = Sum / Points;
+	for(uint32_t Point = 0; Point < Points; Point++)
+	{
+		Level = Check_Sample(Wave, Point / (AdcRate * Oversampling));
+		if(Level > Mean)
+			Above += Level - Mean;
+	}
+	*Percent = (Max + Min > 0) ? (Max - Min) / (Max + Min) * 100 : 0;
+	*Index = (Sum > 0) ? Above / Sum : 0;
+	*Modulation = (Wave->Frequency && Sum > 0) ? 2 * sqrt(Real * Real + Imaginary * Imaginary) / Sum * 100 : 0;
+}
+
+static uint16_t Check_Bin(uint16_t Frequency)
+{
+	uint16_t Bin = 0;
+
+	while(Bin < FlickerBins - 1 && FlickerFrequencies[Bin] != Frequency)
+		Bin++;
+	return Bin;
+}
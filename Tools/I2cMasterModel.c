@@ -0,0 +1,413 @@
+/**
+ *  Register level I2C master on a bus model, runs on the PC
+ *  Builds Core/Src/I2cMaster.c against a model of the F1 I2C peripheral
+ *  and a BH1750, the bus figures of I2cMaster come from here. The cycle
+ *  counter follows a simulated 72MHz clock that every read of it in a
+ *  wait loop moves on, the peripheral is stepped to it then.
+ *  - 400kHz, 9 bits a byte with the ACK, half a bit for the START and
+ *    for the STOP.
+ *  - The LL calls with side effects on the hardware are the model's: the
+ *    DR write starts the byte, the DR read frees it and the SR1 and SR2
+ *    reads clear ADDR. The rest are the register bits.
+ *  - The receiver follows RM0008 26.3.3: a byte goes to DR if it's free,
+ *    else it stays in the shift register with BTF and SCL held low. The
+ *    ACK is taken at the end of the byte, with POS when it starts.
+ *  - The sensor can stretch the clock before its first byte, to try the
+ *    timeout.
+ *  It prints and checks the wire time of a sensor read and of a one shot
+ *  start, the throughput against I2cMasterCeiling and the bytes read,
+ *  then runs I2cMaster_Compare with a clock stretched past the timeout,
+ *  on the sensor and then on the HAL side only, under its tick timeout.
+ *  The HAL side of the comparison is a stand-in that only takes the wire
+ *  time, the CPU cost of the HAL is what the device measures.
+ *  Build: gcc -O2 -DUSE_HAL_DRIVER -DSTM32F103xB -ICore/Inc -ICore/Src -IDrivers/STM32F1xx_HAL_Driver/Inc
+ *         -IDrivers/CMSIS/Device/ST/STM32F1xx/Include -IDrivers/CMSIS/Include -o I2cMasterModel Tools/I2cMasterModel.c
+ */
+
+#include "I2cMaster.h"
+#include "stm32f1xx_ll_i2c.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+//The core instructions the transfers mask the interrupts with, there's only one thread here
+#define __get_PRIMASK() 0U
+#define __set_PRIMASK(Mask) ((void) (Mask))
+#define __disable_irq() ((void) 0)
+
+//The peripherals the master touches
+static I2C_TypeDef ModelI2c1;
+static DWT_Type ModelDwt;
+static DWT_Type *Sim_Dwt(void);
+#undef I2C1
+#define I2C1 (&ModelI2c1)
+#undef DWT
+#define DWT (Sim_Dwt())
+
+//The register accesses with side effects, the header's inline ones are already defined
+static void Sim_ClearAddr(I2C_TypeDef *Regs);
+static void Sim_Transmit(I2C_TypeDef *Regs, uint8_t Data);
+static uint8_t Sim_Receive(I2C_TypeDef *Regs);
+#define LL_I2C_ClearFlag_ADDR(Regs) Sim_ClearAddr(Regs)
+#define LL_I2C_TransmitData8(Regs, Data) Sim_Transmit(Regs, Data)
+#define LL_I2C_ReceiveData8(Regs) Sim_Receive(Regs)
+
+#define CoreClock 72000000
+#define BitCycles (CoreClock / I2cMasterBitRate)
+#define ByteCycles (9 * BitCycles)
+#define EdgeCycles (BitCycles / 2) //START or STOP
+#define PollCycles 4               //A read of the cycle counter in a wait loop
+#define SensorAddress (0x23 << 1)
+#define SensorOneShot 0x20         //One time H resolution
+#define ReadTimeout 500            //us, BH1750_ReadTimeout
+#define StretchTime 600            //us, past the timeout
+
+typedef enum SimPhase
+{
+	Phase_Idle,
+	Phase_Start,   //START on the wire
+	Phase_Address, //SB set, waits for the address in DR
+	Phase_Shift,   //A byte on the wire
+	Phase_Held,    //SCL low: ADDR, BTF or the last byte done
+	Phase_Stop
+}SimPhase;
+
+typedef struct SimBus
+{
+	SimPhase Phase;
+	uint64_t Due;      //End of the current phase, cycles
+	uint64_t Began;    //START asked for
+	uint64_t Ended;    //STOP done
+	bool Read;
+	bool Addressing;   //The byte shifting is the address
+	bool Acked;        //Of the last byte done
+	bool PosAck;       //ACK taken at the start of the byte, with POS
+	bool Shift;        //A received byte waits in the shift register
+	bool Pending;      //A byte to send waits in DR
+	uint8_t ShiftData;
+	uint8_t TxData;
+	uint8_t Next;      //The sensor's next byte
+	uint32_t Stretch;  //Cycles the sensor holds SCL before its first byte
+	uint8_t Sent[4];
+	uint8_t SentBytes;
+}SimBus;
+
+uint32_t SystemCoreClock = CoreClock;
+I2C_HandleTypeDef hi2c1;
+static uint64_t Cycles;
+static SimBus Bus;
+static uint32_t HalStretch; //Cycles the stand-in of the HAL takes on top
+
+static void Sim_Step(void);
+
+static DWT_Type *Sim_Dwt(void)
+{
+	Cycles += PollCycles;
+	ModelDwt.CYCCNT = (uint32_t) Cycles;
+	Sim_Step();
+	return &ModelDwt;
+}
+
+uint32_t HAL_GetTick(void)
+{
+	return (uint32_t) (Cycles / (CoreClock / 1000));
+}
+
+bool I2cBus_Ready(I2C_HandleTypeDef *Handle)
+{
+	(void) Handle;
+	return true;
+}
+
+void I2cBus_Traffic(I2C_HandleTypeDef *Handle, uint16_t Address, uint32_t Transactions, uint32_t Bytes, uint32_t Cycles)
+{
+	(void) Handle;
+	(void) Address;
+	(void) Transactions;
+	(void) Bytes;
+	(void) Cycles;
+}
+
+//Stands in for the HAL in I2cMaster_Compare: the wire time of the read and the tick timeout, no CPU cost
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *Handle, uint16_t Address, uint8_t *Data, uint16_t Size,
+		uint32_t Timeout)
+{
+	uint32_t Start = HAL_GetTick();
+
+	(void) Handle;
+	(void) Address;
+	Cycles += 2 * EdgeCycles + (uint64_t) (Size + 1) * ByteCycles + Bus.Stretch + HalStretch;
+	for(uint16_t Index = 0; Index < Size; Index++)
+		Data[Index] = Bus.Next++;
+	return (HAL_GetTick() - Start > Timeout) ? HAL_TIMEOUT : HAL_OK;
+}
+
+#include "I2cMaster.c"
+
+static int Sim_Check(const char *What, double Got, double Expected, double Tolerance);
+static double Sim_Us(uint64_t Span);
+
+int main(void)
+{
+	I2cMasterComparison Comparison;
+	uint8_t Data[4], Command = SensorOneShot, First;
+	uint32_t Throughput;
+	double Wire;
+	int Failures = 0;
+
+	hi2c1.Instance = I2C1;
+	hi2c1.State = HAL_I2C_STATE_READY;
+	ModelI2c1.CR1 = I2C_CR1_PE;
+
+	//The one shot start, address and command
+	Failures += Sim_Check("One shot result", I2cMaster_Transmit(&hi2c1, SensorAddress, &Command, 1, ReadTimeout), HAL_OK, 0);
+	Sim_Step();
+	while(Bus.Phase != Phase_Idle)
+		Sim_Dwt();
+	printf("One shot start: %.2fus on the wire\n", Sim_Us(Bus.Ended - Bus.Began));
+	Failures += Sim_Check("One shot wire time", Sim_Us(Bus.Ended - Bus.Began), 47.5, 0.25);
+	Failures += Sim_Check("One shot command", Bus.SentBytes == 1 && Bus.Sent[0] == SensorOneShot, 1, 0);
+
+	//The sensor reads, 2 bytes then the 1 and 3 byte sequences
+	I2cMasterInfo[0] = (I2cMasterStats) {0};
+	for(uint16_t Length = 2; Length <= 3; Length++)
+	{
+		First = Bus.Next;
+		Failures += Sim_Check("Read result", I2cMaster_Receive(&hi2c1, SensorAddress, Data, Length, ReadTimeout), HAL_OK, 0);
+		while(Bus.Phase != Phase_Idle)
+			Sim_Dwt();
+		for(uint16_t Index = 0; Index < Length; Index++)
+			Failures += Sim_Check("Byte read", Data[Index], (uint8_t) (First + Index), 0);
+		printf("Read of %u bytes: %.2fus on the wire, %.2fus in the call\n", Length, Sim_Us(Bus.Ended - Bus.Began),
+				Sim_Us(I2cMasterInfo[0].MaxCycles));
+		if(Length == 2)
+		{
+			Failures += Sim_Check("Read wire time", Sim_Us(Bus.Ended - Bus.Began), 70, 0.25);
+			//The stats stop at the end of the call, the STOP is still on the wire
+			Wire = 3e6 / Sim_Us(Bus.Ended - Bus.Began);
+			Throughput = I2cMaster_Throughput(&hi2c1);
+			printf("Throughput %.0fB/s on the wire, %.1f%% of the %dB/s ceiling, the stats read %luB/s\n", Wire,
+					Wire * 100 / I2cMasterCeiling, I2cMasterCeiling, (unsigned long) Throughput);
+			Failures += Sim_Check("Throughput", Wire * 100 / I2cMasterCeiling, 96.4, 0.5);
+		}
+	}
+	First = Bus.Next;
+	Failures += Sim_Check("Read of 1 result", I2cMaster_Receive(&hi2c1, SensorAddress, Data, 1, ReadTimeout), HAL_OK, 0);
+	Failures += Sim_Check("Byte read", Data[0], First, 0);
+	while(Bus.Phase != Phase_Idle)
+		Sim_Dwt();
+
+	//Both sides of the comparison against the same bound
+	I2cMaster_Compare(&hi2c1, SensorAddress, 2, 8, ReadTimeout, &Comparison);
+	printf("Compare: %u runs, %u failures, %.2fus HAL, %.2fus LL\n", Comparison.Runs, Comparison.Failures,
+			Sim_Us(Comparison.HalCycles), Sim_Us(Comparison.LlCycles));
+	Failures += Sim_Check("Compare runs", Comparison.Runs, 8, 0);
+	Bus.Stretch = StretchTime * (CoreClock / 1000000);
+	I2cMaster_Compare(&hi2c1, SensorAddress, 2, 8, ReadTimeout, &Comparison);
+	printf("Compare stretched %dus: %u runs, %u failures, error code 0x%lx\n", StretchTime, Comparison.Runs,
+			Comparison.Failures, (unsigned long) hi2c1.ErrorCode);
+	Failures += Sim_Check("Stretched runs", Comparison.Runs, 0, 0);
+	Failures += Sim_Check("Stretched failures", Comparison.Failures, 8, 0);
+	Failures += Sim_Check("Stretched timeout", (hi2c1.ErrorCode & HAL_I2C_ERROR_TIMEOUT) != 0, 1, 0);
+	//Within the HAL tick timeout, still past the bound of the LL read
+	HalStretch = Bus.Stretch;
+	Bus.Stretch = 0;
+	I2cMaster_Compare(&hi2c1, SensorAddress, 2, 8, ReadTimeout, &Comparison);
+	printf("Compare HAL side %dus slower: %u runs, %u failures\n", StretchTime, Comparison.Runs, Comparison.Failures);
+	Failures += Sim_Check("HAL stretched runs", Comparison.Runs, 0, 0);
+	Failures += Sim_Check("HAL stretched failures", Comparison.Failures, 8, 0);
+	printf(Failures ? "FAILED\n" : "OK\n");
+	return Failures ? 1 : 0;
+}
+
+//Private functions
+//The bus up to the cycle counter, one phase after another
+static void Sim_Step(void)
+{
+	I2C_TypeDef *Regs = &ModelI2c1;
+	bool Moved = true;
+
+	while(Moved)
+	{
+		Moved = false;
+		switch(Bus.Phase)
+		{
+			case Phase_Idle:
+				if(Regs->CR1 & I2C_CR1_START)
+				{
+					Bus.Began = Cycles;
+					Bus.Due = Cycles + EdgeCycles;
+					Bus.Phase = Phase_Start;
+					Regs->SR2 |= I2C_SR2_BUSY | I2C_SR2_MSL;
+					Moved = true;
+				}
+			break;
+			case Phase_Start:
+				if(Cycles >= Bus.Due)
+				{
+					Regs->CR1 &= ~I2C_CR1_START;
+					Regs->SR1 |= I2C_SR1_SB;
+					Bus.Phase = Phase_Address;
+					Moved = true;
+				}
+			break;
+			case Phase_Address:
+			break;
+			case Phase_Shift:
+				if(Cycles < Bus.Due)
+					break;
+				Moved = true;
+				Bus.Phase = Phase_Held;
+				if(Bus.Addressing)
+				{
+					Bus.Addressing = false;
+					if(Bus.Acked)
+						Regs->SR1 |= I2C_SR1_ADDR;
+					else
+						Regs->SR1 |= I2C_SR1_AF;
+				}
+				else if(Bus.Read)
+				{
+					Bus.Acked = (Regs->CR1 & I2C_CR1_POS) ? Bus.PosAck : (Regs->CR1 & I2C_CR1_ACK) != 0;
+					if(Regs->SR1 & I2C_SR1_RXNE)
+					{
+						Bus.Shift = true;
+						Regs->SR1 |= I2C_SR1_BTF;
+					}
+					else
+					{
+						Regs->DR = Bus.ShiftData;
+						Regs->SR1 |= I2C_SR1_RXNE;
+						if(Bus.Acked)
+						{
+							Bus.ShiftData = Bus.Next++;
+							Bus.PosAck = (Regs->CR1 & I2C_CR1_ACK) != 0;
+							Bus.Due = Cycles + ByteCycles;
+							Bus.Phase = Phase_Shift;
+						}
+					}
+				}
+				else
+				{
+					if(Bus.SentBytes < sizeof(Bus.Sent))
+						Bus.Sent[Bus.SentBytes++] = Bus.TxData;
+					if(Bus.Pending)
+					{
+						Bus.Pending = false;
+						Bus.TxData = (uint8_t) Regs->DR;
+						Regs->SR1 |= I2C_SR1_TXE;
+						Bus.Due = Cycles + ByteCycles;
+						Bus.Phase = Phase_Shift;
+					}
+					else
+						Regs->SR1 |= I2C_SR1_BTF;
+				}
+			break;
+			case Phase_Held:
+				//STOP once nothing is owed: ADDR cleared and the last byte done
+				if((Regs->CR1 & I2C_CR1_STOP) && !(Regs->SR1 & I2C_SR1_ADDR) && !Bus.Shift && !Bus.Pending)
+				{
+					Bus.Due = Cycles + EdgeCycles;
+					Bus.Phase = Phase_Stop;
+					Moved = true;
+				}
+			break;
+			case Phase_Stop:
+				if(Cycles >= Bus.Due)
+				{
+					Regs->CR1 &= ~I2C_CR1_STOP;
+					Regs->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_BTF);
+					Regs->SR2 &= ~(I2C_SR2_BUSY | I2C_SR2_MSL);
+					Bus.Ended = Cycles;
+					Bus.Phase = Phase_Idle;
+					Moved = true;
+				}
+			break;
+		}
+	}
+}
+
+//SR1 then SR2: ADDR cleared, the data phase starts
+static void Sim_ClearAddr(I2C_TypeDef *Regs)
+{
+	if(!(Regs->SR1 & I2C_SR1_ADDR))
+		return;
+	Regs->SR1 &= ~I2C_SR1_ADDR;
+	if(Bus.Read)
+	{
+		Bus.ShiftData = Bus.Next++;
+		Bus.PosAck = (Regs->CR1 & I2C_CR1_ACK) != 0;
+		Bus.Due = Cycles + Bus.Stretch + ByteCycles;
+		Bus.Phase = Phase_Shift;
+	}
+	else
+		Regs->SR1 |= I2C_SR1_TXE;
+	Sim_Step();
+}
+
+//DR write: the address after SB, else a byte to send
+static void Sim_Transmit(I2C_TypeDef *Regs, uint8_t Data)
+{
+	Regs->DR = Data;
+	if(Bus.Phase == Phase_Address && (Regs->SR1 & I2C_SR1_SB))
+	{
+		Regs->SR1 &= ~I2C_SR1_SB;
+		Bus.Read = (Data & 0x01) != 0;
+		Bus.Addressing = true;
+		Bus.Acked = (Data & 0xFE) == SensorAddress;
+		Bus.SentBytes = 0;
+		Bus.Due = Cycles + ByteCycles;
+		Bus.Phase = Phase_Shift;
+	}
+	else if(Bus.Phase == Phase_Held && (Regs->SR1 & I2C_SR1_TXE))
+	{
+		//Straight to the shift register
+		Regs->SR1 &= ~I2C_SR1_BTF;
+		Bus.TxData = Data;
+		Bus.Due = Cycles + ByteCycles;
+		Bus.Phase = Phase_Shift;
+	}
+	else
+	{
+		Regs->SR1 &= ~I2C_SR1_TXE;
+		Bus.Pending = true;
+	}
+}
+
+//DR read: the held byte moves in and the next one is clocked if it was acknowledged
+static uint8_t Sim_Receive(I2C_TypeDef *Regs)
+{
+	uint8_t Data = (uint8_t) Regs->DR;
+
+	Regs->SR1 &= ~I2C_SR1_RXNE;
+	if(Bus.Shift)
+	{
+		Bus.Shift = false;
+		Regs->SR1 &= ~I2C_SR1_BTF;
+		Regs->DR = Bus.ShiftData;
+		Regs->SR1 |= I2C_SR1_RXNE;
+		if(Bus.Acked)
+		{
+			Bus.ShiftData = Bus.Next++;
+			Bus.PosAck = (Regs->CR1 & I2C_CR1_ACK) != 0;
+			Bus.Due = Cycles + ByteCycles;
+			Bus.Phase = Phase_Shift;
+		}
+	}
+	Sim_Step();
+	return Data;
+}
+
+static int Sim_Check(const char *What, double Got, double Expected, double Tolerance)
+{
+	if(Got < Expected - Tolerance || Got > Expected + Tolerance)
+	{
+		printf("%s: %g, expected %g\n", What, Got, Expected);
+		return 1;
+	}
+	return 0;
+}
+
+static double Sim_Us(uint64_t Span)
+{
+	return Span / (CoreClock / 1e6);
+}
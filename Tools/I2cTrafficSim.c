@@ -0,0 +1,297 @@
+/**
+ *  I2C traffic accounting simulation, runs on the PC
+ *  Builds Core/Src/I2cBus.c against host shims and reads the I2cDevices
+ *  table the Diagnostics page shows. I2C1, I2C2, GPIOB and the cycle
+ *  counter are structures in the RAM, the cycle counter follows a
+ *  simulated 72MHz clock that each transaction moves by its time on the
+ *  wire at 400kHz (9 bits a byte) and the tick is derived from it. The
+ *  buses run one after the other, each charge is its own wire time.
+ *  - The two heads are read on I2C2 every 120ms and charged like
+ *    I2cMaster does: one transaction, the register bytes plus the address.
+ *  - The display is flushed every 100ms on I2C1 following Display_Update:
+ *    skipped while the bus is parked, only the bus time when the flush
+ *    failed, the 32 transactions and 1112 bytes when it went through.
+ *  - A logger page goes to the EEPROM every 2s through the queue, which
+ *    waits while the bus is parked.
+ *  - The display doesn't answer from 3.0 to 3.5s (NACK) and a bus error
+ *    keeps I2C1 from 6 to 8s, which parks it with the doubling backoff.
+ *  I2cBus_task runs every ms. The table is printed once a simulated
+ *  second and the totals checked against what went through.
+ *  Build: gcc -O2 -DUSE_HAL_DRIVER -DSTM32F103xB -ICore/Inc -ICore/Src -IDrivers/STM32F1xx_HAL_Driver/Inc
+ *         -IDrivers/CMSIS/Device/ST/STM32F1xx/Include -IDrivers/CMSIS/Include -o I2cTrafficSim Tools/I2cTrafficSim.c
+ *  Use:   I2cTrafficSim [seconds]
+ */
+
+#include "I2cBus.h"
+#include "I2cMaster.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//The core instructions the accounting masks the interrupts with, there's only one thread here
+#define __get_PRIMASK() 0U
+#define __set_PRIMASK(Mask) ((void) (Mask))
+#define __disable_irq() ((void) 0)
+#define __DMB() ((void) 0)
+
+//The peripherals the bus code touches
+static I2C_TypeDef ModelI2c1, ModelI2c2;
+static GPIO_TypeDef ModelGpio;
+static CoreDebug_Type ModelDebug;
+static DWT_Type ModelDwt;
+static DWT_Type *Sim_Dwt(void);
+#undef I2C1
+#define I2C1 (&ModelI2c1)
+#undef I2C2
+#define I2C2 (&ModelI2c2)
+#undef GPIOB
+#define GPIOB (&ModelGpio)
+#undef CoreDebug
+#define CoreDebug (&ModelDebug)
+#undef DWT
+#define DWT (Sim_Dwt())
+
+#define CoreClock 72000000
+#define CyclesPerByte (9 * CoreClock / 400000) //At 400kHz
+#define PollCycles 4                           //A read of the cycle counter in a wait loop
+#define DisplayAddress 0x78
+#define DisplayFlushBytes 1112
+#define DisplayFlushTransactions 32
+#define DisplayPeriod 100 //ms
+#define EepromAddress 0xA0
+#define EepromPageBytes 19 //Address, 2 register bytes, 16 of data
+#define EepromPeriod 2000  //ms
+#define HeadAddressLow (0x23 << 1)
+#define HeadAddressHigh (0x5C << 1)
+#define HeadBytes 3        //Address and 2 of data
+#define HeadPeriod 120     //ms
+#define NackStart 3000
+#define NackEnd 3500
+#define FaultStart 6000
+#define FaultEnd 8000
+
+uint32_t SystemCoreClock = CoreClock;
+I2C_HandleTypeDef hi2c1, hi2c2;
+static uint64_t Cycles;
+
+static DWT_Type *Sim_Dwt(void)
+{
+	Cycles += PollCycles;
+	ModelDwt.CYCCNT = (uint32_t) Cycles;
+	return &ModelDwt;
+}
+
+uint32_t HAL_GetTick(void)
+{
+	return (uint32_t) (Cycles / (CoreClock / 1000));
+}
+
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c)
+{
+	hi2c->State = HAL_I2C_STATE_RESET;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c)
+{
+	hi2c->State = HAL_I2C_STATE_READY;
+	hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+	return HAL_OK;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+	(void) GPIOx;
+	(void) GPIO_Init;
+}
+
+HAL_StatusTypeDef I2cMaster_IsDeviceReady(I2C_HandleTypeDef *Handle, uint16_t Address, uint32_t Timeout)
+{
+	(void) Handle;
+	(void) Address;
+	(void) Timeout;
+	return HAL_OK;
+}
+
+#include "I2cBus.c"
+
+typedef struct SimCounts
+{
+	uint32_t Flushes;  //Went through
+	uint32_t Failed;
+	uint32_t Parked;   //Skipped while parked
+	uint32_t Nacks;
+	uint32_t BusErrors;
+	uint32_t Pages;
+	uint32_t Reads;
+}SimCounts;
+
+static SimCounts Counts;
+
+static void Sim_Flush(void);
+static void Sim_Page(void);
+static void Sim_Read(uint16_t Address);
+static void Sim_Print(uint32_t Second);
+static I2cDevice *Sim_Find(I2C_HandleTypeDef *Handle, uint16_t Address);
+static int Sim_Check(const char *What, uint32_t Got, uint32_t Expected);
+
+int main(int argc, char *argv[])
+{
+	uint32_t Seconds = (argc > 1) ? (uint32_t) atoi(argv[1]) : 10;
+	uint32_t NextFlush = 0, NextPage = EepromPeriod, NextRead = 0, NextPrint = 1000;
+	uint32_t Pending = 0, Tick;
+	I2cDevice *Display, *Eeprom;
+	int Failures = 0;
+
+	memset(&ModelGpio, 0xFF, sizeof(ModelGpio));
+	hi2c1.Instance = I2C1;
+	hi2c2.Instance = I2C2;
+	HAL_I2C_Init(&hi2c1);
+	HAL_I2C_Init(&hi2c2);
+	I2cBus_Init(&hi2c1, &hi2c2);
+	I2cBus_Name(&hi2c1, DisplayAddress, "OLED");
+	I2cBus_Name(&hi2c1, EepromAddress, "EEP");
+	I2cBus_Name(&hi2c2, HeadAddressLow, "LUX");
+	I2cBus_Name(&hi2c2, HeadAddressHigh, "AUX");
+	while((Tick = HAL_GetTick()) < Seconds * 1000)
+	{
+		if((int32_t) (Tick - NextRead) >= 0)
+		{
+			Sim_Read(HeadAddressLow);
+			Sim_Read(HeadAddressHigh);
+			NextRead += HeadPeriod;
+		}
+		if((int32_t) (Tick - NextFlush) >= 0)
+		{
+			Sim_Flush();
+			NextFlush += DisplayPeriod;
+		}
+		if((int32_t) (Tick - NextPage) >= 0)
+		{
+			Pending++;
+			NextPage += EepromPeriod;
+		}
+		for(; Pending > 0 && I2cBus_Ready(&hi2c1); Pending--)
+			Sim_Page();
+		I2cBus_task();
+		if((int32_t) (Tick - NextPrint) >= 0)
+		{
+			Sim_Print(NextPrint / 1000);
+			NextPrint += 1000;
+		}
+		//Idle until the next ms, unless a transaction already went past it
+		if(Cycles < (uint64_t) (Tick + 1) * (CoreClock / 1000))
+			Cycles = (uint64_t) (Tick + 1) * (CoreClock / 1000);
+	}
+	Display = Sim_Find(&hi2c1, DisplayAddress);
+	Eeprom = Sim_Find(&hi2c1, EepromAddress);
+	printf("Display: %u flushes, %u failed, %u skipped parked. EEPROM: %u pages. Heads: %u reads. %u recoveries, last backoff %ums\n",
+			Counts.Flushes, Counts.Failed, Counts.Parked, Counts.Pages, Counts.Reads, I2cBusInfo[0].Recoveries, I2cBusInfo[0].Backoff);
+	Failures += Sim_Check("display bytes", Display->Bytes, Counts.Flushes * DisplayFlushBytes);
+	Failures += Sim_Check("display transactions", Display->Transactions, Counts.Flushes * DisplayFlushTransactions);
+	Failures += Sim_Check("display skipped", Display->Skipped, Counts.Parked);
+	Failures += Sim_Check("display NACKs", Display->Faults[I2c_Nack], Counts.Nacks);
+	Failures += Sim_Check("display bus errors", Display->Faults[I2c_BusError], Counts.BusErrors);
+	Failures += Sim_Check("EEPROM bytes", Eeprom->Bytes, Counts.Pages * EepromPageBytes);
+	Failures += Sim_Check("head bytes", Sim_Find(&hi2c2, HeadAddressLow)->Bytes + Sim_Find(&hi2c2, HeadAddressHigh)->Bytes,
+			Counts.Reads * HeadBytes);
+	Failures += Sim_Check("I2C2 faults", I2cBus_DeviceFaults(Sim_Find(&hi2c2, HeadAddressLow)), 0);
+	printf("%s\n", Failures ? "FAILED" : "OK");
+	return Failures != 0;
+}
+
+//Private functions
+//Display_Update with the library flush: its calls only leave the error of the last one in the handle
+static void Sim_Flush(void)
+{
+	uint32_t Start, Spent, Tick = HAL_GetTick();
+	HAL_StatusTypeDef Result;
+
+	if(!I2cBus_Ready(&hi2c1))
+	{
+		I2cBus_Report(&hi2c1, DisplayAddress, HAL_BUSY);
+		Counts.Parked++;
+		return;
+	}
+	Start = DWT -> CYCCNT;
+	if(Tick >= NackStart && Tick < NackEnd)
+	{
+		//Every transaction stops at the address
+		Cycles += DisplayFlushTransactions * CyclesPerByte;
+		hi2c1.ErrorCode = HAL_I2C_ERROR_AF;
+		Counts.Nacks++;
+	}
+	else if(Tick >= FaultStart && Tick < FaultEnd)
+	{
+		//The first transaction sees the misplaced STOP, the rest time out at the HAL's BUSY wait
+		Cycles += CyclesPerByte;
+		hi2c1.ErrorCode = HAL_I2C_ERROR_BERR;
+		Counts.BusErrors++;
+	}
+	else
+		Cycles += (uint64_t) DisplayFlushBytes * CyclesPerByte;
+	Spent = DWT -> CYCCNT - Start;
+	Result = (hi2c1.ErrorCode == HAL_I2C_ERROR_NONE && I2cBus_Ready(&hi2c1)) ? HAL_OK : HAL_ERROR;
+	if(I2cBus_Report(&hi2c1, DisplayAddress, Result) != HAL_OK)
+	{
+		I2cBus_Traffic(&hi2c1, DisplayAddress, 0, 0, Spent);
+		Counts.Failed++;
+		return;
+	}
+	I2cBus_Traffic(&hi2c1, DisplayAddress, DisplayFlushTransactions, DisplayFlushBytes, Spent);
+	Counts.Flushes++;
+}
+
+//A chunk of I2cQueue, the whole page in one transaction
+static void Sim_Page(void)
+{
+	uint32_t Start = DWT -> CYCCNT;
+
+	Cycles += EepromPageBytes * CyclesPerByte;
+	I2cBus_Report(&hi2c1, EepromAddress, HAL_OK);
+	I2cBus_Traffic(&hi2c1, EepromAddress, 1, EepromPageBytes, DWT -> CYCCNT - Start);
+	Counts.Pages++;
+}
+
+//A read of I2cMaster from the acquisition ISR
+static void Sim_Read(uint16_t Address)
+{
+	uint32_t Start = DWT -> CYCCNT;
+
+	Cycles += HeadBytes * CyclesPerByte;
+	I2cBus_Report(&hi2c2, Address, HAL_OK);
+	I2cBus_Traffic(&hi2c2, Address, 1, HeadBytes, DWT -> CYCCNT - Start);
+	Counts.Reads++;
+}
+
+//The rates of the second I2cBus_task just closed
+static void Sim_Print(uint32_t Second)
+{
+	const I2cDevice *Device;
+
+	printf("%3us %s\n", Second, I2cBusInfo[0].Parked ? "I2C1 parked" : "");
+	for(uint16_t Index = 0; Index < I2cDeviceCount; Index++)
+	{
+		Device = &I2cDevices[Index];
+		printf("      %-4s %5u tr/s %6u B/s %4u o/oo busy %4u err/s, %u skipped, %u faults\n", Device->Name,
+				Device->TransactionsPerSecond, Device->BytesPerSecond, Device->BusyPerMille, Device->ErrorsPerSecond,
+				Device->Skipped, I2cBus_DeviceFaults(Device));
+	}
+}
+
+static I2cDevice *Sim_Find(I2C_HandleTypeDef *Handle, uint16_t Address)
+{
+	for(uint16_t Index = 0; Index < I2cDeviceCount; Index++)
+		if(I2cDevices[Index].Bus == Handle && I2cDevices[Index].Address == Address)
+			return &I2cDevices[Index];
+	fprintf(stderr, "Device %02X isn't in the table\n", Address);
+	exit(1);
+}
+
+static int Sim_Check(const char *What, uint32_t Got, uint32_t Expected)
+{
+	if(Got == Expected)
+		return 0;
+	printf("Wrong %s: %u, expected %u\n", What, Got, Expected);
+	return 1;
+}
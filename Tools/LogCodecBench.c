@@ -0,0 +1,236 @@
+/**
+ *  Log codec round trip test and compression benchmark, runs on the PC
+ *  Round trip: random records (steady, off step, big jumps both ways, 0
+ *  and LogCodecMaxLux) are packed into buffers of random sizes until they
+ *  are full, a refused record has to leave the buffer as it was, and every
+ *  buffer has to decode to the same records.
+ *  Benchmark: a synthetic office light trace (slow drift, sensor noise,
+ *  lights switched now and then, a late record now and then) packed into
+ *  log blocks, the records per block and the bytes per record with the
+ *  block header against 8 of a timestamp and a float.
+ *  Timing: LogCodec_Put alone over the same trace, already in memory,
+ *  the best of a few passes in ns and TSC cycles per record of this PC.
+ *  The cycles on the instrument are on the log page of Diagnostics, the
+ *  DWT counter around the same call in Logger.c.
+ *  Build: gcc -O2 -ICore/Inc -o LogCodecBench Tools/LogCodecBench.c Core/Src/LogCodec.c
+ *  Use:   LogCodecBench [block size] [header size]   (defaults from LogBlock.h)
+ */
+
+#include "LogBlock.h"
+#include "LogCodec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define Bench_Cycles() __rdtsc()
+#else
+#define Bench_Cycles() 0ULL
+#endif
+
+#define BenchRecords 1000000
+#define TimingPasses 5
+#define TestBuffers 200000
+#define MaxBuffer 256
+
+typedef struct Record
+{
+	uint32_t Time;
+	uint32_t Lux;
+}Record;
+
+static uint32_t Bench_RoundTrip(void);
+static void Bench_Ratio(uint16_t BlockSize, uint16_t HeaderSize);
+static void Bench_Timing(uint16_t Size);
+static uint32_t Bench_Check(const uint8_t *Data, uint16_t Size, const Record *Records, uint16_t Count, uint16_t Step);
+static uint32_t Bench_Random(void);
+
+int main(int argc, char **argv)
+{
+	uint16_t BlockSize = (argc > 1) ? atoi(argv[1]) : LogBlockSize;
+	uint16_t HeaderSize = (argc > 2) ? atoi(argv[2]) : LogBlockSize - LogDataSize;
+	uint32_t Failures;
+
+	if(BlockSize <= HeaderSize || BlockSize - HeaderSize > MaxBuffer)
+	{
+		fprintf(stderr, "Data size out of 1..%d\n", MaxBuffer);
+		return 2;
+	}
+	srand(7);
+	Failures = Bench_RoundTrip();
+	Bench_Ratio(BlockSize, HeaderSize);
+	return Failures != 0;
+}
+
+//Private functions
+static uint32_t Bench_RoundTrip(void)
+{
+	static Record Records[MaxBuffer];
+	uint8_t Data[MaxBuffer], Before[MaxBuffer];
+	LogEncoder Encoder;
+	uint16_t Size, Step, Count, Used;
+	uint32_t Time, Lux, Failures = 0, Total = 0;
+	int64_t Next;
+
+	for(uint32_t Buffer = 0; Buffer < TestBuffers; Buffer++)
+	{
+		Size = 1 + rand() % MaxBuffer;
+		Step = 1 + rand() % 1000;
+		memset(Data, 0xFF, sizeof(Data));
+		LogCodec_Start(&Encoder, Data, Size, Step);
+		Time = rand() % 1000;
+		Lux = Bench_Random() % (LogCodecMaxLux + 1);
+		for(Count = 0;;)
+		{
+			memcpy(Before, Data, sizeof(Data));
+			Used = Encoder.Used;
+			if(!LogCodec_Put(&Encoder, Time, Lux))
+			{
+				if(Encoder.Used != Used || Encoder.Count != Count || memcmp(Before, Data, sizeof(Data)))
+				{
+					if(Failures++ < 10)
+						printf("Buffer %u: a refused record changed it\n", Buffer);
+				}
+				break;
+			}
+			Records[Count].Time = Time;
+			Records[Count++].Lux = Lux;
+			//Mostly on step and close, some off step, far or at the ends of the range
+			switch(rand() % 8)
+			{
+				case 0:
+					Time += rand() % (3 * Step);
+				break;
+				default:
+					Time += Step;
+				break;
+			}
+			switch(rand() % 10)
+			{
+				case 0:
+					Lux = 0;
+				break;
+				case 1:
+					Lux = LogCodecMaxLux;
+				break;
+				case 2:
+					Lux = Bench_Random() % (LogCodecMaxLux + 1);
+				break;
+				default:
+					Next = (int64_t) Lux + rand() % 65 - 32;
+					Lux = (Next < 0) ? 0 : (Next > LogCodecMaxLux) ? LogCodecMaxLux : (uint32_t) Next;
+				break;
+			}
+		}
+		Total += Count;
+		Failures += Bench_Check(Data, Size, Records, Count, Step);
+	}
+	printf("Round trip: %u buffers, %u records, failures %u\n", TestBuffers, Total, Failures);
+	return Failures;
+}
+
+static Record Trace[BenchRecords];
+
+static void Bench_Ratio(uint16_t BlockSize, uint16_t HeaderSize)
+{
+	static Record Records[MaxBuffer];
+	uint8_t Data[MaxBuffer];
+	LogEncoder Encoder;
+	uint16_t Size = BlockSize - HeaderSize, Count = 0;
+	uint32_t Time = 0, Lux, Blocks = 0, Packed = 0, Failures = 0;
+	double Light = 350;
+
+	LogCodec_Start(&Encoder, Data, Size, LogPeriod / 100);
+	for(uint32_t Index = 0; Index < BenchRecords; Index++)
+	{
+		Light += (rand() % 21 - 10) * 0.05;
+		if(rand() % 500 == 0)
+			Light = (rand() % 2) ? Light * 3 : Light / 3;
+		if(Light < 0.5)
+			Light = 0.5;
+		if(Light > 65535) //BH1750 range
+			Light = 65535;
+		Lux = (uint32_t) (Light * 10 + 0.5);
+		Time += LogPeriod / 100 + ((rand() % 50 == 0) ? rand() % 5 : 0);
+		Trace[Index].Lux = Lux;
+		Trace[Index].Time = Time;
+		if(!LogCodec_Put(&Encoder, Time, Lux))
+		{
+			Failures += Bench_Check(Data, Size, Records, Count, LogPeriod / 100);
+			Packed += Encoder.Count;
+			Blocks++;
+			LogCodec_Start(&Encoder, Data, Size, LogPeriod / 100);
+			Time = Count = 0;
+			Trace[Index].Time = Time;
+			LogCodec_Put(&Encoder, Time, Lux);
+		}
+		Records[Count].Time = Time;
+		Records[Count++].Lux = Lux;
+	}
+	printf("Office trace, %u byte blocks with a %u byte header: %.1f records per block, %.2f bytes per record, "
+			"%.1fx against 8 bytes, failures %u\n", BlockSize, HeaderSize, (double) Packed / Blocks,
+			(double) BlockSize * Blocks / Packed, 8.0 * Packed / ((double) BlockSize * Blocks), Failures);
+	Bench_Timing(Size);
+}
+
+//The trace again with only the codec in the loop, a refused record starts the next block like in Logger_Store
+static void Bench_Timing(uint16_t Size)
+{
+	uint8_t Data[MaxBuffer];
+	LogEncoder Encoder;
+	struct timespec Start, End;
+	uint64_t Cycles, BestCycles = UINT64_MAX;
+	double Seconds, Best = 1e9;
+
+	for(uint16_t Pass = 0; Pass < TimingPasses; Pass++)
+	{
+		LogCodec_Start(&Encoder, Data, Size, LogPeriod / 100);
+		clock_gettime(CLOCK_MONOTONIC, &Start);
+		Cycles = Bench_Cycles();
+		for(uint32_t Index = 0; Index < BenchRecords; Index++)
+		{
+			if(!LogCodec_Put(&Encoder, Trace[Index].Time, Trace[Index].Lux))
+			{
+				LogCodec_Start(&Encoder, Data, Size, LogPeriod / 100);
+				LogCodec_Put(&Encoder, Trace[Index].Time, Trace[Index].Lux);
+			}
+		}
+		Cycles = Bench_Cycles() - Cycles;
+		clock_gettime(CLOCK_MONOTONIC, &End);
+		Seconds = (End.tv_sec - Start.tv_sec) + (End.tv_nsec - Start.tv_nsec) / 1e9;
+		if(Seconds < Best)
+			Best = Seconds;
+		if(Cycles < BestCycles)
+			BestCycles = Cycles;
+	}
+	printf("LogCodec_Put over the trace: %.1f ns, %.1f TSC cycles per record on this PC\n", Best * 1e9 / BenchRecords,
+			(double) BestCycles / BenchRecords);
+}
+
+static uint32_t Bench_Check(const uint8_t *Data, uint16_t Size, const Record *Records, uint16_t Count, uint16_t Step)
+{
+	LogDecoder Decoder;
+	uint32_t Time, Lux;
+
+	LogCodec_Open(&Decoder, Data, Size, Count, Step);
+	for(uint16_t Index = 0; Index < Count; Index++)
+	{
+		if(!LogCodec_Get(&Decoder, &Time, &Lux) || Time != Records[Index].Time || Lux != Records[Index].Lux)
+		{
+			printf("Record %u of %u: %u %u, put %u %u\n", Index, Count, Time, Lux, Records[Index].Time, Records[Index].Lux);
+			return 1;
+		}
+	}
+	if(LogCodec_Get(&Decoder, &Time, &Lux))
+	{
+		printf("More than %u records\n", Count);
+		return 1;
+	}
+	return 0;
+}
+
+static uint32_t Bench_Random(void)
+{
+	return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
@@ -0,0 +1,323 @@
+/**
+ *  Power loss and wear model of the measurement log, runs on the PC
+ *  Builds Core/Src/Logger.c against a RAM image of the EEPROM (EepromSize,
+ *  the 24C02 unless it's given with -D like for the firmware). The page
+ *  writes of the EEPROM cache are counted and the power is cut at a
+ *  random one, the cut page only gets a random part of its new bytes.
+ *  After each cut the log boots again and:
+ *  - The newest block is the last one written whole.
+ *  - The blocks by age have consecutive sequences, all the ring is kept
+ *    but the block that was overwritten.
+ *  - The log clock goes on after the newest record.
+ *  - The boot reads each block once, LogBlocks reads.
+ *  The range run logs a noisy daylight swing with and without a deadband
+ *  and compares Logger_Range over random windows with the records it was
+ *  given, one by one: without a deadband the counts and sums match and
+ *  the minimum and maximum are within the lx of the summaries, with one
+ *  the count is a record off at most at each end and the mean, minimum
+ *  and maximum are within the deadband.
+ *  The wear run logs a quiet and a noisy signal for a simulated year and
+ *  reports the records per block, the time of a lap of the ring and the
+ *  years 1M write cycles last on the most written page.
+ *  Build: gcc -O2 -DUSE_HAL_DRIVER -DSTM32F103xB -ICore/Inc -ICore/Src -IDrivers/STM32F1xx_HAL_Driver/Inc
+ *         -IDrivers/CMSIS/Device/ST/STM32F1xx/Include -IDrivers/CMSIS/Include -o LoggerModel Tools/LoggerModel.c
+ *         Core/Src/LogCodec.c Core/Src/LogIndex.c Core/Src/SwingDoor.c Core/Src/ExportFrame.c -lm
+ *  Use:   LoggerModel [cuts]
+ */
+
+#include "Logger.h"
+#include "EepromCache.h"
+#include "ExportFrame.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <math.h>
+
+//The cycle counter the logger reads, the host has none
+static DWT_Type ModelDwt;
+#undef DWT
+#define DWT (&ModelDwt)
+
+#define PageCycles 1000000
+#define WearDays 365
+#define RangeRecords 20000
+#define RangeWindows 5000
+
+EepromCache ConfigCache;
+static uint8_t Eeprom[EepromSize];
+static uint32_t PageWrites[EepromSize / EepromPageSize];
+static uint32_t Tick;
+static long Budget = -1;  //Page writes before the cut, -1 never
+static jmp_buf Cut;
+
+uint32_t HAL_GetTick(void)
+{
+	return Tick;
+}
+
+uint32_t Acquisition_Micros(void)
+{
+	return Tick * 1000;
+}
+
+bool I2cQueue_Lock(I2C_HandleTypeDef *Handle, I2cPriority Priority)
+{
+	return true;
+}
+
+void I2cQueue_Unlock(I2C_HandleTypeDef *Handle, uint32_t Bytes)
+{
+}
+
+HAL_StatusTypeDef I2cBus_Report(I2C_HandleTypeDef *Handle, uint16_t Address, HAL_StatusTypeDef Result)
+{
+	return Result;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *Handle, uint16_t Address, uint16_t Register, uint16_t Size,
+		uint8_t *Data, uint16_t Length, uint32_t Timeout)
+{
+	memcpy(Data, Eeprom + Register, Length);
+	return HAL_OK;
+}
+
+uint32_t ConfigImage_Crc(const uint8_t *Data, uint16_t Length)
+{
+	return ExportFrame_Crc(Data, Length);
+}
+
+bool EepromCache_WritePage(uint16_t Register, const uint8_t *Data, uint16_t Length)
+{
+	PageWrites[Register / EepromPageSize]++;
+	if(Budget >= 0 && Budget-- == 0)
+	{
+		//The write cycle was cut, some of the bytes made it
+		for(uint16_t Index = 0; Index < Length; Index++)
+			if(rand() % 2)
+				Eeprom[Register + Index] = Data[Index];
+		longjmp(Cut, 1);
+	}
+	memcpy(Eeprom + Register, Data, Length);
+	ConfigCache.PagesWritten++;
+	return true;
+}
+
+#include "Logger.c"
+
+static uint32_t Model_Cuts(uint32_t Cuts);
+static uint32_t Model_Check(Logger *Log, uint32_t *Written, uint32_t *Total);
+static uint32_t Model_Ranges(uint16_t Deadband);
+static void Model_Wear(const char *Name, float Noise);
+
+int main(int argc, char **argv)
+{
+	uint32_t Cuts = (argc > 1) ? strtoul(argv[1], NULL, 0) : 20000;
+	uint32_t Failures;
+
+	srand(1);
+	Failures = Model_Cuts(Cuts);
+	Failures += Model_Ranges(0);
+	Failures += Model_Ranges(10);
+	Failures += Model_Ranges(50);
+	Model_Wear("Quiet", 0.2f);
+	Model_Wear("Noisy", 20.0f);
+	return Failures != 0;
+}
+
+//Private functions
+static uint32_t Model_Cuts(uint32_t Cuts)
+{
+	static Logger Log;
+	Sample New = {0, 0};
+	uint32_t Done = 0, Failures = 0, Written = 0, Total = 0, MaxReads = 0, Blocks;
+
+	memset(Eeprom, 0xFF, sizeof(Eeprom));
+	Logger_Init(&Log, NULL, 0xA0);
+	while(Done < Cuts)
+	{
+		Budget = (rand() % 3) ? rand() % (2 * PagesPerBlock) : -1;
+		if(setjmp(Cut) == 0)
+		{
+			//Until the cut, or a few blocks
+			for(uint32_t Record = 0; Record < 3 * LogMaxRecords; Record++)
+			{
+				Tick += LogPeriod;
+				New.Timestamp = Tick * 1000;
+				New.Lux = 500 + (rand() % 200) / 10.0f;
+				Logger_Add(&Log, &New);
+				for(uint16_t Step = 0; Step < 2 * PagesPerBlock + 2; Step++)
+				{
+					Blocks = Log.Blocks;
+					Logger_task(&Log);
+					if(Log.Blocks != Blocks)
+					{
+						Written = Log.Flushing.Sequence;
+						Total++;
+					}
+				}
+			}
+			Budget = -1;
+			continue;
+		}
+		Budget = -1;
+		Done++;
+		//The records still in RAM are lost
+		Tick += rand() % 100000;
+		Logger_Init(&Log, NULL, 0xA0);
+		if(Log.Reads > MaxReads)
+			MaxReads = Log.Reads;
+		Failures += Model_Check(&Log, &Written, &Total);
+	}
+	printf("Power cuts: %u, blocks written %u, most blocks read on a boot %u (LogBlocks %u), failures %u\n",
+			Done, Total, MaxReads, (unsigned) LogBlocks, Failures);
+	return Failures;
+}
+
+static uint32_t Model_Check(Logger *Log, uint32_t *Written, uint32_t *Total)
+{
+	LogBlock Block;
+	LogDecoder Decoder;
+	uint32_t Sequence, Time, Lux, Last = 0;
+	uint16_t Expected;
+
+	if(Log->Reads != LogBlocks)
+	{
+		printf("%u blocks read on the boot\n", Log->Reads);
+		return 1;
+	}
+	if(*Total == 0)
+		return 0;
+	//The cut block is whole if every byte of its last page made it
+	if(!Logger_Read(Log, 0, &Block) || (Block.Sequence != *Written && Block.Sequence != *Written + 1))
+	{
+		printf("Newest block %u, written %u\n", Block.Sequence, *Written);
+		return 1;
+	}
+	if(Block.Sequence != *Written)
+		(*Total)++;
+	*Written = Sequence = Block.Sequence;
+	Logger_Open(&Block, &Decoder);
+	while(LogCodec_Get(&Decoder, &Time, &Lux))
+		Last = Block.Start + Time * 100;
+	if((int32_t) (Logger_Now(Log) - Last) < LogPeriod)
+	{
+		printf("Log clock %u, the newest record is at %u\n", Logger_Now(Log), Last);
+		return 1;
+	}
+	for(uint16_t Age = 1; Age < Log->Count; Age++)
+	{
+		if(!Logger_Read(Log, Age, &Block) || Block.Sequence != --Sequence)
+		{
+			printf("Block of age %u out of order\n", Age);
+			return 1;
+		}
+	}
+	Expected = (*Total < LogBlocks) ? *Total : LogBlocks - 1;
+	if(Log->Count < Expected)
+	{
+		printf("%u blocks kept, %u expected\n", Log->Count, Expected);
+		return 1;
+	}
+	return 0;
+}
+
+//Records a bit more than a LogPeriod apart, like the samples make them
+static uint32_t Model_Ranges(uint16_t Deadband)
+{
+	static Logger Log;
+	static uint32_t Times[RangeRecords], Luxes[RangeRecords];
+	Sample New = {0, 0};
+	LogRange Range, Exact;
+	uint32_t Records = 0, First, Last, From, To, Failures = 0;
+	int32_t Count, MaxCount = 0;
+	double Mean, MaxMean = 0, MaxMin = 0, MaxMax = 0;
+	double Bound = (Deadband ? Deadband : 9) + 10;
+	bool Near;
+
+	memset(Eeprom, 0xFF, sizeof(Eeprom));
+	Budget = -1;
+	Logger_Init(&Log, NULL, 0xA0);
+	Logger_Deadband(&Log, Deadband);
+	while(Records < RangeRecords)
+	{
+		Tick += LogPeriod + rand() % 120;
+		New.Timestamp = Tick * 1000;
+		New.Lux = 300 + 200 * sinf(Records * 6.2832f / 2000) + 2.0f * (rand() % 2001 - 1000) / 1000.0f;
+		Logger_Add(&Log, &New);
+		if(Log.Samples == 0)
+		{
+			Times[Records] = Log.WaitingTime;
+			Luxes[Records++] = Log.WaitingLux;
+		}
+		for(uint16_t Step = 0; Step < 2 * PagesPerBlock + 2; Step++)
+			Logger_task(&Log);
+	}
+	//The EEPROM covers from the oldest block to the block filling in the RAM
+	First = Log.Starts[(Log.Head + LogBlocks + 1 - Log.Count) % LogBlocks];
+	Last = Log.Filling.Start;
+	for(uint32_t Window = 0; Window < RangeWindows; Window++)
+	{
+		From = First + (uint32_t) rand() * (uint32_t) rand() % (Last - First);
+		To = From + 1 + (uint32_t) rand() * (uint32_t) rand() % (Last - From);
+		LogIndex_Empty(&Exact);
+		Near = false;
+		for(uint32_t Record = 0; Record < Records; Record++)
+		{
+			if(Times[Record] >= From && Times[Record] < To)
+				LogIndex_Add(&Exact, Luxes[Record]);
+			//The blocks keep the times in 0.1s
+			Near |= Times[Record] - From + 100 < 200 || Times[Record] - To + 100 < 200;
+		}
+		if(Exact.Count < 2 || Near)
+			continue;
+		Logger_Range(&Log, From, To, &Range);
+		Count = (int32_t) Range.Count - (int32_t) Exact.Count;
+		Mean = (Range.Count ? (double) Range.Sum / Range.Count : 0) - (double) Exact.Sum / Exact.Count;
+		if(abs(Count) > abs(MaxCount))
+			MaxCount = Count;
+		if(fabs(Mean) > fabs(MaxMean))
+			MaxMean = Mean;
+		if(fabs((double) Range.Min - Exact.Min) > fabs(MaxMin))
+			MaxMin = (double) Range.Min - Exact.Min;
+		if(fabs((double) Range.Max - Exact.Max) > fabs(MaxMax))
+			MaxMax = (double) Range.Max - Exact.Max;
+		if(Deadband == 0 ? (Count != 0 || Range.Sum != Exact.Sum) : (abs(Count) > 2 || fabs(Mean) > Deadband)
+				|| fabs((double) Range.Min - Exact.Min) > Bound || fabs((double) Range.Max - Exact.Max) > Bound)
+			Failures++;
+	}
+	printf("Ranges, deadband %.1flx: %.1f records per block, most off by %d records, mean %.2flx, min %.1flx, max %.1flx, failures %u\n",
+			Deadband / 10.0, (double) Records / Log.Blocks, (int) MaxCount, MaxMean / 10, MaxMin / 10, MaxMax / 10, Failures);
+	return Failures;
+}
+
+//Noise in lx around a slow daylight swing
+static void Model_Wear(const char *Name, float Noise)
+{
+	static Logger Log;
+	Sample New = {0, 0};
+	uint32_t Records = WearDays * 24 * 3600 / (LogPeriod / 1000);
+	uint32_t Most = 0;
+	double Years;
+
+	memset(Eeprom, 0xFF, sizeof(Eeprom));
+	memset(PageWrites, 0, sizeof(PageWrites));
+	Budget = -1;
+	Logger_Init(&Log, NULL, 0xA0);
+	for(uint32_t Record = 0; Record < Records; Record++)
+	{
+		Tick += LogPeriod;
+		New.Timestamp = Tick * 1000;
+		New.Lux = 300 + 200 * sinf(Record * 6.2832f / (24 * 360)) + Noise * (rand() % 2001 - 1000) / 1000.0f;
+		Logger_Add(&Log, &New);
+		for(uint16_t Step = 0; Step < 2 * PagesPerBlock + 2; Step++)
+			Logger_task(&Log);
+	}
+	for(uint16_t Page = LogStart / EepromPageSize; Page < LogEnd / EepromPageSize; Page++)
+		if(PageWrites[Page] > Most)
+			Most = PageWrites[Page];
+	Years = (double) PageCycles / Most * WearDays / 365;
+	printf("%s: %.1f records per block, %.1f bytes per record, a lap of %.0f minutes, %.0f years for %u cycles\n",
+			Name, (double) Log.Encoded / Log.Blocks, (double) Log.EncodedBytes / Log.Encoded,
+			(double) Log.Encoded / Log.Blocks * LogBlocks * LogPeriod / 60000, Years, PageCycles);
+}
@@ -0,0 +1,117 @@
+/**
+ *  Swinging door check, runs on the PC
+ *  Replays two synthetic traces of 30000 records of 10s (~3.5 days)
+ *  through Core/Src/SwingDoor.c with each deadband of the Diagnostics
+ *  screen, draws the lines between the stored points as the decoder does
+ *  and reports the points stored, the ratio and the largest distance of
+ *  a record to the line, which must not pass the deadband.
+ *  - Daylight: a clear sky day curve with passing clouds and sensor noise.
+ *  - Office: lights switched between 200 and 4000lx with sensor noise.
+ *  Build: gcc -O2 -ICore/Inc -o SwingDoorCheck Tools/SwingDoorCheck.c Core/Src/SwingDoor.c -lm
+ */
+
+#include "SwingDoor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define TraceRecords 30000
+#define RecordPeriod 10000 //ms
+
+typedef enum Trace
+{
+	Trace_Daylight,
+	Trace_Office,
+	Traces
+}Trace;
+
+static const char *TraceNames[Traces] = {"Daylight", "Office"};
+static const uint16_t Deadbands[] = {1, 5, 10, 50, 100, 500}; //0.1lx
+
+static uint32_t Times[TraceRecords], Luxes[TraceRecords];
+static uint32_t StoredTimes[TraceRecords + 1], StoredLuxes[TraceRecords + 1];
+
+static void Check_Trace(Trace Shape);
+static double Check_Error(uint32_t Stored);
+
+int main(void)
+{
+	SwingDoor Door;
+	uint32_t Stored, Failures = 0;
+	double Error;
+
+	for(Trace Shape = 0; Shape < Traces; Shape++)
+	{
+		Check_Trace(Shape);
+		for(uint16_t Band = 0; Band < sizeof(Deadbands) / sizeof(uint16_t); Band++)
+		{
+			SwingDoor_Init(&Door, Deadbands[Band]);
+			Stored = 0;
+			for(uint32_t Index = 0; Index < TraceRecords; Index++)
+				if(SwingDoor_Add(&Door, Times[Index], Luxes[Index], &StoredTimes[Stored], &StoredLuxes[Stored]))
+					Stored++;
+			if(SwingDoor_Flush(&Door, &StoredTimes[Stored], &StoredLuxes[Stored]))
+				Stored++;
+			Error = Check_Error(Stored);
+			printf("%-8s band %5.1flx: %5u of %u stored, %5.1fx, largest error %6.3flx%s\n", TraceNames[Shape],
+					Deadbands[Band] / 10.0, Stored, TraceRecords, (double) TraceRecords / Stored, Error / 10,
+					(Error > Deadbands[Band]) ? " OVER" : "");
+			if(Error > Deadbands[Band])
+				Failures++;
+		}
+	}
+	printf("Failures %u\n", Failures);
+	return Failures != 0;
+}
+
+//Private functions
+static void Check_Trace(Trace Shape)
+{
+	double Lux = (Shape == Trace_Office) ? 3000 : 0;
+	double Day, Sun, Cloud;
+
+	srand(1 + Shape);
+	for(uint32_t Index = 0; Index < TraceRecords; Index++)
+	{
+		if(Shape == Trace_Daylight)
+		{
+			Day = fmod(Index * (RecordPeriod / 1000.0), 86400) / 86400;
+			Sun = (Day > 0.25 && Day < 0.75) ? 30000 * sin((Day - 0.25) * 2 * M_PI) : 0;
+			Cloud = (rand() % 100 < 2) ? (rand() % 1000) / 1000.0 : 1;
+			Lux = Sun * Cloud * 0.1 + (rand() % 11 - 5) * 0.1;
+		}
+		else
+		{
+			if(rand() % 500 == 0)
+				Lux = (rand() % 2) ? 4000 : 200;
+			Lux += (rand() % 7 - 3) * 0.1;
+		}
+		if(Lux < 0)
+			Lux = 0;
+		//A few ms of jitter on the record times
+		Times[Index] = Index * RecordPeriod + rand() % 3;
+		Luxes[Index] = (uint32_t) (Lux * 10 + 0.5);
+	}
+}
+
+//0.1lx, of the records up to the last stored point to the lines between the stored points
+static double Check_Error(uint32_t Stored)
+{
+	double Line, Error, Worst = 0;
+	uint32_t Segment = 0;
+
+	for(uint32_t Index = 0; Index < TraceRecords && Times[Index] <= StoredTimes[Stored - 1]; Index++)
+	{
+		while(Segment + 1 < Stored && StoredTimes[Segment + 1] < Times[Index])
+			Segment++;
+		if(Times[Index] == StoredTimes[Segment])
+			Line = StoredLuxes[Segment];
+		else
+			Line = StoredLuxes[Segment] + ((double) StoredLuxes[Segment + 1] - StoredLuxes[Segment]) *
+					(Times[Index] - StoredTimes[Segment]) / (double) (StoredTimes[Segment + 1] - StoredTimes[Segment]);
+		Error = fabs(Line - Luxes[Index]);
+		if(Error > Worst)
+			Worst = Error;
+	}
+	return Worst;
+}